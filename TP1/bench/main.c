@@ -0,0 +1,927 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "counters.h"
+#include "filter.h"
+#include "futex-queue.h"
+#include "image.h"
+#include "log.h"
+#include "pipeline.h"
+#include "queue.h"
+#include "registry.h"
+#include "service.h"
+
+/* a benchmark is repeated until it ran for at least this long */
+#define BENCH_MIN_SECONDS 0.25
+#define BENCH_MAX_ITERATIONS 1000
+#define BENCH_MAX_RESULTS 1024
+
+/* items pushed through the queues by the queue benchmarks */
+#define BENCH_QUEUE_ITEMS 100000
+#define BENCH_QUEUE_SIZE 32
+
+typedef struct bench_size {
+    size_t width;
+    size_t height;
+} bench_size_t;
+
+typedef struct bench_pipeline {
+    const char* name;
+    int (*run)(image_dir_t* image_dir);
+} bench_pipeline_t;
+
+typedef struct bench_result {
+    char kind[16];
+    char name[64];
+    size_t width;
+    size_t height;
+    unsigned int iterations;
+    double seconds;
+    double mpixels_per_sec;
+    bool has_counters;
+    counters_sample_t counters; /* over all the iterations */
+} bench_result_t;
+
+/* blocking queues compared by the queue benchmarks */
+typedef struct bench_queue {
+    const char* name;
+    void* (*create)(size_t size);
+    void (*destroy)(void* queue);
+    int (*push)(void* queue, void* ptr);
+    void* (*pop)(void* queue);
+} bench_queue_t;
+
+/* threads on both sides of the queue, 1 x 20 is the input of the pthread pipeline */
+typedef struct bench_queue_threads {
+    unsigned int producers;
+    unsigned int consumers;
+} bench_queue_threads_t;
+
+typedef struct bench_queue_args {
+    const bench_queue_t* queue;
+    void* instance;
+    size_t items;
+} bench_queue_args_t;
+
+static const bench_size_t default_sizes[] = {
+    {256, 256}, {1280, 720}, {1920, 1080}, {3840, 2160}, {7680, 4320},
+};
+
+static const bench_pipeline_t pipelines[] = {
+    {"serial", pipeline_serial},
+    {"pthread", pipeline_pthread},
+    {"tbb", pipeline_tbb},
+    {"tbb-fused", pipeline_tbb_fused},
+    {"openmp", pipeline_openmp},
+    {"coroutine", pipeline_coroutine},
+    {"process", pipeline_process},
+#ifdef HAVE_OPENCL
+    {"opencl", pipeline_opencl},
+#endif
+};
+
+static void* bench_mutex_queue_create(size_t size) {
+    return queue_create(size);
+}
+
+static void bench_mutex_queue_destroy(void* queue) {
+    queue_destroy(queue);
+}
+
+static int bench_mutex_queue_push(void* queue, void* ptr) {
+    return queue_push(queue, ptr);
+}
+
+static void* bench_mutex_queue_pop(void* queue) {
+    return queue_pop(queue);
+}
+
+static void* bench_futex_queue_create(size_t size) {
+    return futex_queue_create(size);
+}
+
+static void bench_futex_queue_destroy(void* queue) {
+    futex_queue_destroy(queue);
+}
+
+static int bench_futex_queue_push(void* queue, void* ptr) {
+    return futex_queue_push(queue, ptr);
+}
+
+static void* bench_futex_queue_pop(void* queue) {
+    return futex_queue_pop(queue);
+}
+
+static const bench_queue_t queues[] = {
+    {"mutex", bench_mutex_queue_create, bench_mutex_queue_destroy, bench_mutex_queue_push, bench_mutex_queue_pop},
+    {"futex", bench_futex_queue_create, bench_futex_queue_destroy, bench_futex_queue_push, bench_futex_queue_pop},
+};
+
+static const bench_queue_threads_t queue_threads[] = {
+    {1, 1},
+    {1, 20},
+    {20, 20},
+};
+
+static bench_result_t results[BENCH_MAX_RESULTS];
+static size_t result_count = 0;
+static bool use_counters   = false;
+
+static void show_help(FILE* f, const char* exec_name) {
+    fprintf(f, "Usage: %s [OPTION]...\n", exec_name);
+    fprintf(f, "\n");
+    fprintf(f, "Options:\n");
+    fprintf(f, "  --filters                       micro-benchmark every filter, and the default chain stage by\n");
+    fprintf(f, "                                  stage against its fused form\n");
+    fprintf(f, "  --sizes WxH[,WxH...]            frame sizes of the filter benchmarks (default: 256x256 to 8K)\n");
+    fprintf(f, "  --pipelines DIR                 benchmark every pipeline on synthetic frames generated in DIR\n");
+    fprintf(f, "  --batches N                     with --pipelines, run the frames N at a time through a new\n");
+    fprintf(f, "                                  pthread pipeline per batch and through one warm service\n");
+    fprintf(f, "  --queues                        benchmark the blocking queues, with context switches per item\n");
+    fprintf(f, "  --counters                      also print the IPC and cache/TLB misses per pixel from the\n");
+    fprintf(f, "                                  hardware performance counters, per filter and per pipeline stage\n");
+    fprintf(f, "  --frames N                      number of synthetic frames (default: 64)\n");
+    fprintf(f, "  --frame-size WxH                size of the synthetic frames (default: 256x256)\n");
+    fprintf(f, "  --csv FILE                      write the results as CSV\n");
+    fprintf(f, "  --json FILE                     write the results as JSON\n");
+    fprintf(f, "  --compare FILE                  compare the results against a baseline CSV\n");
+    fprintf(f, "  --threshold PERCENT             slowdown reported as a regression (default: 10)\n");
+    fprintf(f, "  --alloc [malloc|aligned|thp|hugetlb|memfd]\n");
+    fprintf(f, "                                  allocation policy of the frames (default: malloc)\n");
+    fprintf(f, "  --prefault                      touch the frame pages when they are allocated\n");
+    fprintf(f, "  --help                          show this help\n");
+}
+
+static void fail_missing_argument(const char* exec_name, const char* opt) {
+    fprintf(stderr, "%s: option '%s' requires an argument\n", exec_name, opt);
+    fprintf(stderr, "Try '%s --help' for more information.\n", exec_name);
+    exit(1);
+}
+
+static void fail_unknown_argument(const char* exec_name, const char* opt) {
+    fprintf(stderr, "%s: unrecognized option '%s'\n", exec_name, opt);
+    fprintf(stderr, "Try '%s --help' for more information.\n", exec_name);
+    exit(1);
+}
+
+static void fail_argument_parsing(const char* exec_name, const char* arg_name, const char* arg) {
+    fprintf(stderr, "%s: failed to parse '%s' for argument `%s`\n", exec_name, arg, arg_name);
+    fprintf(stderr, "Try '%s --help' for more information.\n", exec_name);
+    exit(1);
+}
+
+static double bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int parse_size(const char* arg, bench_size_t* size) {
+    char* end;
+
+    size->width = strtoul(arg, &end, 10);
+    if (end == arg || *end != 'x') {
+        return -1;
+    }
+
+    arg          = end + 1;
+    size->height = strtoul(arg, &end, 10);
+    if (end == arg || (*end != '\0' && *end != ',')) {
+        return -1;
+    }
+
+    if (size->width < 3 || size->height < 3) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_sizes(const char* arg, bench_size_t* sizes, size_t max_count, size_t* count) {
+    *count = 0;
+
+    while (*arg != '\0') {
+        if (*count == max_count || parse_size(arg, &sizes[*count]) < 0) {
+            return -1;
+        }
+        (*count)++;
+
+        const char* next = strchr(arg, ',');
+        if (next == NULL) {
+            break;
+        }
+        arg = next + 1;
+    }
+
+    return (*count > 0) ? 0 : -1;
+}
+
+static bench_result_t* add_result(const char* kind, const char* name, size_t width, size_t height) {
+    if (result_count == BENCH_MAX_RESULTS) {
+        LOG_ERROR("too many results");
+        return NULL;
+    }
+
+    bench_result_t* result = &results[result_count++];
+    memset(result, 0, sizeof(*result));
+    snprintf(result->kind, sizeof(result->kind), "%s", kind);
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->width  = width;
+    result->height = height;
+
+    return result;
+}
+
+static void print_result(bench_result_t* result) {
+    printf("%-9s %-20s %5zux%-5zu %6u %12.3f %12.2f\n", result->kind, result->name, result->width, result->height,
+           result->iterations, 1e3 * result->seconds / result->iterations, result->mpixels_per_sec);
+    fflush(stdout);
+}
+
+/* counters of the filter benchmarks, the stages nested in a filter are counted with it */
+static void print_counters(void) {
+    printf("\n%-9s %-20s %11s %12s %12s %12s %12s\n", "kind", "name", "size", "IPC", "cycles/px", "LLC miss/px",
+           "dTLB miss/px");
+
+    for (size_t i = 0; i < result_count; i++) {
+        bench_result_t* result = &results[i];
+        if (!result->has_counters) {
+            continue;
+        }
+
+        printf("%-9s %-20s %5zux%-5zu", result->kind, result->name, result->width, result->height);
+        counters_print_ratios(&result->counters, result->width * result->height * result->iterations);
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+static image_t* create_random_image(size_t id, size_t width, size_t height) {
+    image_t* image = image_create(id, width, height);
+    if (image == NULL) {
+        return NULL;
+    }
+
+    /* same content as data/generate-random: random RGB, opaque alpha */
+    for (size_t i = 0; i < width * height; i++) {
+        unsigned int value        = rand();
+        image->pixels[i].bytes[0] = value;
+        image->pixels[i].bytes[1] = value >> 8;
+        image->pixels[i].bytes[2] = value >> 16;
+        image->pixels[i].bytes[3] = 0xff;
+    }
+
+    return image;
+}
+
+static int bench_filters(bench_size_t* sizes, size_t size_count) {
+    image_t* input;
+
+    for (size_t s = 0; s < size_count; s++) {
+        input = create_random_image(0, sizes[s].width, sizes[s].height);
+        if (input == NULL) {
+            LOG_ERROR("failed to create %zux%zu frame", sizes[s].width, sizes[s].height);
+            goto fail_exit;
+        }
+
+        /* filters with a parameter run with its default value */
+        for (size_t f = 0; f < filter_registry_count; f++) {
+            const filter_entry_t* filter = &filter_registry[f];
+
+            bench_result_t* result = add_result("filter", filter->name, input->width, input->height);
+            if (result == NULL) {
+                goto fail_free_input;
+            }
+
+            counters_sample_t counters_start;
+            result->has_counters = use_counters && counters_read(&counters_start) == 0;
+
+            double start = bench_now();
+            do {
+                image_t* output = filter->apply(input, filter->default_value);
+                if (output == NULL) {
+                    LOG_ERROR("filter `%s` failed", filter->name);
+                    goto fail_free_input;
+                }
+                image_destroy(output);
+
+                result->iterations++;
+                result->seconds = bench_now() - start;
+            } while (result->seconds < BENCH_MIN_SECONDS && result->iterations < BENCH_MAX_ITERATIONS);
+
+            if (result->has_counters && counters_read(&result->counters) == 0) {
+                for (int event = 0; event < COUNTERS_EVENT_COUNT; event++) {
+                    result->counters.values[event] -= counters_start.values[event];
+                }
+            } else {
+                result->has_counters = false;
+            }
+
+            result->mpixels_per_sec = (input->width * input->height * result->iterations) / result->seconds / 1e6;
+            print_result(result);
+        }
+
+        image_destroy(input);
+    }
+
+    return 0;
+
+fail_free_input:
+    image_destroy(input);
+fail_exit:
+    return -1;
+}
+
+/* the default chain one filter after the other, as the stages of the pipelines run it */
+static image_t* bench_chain_stages(image_t* image) {
+    image_t* scaled = filter_scale_up(image, 2);
+    if (scaled == NULL) {
+        return NULL;
+    }
+
+    image_t* desaturated = filter_desaturate(scaled);
+    image_destroy(scaled);
+    if (desaturated == NULL) {
+        return NULL;
+    }
+
+    image_t* flipped = filter_horizontal_flip(desaturated);
+    image_destroy(desaturated);
+    if (flipped == NULL) {
+        return NULL;
+    }
+
+    image_t* edges = filter_sobel(flipped);
+    image_destroy(flipped);
+    return edges;
+}
+
+/* stage by stage against the fused chain, the outputs are compared once per size */
+static int bench_chain(bench_size_t* sizes, size_t size_count) {
+    static const struct {
+        const char* name;
+        image_t* (*apply)(image_t* image);
+    } chains[] = {
+        {"stages", bench_chain_stages},
+        {"fused", pipeline_chain_fused},
+    };
+
+    image_t* input;
+
+    for (size_t s = 0; s < size_count; s++) {
+        input = create_random_image(0, sizes[s].width, sizes[s].height);
+        if (input == NULL) {
+            LOG_ERROR("failed to create %zux%zu frame", sizes[s].width, sizes[s].height);
+            goto fail_exit;
+        }
+
+        bool same         = false;
+        image_t* expected = bench_chain_stages(input);
+        image_t* actual   = pipeline_chain_fused(input);
+        if (expected != NULL && actual != NULL && expected->width == actual->width &&
+            expected->height == actual->height) {
+            same = memcmp(expected->pixels, actual->pixels, actual->width * actual->height * sizeof(pixel_t)) == 0;
+        }
+
+        if (expected != NULL) {
+            image_destroy(expected);
+        }
+        if (actual != NULL) {
+            image_destroy(actual);
+        }
+
+        if (!same) {
+            LOG_ERROR("the fused chain differs from the filters on a %zux%zu frame", input->width, input->height);
+            goto fail_free_input;
+        }
+
+        for (size_t c = 0; c < sizeof(chains) / sizeof(chains[0]); c++) {
+            bench_result_t* result = add_result("chain", chains[c].name, input->width, input->height);
+            if (result == NULL) {
+                goto fail_free_input;
+            }
+
+            double start = bench_now();
+            do {
+                image_t* output = chains[c].apply(input);
+                if (output == NULL) {
+                    LOG_ERROR("chain `%s` failed", chains[c].name);
+                    goto fail_free_input;
+                }
+                image_destroy(output);
+
+                result->iterations++;
+                result->seconds = bench_now() - start;
+            } while (result->seconds < BENCH_MIN_SECONDS && result->iterations < BENCH_MAX_ITERATIONS);
+
+            result->mpixels_per_sec = (input->width * input->height * result->iterations) / result->seconds / 1e6;
+            print_result(result);
+        }
+
+        image_destroy(input);
+    }
+
+    return 0;
+
+fail_free_input:
+    image_destroy(input);
+fail_exit:
+    return -1;
+}
+
+static int generate_frames(const char* directory, size_t count, bench_size_t* size) {
+    char filename[256];
+
+    if (mkdir(directory, 0755) < 0 && errno != EEXIST) {
+        LOG_ERROR_ERRNO("mkdir");
+        goto fail_exit;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        image_t* image = create_random_image(i, size->width, size->height);
+        if (image == NULL) {
+            goto fail_exit;
+        }
+
+        snprintf(filename, sizeof(filename), "%s/%04zu.png", directory, i);
+        int ret = image_save_png(image, filename);
+        image_destroy(image);
+        if (ret < 0) {
+            goto fail_exit;
+        }
+    }
+
+    /* a leftover frame from a larger run would extend the sequence */
+    snprintf(filename, sizeof(filename), "%s/%04zu.png", directory, count);
+    unlink(filename);
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+static int bench_pipelines(const char* directory, size_t frame_count, bench_size_t* frame_size) {
+    if (generate_frames(directory, frame_count, frame_size) < 0) {
+        LOG_ERROR("failed to generate frames in `%s`", directory);
+        goto fail_exit;
+    }
+
+    for (size_t p = 0; p < sizeof(pipelines) / sizeof(pipelines[0]); p++) {
+        image_dir_t image_dir = {.load_current = 0, .stop = false};
+        image_dir_reset(&image_dir, directory, directory, pipelines[p].name);
+
+        bench_result_t* result = add_result("pipeline", pipelines[p].name, frame_size->width, frame_size->height);
+        if (result == NULL) {
+            goto fail_exit;
+        }
+
+        /* counted from a fresh set of threads for every pipeline */
+        if (use_counters && counters_open() < 0) {
+            goto fail_exit;
+        }
+
+        /* the backends print progress on stdout, keep the report readable */
+        fflush(stdout);
+        int stdout_copy = dup(STDOUT_FILENO);
+        int null_fd     = open("/dev/null", O_WRONLY);
+        if (stdout_copy < 0 || null_fd < 0) {
+            LOG_ERROR_ERRNO("open");
+            goto fail_exit;
+        }
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+
+        double start = bench_now();
+        int ret      = pipelines[p].run(&image_dir);
+        double end   = bench_now();
+
+        if (image_dir_close(&image_dir) < 0) {
+            ret = -1;
+        }
+
+        fflush(stdout);
+        dup2(stdout_copy, STDOUT_FILENO);
+        close(stdout_copy);
+
+        if (ret < 0) {
+            LOG_ERROR("pipeline `%s` failed", pipelines[p].name);
+            goto fail_exit;
+        }
+
+        result->iterations      = image_dir.load_current;
+        result->seconds         = end - start;
+        result->mpixels_per_sec = (frame_size->width * frame_size->height * result->iterations) / result->seconds / 1e6;
+        print_result(result);
+
+        if (use_counters) {
+            counters_print(pipelines[p].name);
+            counters_close();
+            printf("\n");
+        }
+    }
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+/* one batch of the sequence through a new pthread pipeline, or through the service when there is one */
+static int bench_batch(image_dir_t* image_dir, pipeline_service_t* service) {
+    if (service == NULL) {
+        return pipeline_pthread(image_dir);
+    }
+
+    if (pipeline_service_submit_dir(service, image_dir) < 0) {
+        return -1;
+    }
+    return pipeline_service_wait(service, NULL);
+}
+
+/* ms/iter is the latency of a batch, the startup and teardown of the pthread pipeline are paid by every batch */
+static int bench_batches(const char* directory, size_t frame_count, bench_size_t* frame_size, size_t batch_size) {
+    static const char* names[] = {"pthread", "service"};
+
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        image_dir_t image_dir       = {.load_current = 0, .stop = false};
+        pipeline_service_t* service = NULL;
+        bench_result_t* result      = add_result("batch", names[n], frame_size->width, frame_size->height);
+        if (result == NULL) {
+            goto fail_exit;
+        }
+
+        image_dir_reset(&image_dir, directory, directory, names[n]);
+        image_dir.no_save = true;
+
+        /* the service threads are part of the first batch */
+        double start = bench_now();
+        if (n == 1 && (service = pipeline_service_create(0)) == NULL) {
+            goto fail_exit;
+        }
+
+        /* the pthread pipeline prints progress on stdout */
+        fflush(stdout);
+        int stdout_copy = dup(STDOUT_FILENO);
+        int null_fd     = open("/dev/null", O_WRONLY);
+        if (stdout_copy < 0 || null_fd < 0) {
+            LOG_ERROR_ERRNO("open");
+            goto fail_exit;
+        }
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+
+        int ret = 0;
+        for (size_t first = 0; first < frame_count && ret == 0; first += batch_size) {
+            image_dir.load_end = (frame_count - first < batch_size) ? frame_count : first + batch_size;
+            ret                = bench_batch(&image_dir, service);
+            result->iterations++;
+        }
+
+        if (service != NULL) {
+            pipeline_service_destroy(service);
+        }
+        double end = bench_now();
+
+        if (image_dir_close(&image_dir) < 0) {
+            ret = -1;
+        }
+
+        fflush(stdout);
+        dup2(stdout_copy, STDOUT_FILENO);
+        close(stdout_copy);
+
+        if (ret < 0 || image_dir.save_count != frame_count) {
+            LOG_ERROR("batches of `%s` failed", names[n]);
+            goto fail_exit;
+        }
+
+        result->seconds         = end - start;
+        result->mpixels_per_sec = (frame_size->width * frame_size->height * frame_count) / result->seconds / 1e6;
+        print_result(result);
+    }
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+/* items are non-NULL, NULL stops a consumer */
+static void* bench_queue_producer(void* arg) {
+    bench_queue_args_t* args = arg;
+    for (size_t i = 0; i < args->items; i++) {
+        if (args->queue->push(args->instance, (void*)(i + 1)) < 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void* bench_queue_consumer(void* arg) {
+    bench_queue_args_t* args = arg;
+    while (args->queue->pop(args->instance) != NULL) {
+    }
+    return NULL;
+}
+
+static long bench_context_switches(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+/* voluntary and involuntary context switches of the whole process, per item */
+static int bench_queues(void) {
+    printf("\n%-9s %-20s %11s %12s %12s\n", "kind", "name", "threads", "Mitem/s", "switch/item");
+
+    for (size_t q = 0; q < sizeof(queues) / sizeof(queues[0]); q++) {
+        for (size_t t = 0; t < sizeof(queue_threads) / sizeof(queue_threads[0]); t++) {
+            unsigned int producers = queue_threads[t].producers;
+            unsigned int consumers = queue_threads[t].consumers;
+            pthread_t threads[producers + consumers];
+
+            bench_queue_args_t args = {&queues[q], queues[q].create(BENCH_QUEUE_SIZE), BENCH_QUEUE_ITEMS / producers};
+            if (args.instance == NULL) {
+                LOG_ERROR("failed to create `%s` queue", queues[q].name);
+                goto fail_exit;
+            }
+
+            long switches = bench_context_switches();
+            double start  = bench_now();
+
+            for (unsigned int i = 0; i < producers + consumers; i++) {
+                errno = pthread_create(&threads[i], NULL, (i < producers) ? bench_queue_producer : bench_queue_consumer,
+                                       &args);
+                if (errno != 0) {
+                    LOG_ERROR_ERRNO("pthread_create");
+                    goto fail_exit;
+                }
+            }
+
+            for (unsigned int i = 0; i < producers; i++) {
+                pthread_join(threads[i], NULL);
+            }
+            for (unsigned int i = 0; i < consumers; i++) {
+                queues[q].push(args.instance, NULL);
+            }
+            for (unsigned int i = producers; i < producers + consumers; i++) {
+                pthread_join(threads[i], NULL);
+            }
+
+            double seconds = bench_now() - start;
+            switches       = bench_context_switches() - switches;
+            size_t items   = args.items * producers;
+
+            queues[q].destroy(args.instance);
+
+            char threads_name[32];
+            snprintf(threads_name, sizeof(threads_name), "%ux%u", producers, consumers);
+            printf("%-9s %-20s %11s %12.3f %12.3f\n", "queue", queues[q].name, threads_name, items / seconds / 1e6,
+                   (double)switches / items);
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+static int write_csv(const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        LOG_ERROR_ERRNO("fopen");
+        return -1;
+    }
+
+    fprintf(file, "kind,name,width,height,iterations,seconds,mpixels_per_sec\n");
+    for (size_t i = 0; i < result_count; i++) {
+        bench_result_t* result = &results[i];
+        fprintf(file, "%s,%s,%zu,%zu,%u,%.6f,%.3f\n", result->kind, result->name, result->width, result->height,
+                result->iterations, result->seconds, result->mpixels_per_sec);
+    }
+
+    return fclose(file);
+}
+
+static int write_json(const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        LOG_ERROR_ERRNO("fopen");
+        return -1;
+    }
+
+    fprintf(file, "[\n");
+    for (size_t i = 0; i < result_count; i++) {
+        bench_result_t* result = &results[i];
+        fprintf(file,
+                "  {\"kind\": \"%s\", \"name\": \"%s\", \"width\": %zu, \"height\": %zu, \"iterations\": %u, "
+                "\"seconds\": %.6f, \"mpixels_per_sec\": %.3f}%s\n",
+                result->kind, result->name, result->width, result->height, result->iterations, result->seconds,
+                result->mpixels_per_sec, (i + 1 < result_count) ? "," : "");
+    }
+    fprintf(file, "]\n");
+
+    return fclose(file);
+}
+
+/* returns the number of regressions, or -1 if the baseline can't be read */
+static int compare_baseline(const char* filename, double threshold) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        LOG_ERROR_ERRNO("fopen");
+        return -1;
+    }
+
+    char line[512];
+    int regressions = 0;
+
+    printf("\n%-9s %-20s %11s %12s %12s %8s\n", "kind", "name", "size", "baseline", "current", "change");
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        bench_result_t baseline;
+        if (sscanf(line, "%15[^,],%63[^,],%zu,%zu,%u,%lf,%lf", baseline.kind, baseline.name, &baseline.width,
+                   &baseline.height, &baseline.iterations, &baseline.seconds, &baseline.mpixels_per_sec) != 7) {
+            continue;
+        }
+
+        for (size_t i = 0; i < result_count; i++) {
+            bench_result_t* result = &results[i];
+            if (strcmp(result->kind, baseline.kind) != 0 || strcmp(result->name, baseline.name) != 0 ||
+                result->width != baseline.width || result->height != baseline.height) {
+                continue;
+            }
+
+            double change   = 100.0 * (result->mpixels_per_sec - baseline.mpixels_per_sec) / baseline.mpixels_per_sec;
+            bool regression = change < -threshold;
+            regressions += regression;
+
+            printf("%-9s %-20s %5zux%-5zu %12.2f %12.2f %+7.1f%%%s\n", result->kind, result->name, result->width,
+                   result->height, baseline.mpixels_per_sec, result->mpixels_per_sec, change,
+                   regression ? "  REGRESSION" : "");
+        }
+    }
+
+    fclose(file);
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    char* exec_name         = argv[0];
+    bool do_filters         = false;
+    bool do_queues          = false;
+    bool prefault           = false;
+    image_alloc_t alloc     = IMAGE_ALLOC_MALLOC;
+    char* pipeline_dir_name = NULL;
+    char* csv_filename      = NULL;
+    char* json_filename     = NULL;
+    char* baseline_filename = NULL;
+    double threshold        = 10.0;
+    size_t frame_count      = 64;
+    size_t batch_size       = 0;
+
+    bench_size_t frame_size = {256, 256};
+    bench_size_t sizes[16];
+    size_t size_count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    memcpy(sizes, default_sizes, sizeof(default_sizes));
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp("--filters", argv[i]) == 0) {
+            do_filters = true;
+        } else if (strcmp("--queues", argv[i]) == 0) {
+            do_queues = true;
+        } else if (strcmp("--counters", argv[i]) == 0) {
+            use_counters = true;
+        } else if (strcmp("--prefault", argv[i]) == 0) {
+            prefault = true;
+        } else if (strcmp("--help", argv[i]) == 0) {
+            show_help(stdout, exec_name);
+            exit(0);
+        } else if (i >= argc - 1) {
+            if (argv[i][0] == '-' && argv[i][1] == '-') {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+            fail_unknown_argument(exec_name, argv[i]);
+        } else if (strcmp("--sizes", argv[i]) == 0) {
+            if (parse_sizes(argv[i + 1], sizes, sizeof(sizes) / sizeof(sizes[0]), &size_count) < 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+            i++;
+        } else if (strcmp("--pipelines", argv[i]) == 0) {
+            pipeline_dir_name = argv[++i];
+        } else if (strcmp("--frames", argv[i]) == 0) {
+            frame_count = strtoul(argv[i + 1], NULL, 10);
+            if (frame_count == 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+            i++;
+        } else if (strcmp("--batches", argv[i]) == 0) {
+            batch_size = strtoul(argv[i + 1], NULL, 10);
+            if (batch_size == 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+            i++;
+        } else if (strcmp("--frame-size", argv[i]) == 0) {
+            if (parse_size(argv[i + 1], &frame_size) < 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+            i++;
+        } else if (strcmp("--alloc", argv[i]) == 0) {
+            if (image_alloc_parse(argv[i + 1], &alloc) < 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+            i++;
+        } else if (strcmp("--csv", argv[i]) == 0) {
+            csv_filename = argv[++i];
+        } else if (strcmp("--json", argv[i]) == 0) {
+            json_filename = argv[++i];
+        } else if (strcmp("--compare", argv[i]) == 0) {
+            baseline_filename = argv[++i];
+        } else if (strcmp("--threshold", argv[i]) == 0) {
+            threshold = strtod(argv[i + 1], NULL);
+            if (threshold <= 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+            i++;
+        } else {
+            fail_unknown_argument(exec_name, argv[i]);
+        }
+    }
+
+    image_alloc_configure(alloc, prefault);
+
+    printf("%-9s %-20s %11s %6s %12s %12s\n", "kind", "name", "size", "iter", "ms/iter", "Mpixel/s");
+
+    if (do_filters && use_counters && counters_open() < 0) {
+        LOG_ERROR("failed to open the performance counters");
+        exit(1);
+    }
+
+    if (do_filters && bench_filters(sizes, size_count) < 0) {
+        LOG_ERROR("failed to benchmark filters");
+        exit(1);
+    }
+
+    if (do_filters && bench_chain(sizes, size_count) < 0) {
+        LOG_ERROR("failed to benchmark the fused chain");
+        exit(1);
+    }
+
+    if (do_filters && use_counters) {
+        print_counters();
+        counters_close();
+    }
+
+    if (pipeline_dir_name != NULL && bench_pipelines(pipeline_dir_name, frame_count, &frame_size) < 0) {
+        LOG_ERROR("failed to benchmark pipelines");
+        exit(1);
+    }
+
+    if (pipeline_dir_name != NULL && batch_size > 0 &&
+        bench_batches(pipeline_dir_name, frame_count, &frame_size, batch_size) < 0) {
+        LOG_ERROR("failed to benchmark batches");
+        exit(1);
+    }
+
+    if (do_queues && bench_queues() < 0) {
+        LOG_ERROR("failed to benchmark queues");
+        exit(1);
+    }
+
+    image_alloc_release();
+
+    if (csv_filename != NULL && write_csv(csv_filename) < 0) {
+        LOG_ERROR("failed to write `%s`", csv_filename);
+        exit(1);
+    }
+
+    if (json_filename != NULL && write_json(json_filename) < 0) {
+        LOG_ERROR("failed to write `%s`", json_filename);
+        exit(1);
+    }
+
+    if (baseline_filename != NULL) {
+        int regressions = compare_baseline(baseline_filename, threshold);
+        if (regressions < 0) {
+            LOG_ERROR("failed to read baseline `%s`", baseline_filename);
+            exit(1);
+        }
+
+        if (regressions > 0) {
+            printf("%d regression(s) above %.1f%%\n", regressions, threshold);
+            exit(2);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#!/usr/bin/env bash
+
+# Compares the manifests written with `--manifest` against the first one,
+# reports the frames whose hash or size differ and the missing frames.
+
+if [[ $# -lt 2 ]]; then
+    echo "Usage: $0 REFERENCE MANIFEST..."
+    exit 1
+fi
+
+REFERENCE="$1"
+shift
+
+status=0
+for manifest in "$@"; do
+    if cmp -s "$REFERENCE" "$manifest"; then
+        echo "$manifest: ok ($(wc -l < "$manifest") frames)"
+        continue
+    fi
+
+    status=1
+    awk -v name="$manifest" '
+        NR == FNR {
+            reference[$1] = $2 " " $3
+            next
+        }
+        {
+            seen[$1] = 1
+            if (!($1 in reference)) {
+                printf "%s: frame %s is not in the reference\n", name, $1
+            } else if (reference[$1] != $2 " " $3) {
+                printf "%s: frame %s differs (%s instead of %s)\n", name, $1, $2 " " $3, reference[$1]
+            }
+        }
+        END {
+            for (frame in reference) {
+                if (!(frame in seen)) {
+                    printf "%s: frame %s is missing\n", name, frame
+                }
+            }
+        }' "$REFERENCE" "$manifest" | sort
+done
+
+exit $status
@@ -0,0 +1,92 @@
+#!/usr/bin/env bash
+
+# Splits a frame sequence between N pipeline processes with `--shard i/N`,
+# locally or round-robin on ssh hosts sharing the filesystem, then sums up
+# the per-shard stats.
+
+set -u
+
+PIPELINE="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." > /dev/null 2>&1 && pwd)/build/pipeline"
+SHARDS=$(nproc)
+HOSTS=""
+STATS_DIR=""
+
+function show_help() {
+    echo "Usage: $0 [OPTION]... -- [PIPELINE OPTION]..."
+    echo
+    echo "Options:"
+    echo "  -n SHARDS       number of shards (default: number of CPUs)"
+    echo "  -H HOST[,HOST]  run the shards round-robin on these hosts with ssh"
+    echo "  -p PATH         pipeline executable (default: $PIPELINE)"
+    echo "  -s DIR          directory of the per-shard stats (default: temporary)"
+    echo "  -h              show this help"
+    echo
+    echo "The pipeline options are given to every shard, e.g. --directory, --pipeline, --range."
+}
+
+while getopts "n:H:p:s:h" opt; do
+    case "$opt" in
+    n) SHARDS="$OPTARG" ;;
+    H) HOSTS="$OPTARG" ;;
+    p) PIPELINE="$OPTARG" ;;
+    s) STATS_DIR="$OPTARG" ;;
+    h)
+        show_help
+        exit 0
+        ;;
+    *)
+        show_help >&2
+        exit 1
+        ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [[ -z "$STATS_DIR" ]]; then
+    STATS_DIR="$(mktemp -d)"
+    trap 'rm -rf "$STATS_DIR"' EXIT
+fi
+mkdir -p "$STATS_DIR"
+
+IFS=',' read -r -a HOST_LIST <<< "$HOSTS"
+
+pids=()
+for ((shard = 0; shard < SHARDS; shard++)); do
+    args=("$PIPELINE" --quiet --shard "$shard/$SHARDS" --stats "$STATS_DIR/shard-$shard.csv" "$@")
+
+    if [[ ${#HOST_LIST[@]} -eq 0 ]]; then
+        "${args[@]}" &
+    else
+        host="${HOST_LIST[$((shard % ${#HOST_LIST[@]}))]}"
+        ssh "$host" "cd $(printf '%q' "$PWD") && $(printf '%q ' "${args[@]}")" &
+    fi
+    pids+=($!)
+done
+
+failed=0
+for ((shard = 0; shard < SHARDS; shard++)); do
+    if ! wait "${pids[$shard]}"; then
+        echo "shard $shard/$SHARDS failed" >&2
+        failed=1
+    fi
+done
+
+# frames add up, the job lasts as long as its slowest shard
+for ((shard = 0; shard < SHARDS; shard++)); do
+    tail -n +2 "$STATS_DIR/shard-$shard.csv" 2> /dev/null || echo "missing,$shard,$SHARDS,,,0,0,0"
+done | awk -F, '
+    BEGIN {
+        printf "%-6s %8s %10s %10s\n", "shard", "frames", "seconds", "frames/s"
+    }
+    {
+        printf "%-6s %8d %10.3f %10.2f\n", $2 "/" $3, $6, $7, $8
+        frames += $6
+        if ($7 > seconds) {
+            seconds = $7
+        }
+    }
+    END {
+        printf "%-6s %8d %10.3f %10.2f\n", "total", frames, seconds, (seconds > 0) ? frames / seconds : 0
+    }'
+
+exit $failed
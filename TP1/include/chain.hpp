@@ -0,0 +1,446 @@
+#ifndef INCLUDE_CHAIN_HPP_
+#define INCLUDE_CHAIN_HPP_
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+
+extern "C" {
+#include "image.h"
+#include "kernel.h"
+#include "trace.h"
+}
+
+/*
+ * Filter chains fused at compile time: fused::chain<fused::scale<2>,
+ * fused::desaturate, fused::hflip, fused::sobel>::apply(image) returns the
+ * same frame as the four filters one after the other, in a single pass over
+ * the output rows and without the intermediate frames.
+ *
+ * Every stage becomes a node wrapping the node of the stage before it, and
+ * row(y, out) produces row y of the stage output. A node either writes the
+ * row in out, or returns a row it already holds (the source frame, a row it
+ * cached). Nothing is larger than a row except the three input rows a 3x3
+ * stencil keeps, so the rows in flight stay in the L1/L2 cache and the last
+ * stage writes the output frame directly.
+ *
+ * The node types are rewritten while the chain is composed: point filters
+ * commute with the stages that only move pixels (scale, flips), so they are
+ * moved before them. chain<scale<2>, desaturate> desaturates the source
+ * pixels once instead of the four copies of every pixel.
+ *
+ * The results are bit-identical to filter.c. to_hsv and to_rgb are not
+ * modeled.
+ */
+
+namespace fused {
+
+/* the input frame, its rows are returned without a copy */
+class source {
+public:
+    static constexpr bool is_map = false;
+
+    explicit source(const image_t* image) : width(image->width), height(image->height), pixels(image->pixels) {}
+
+    bool valid() const {
+        return true;
+    }
+
+    const pixel_t* row(size_t y, pixel_t* out) {
+        return &this->pixels[y * this->width];
+    }
+
+    const size_t width;
+    const size_t height;
+
+private:
+    const pixel_t* pixels;
+};
+
+/* one row of the size of the input of a node, nullptr if the allocation failed */
+static inline std::unique_ptr<pixel_t[]> row_buffer(size_t width) {
+    return std::unique_ptr<pixel_t[]>(new (std::nothrow) pixel_t[width]);
+}
+
+/* Op::apply(in, out, count) on every row, in and out don't overlap */
+template <typename Op, typename Upstream>
+class point_node {
+public:
+    static constexpr bool is_map = false;
+
+    explicit point_node(const image_t* image)
+        : upstream(image), width(upstream.width), height(upstream.height), buffer(row_buffer(width)) {}
+
+    bool valid() const {
+        return this->buffer != nullptr && this->upstream.valid();
+    }
+
+    const pixel_t* row(size_t y, pixel_t* out) {
+        Op::apply(this->upstream.row(y, this->buffer.get()), out, this->width);
+        return out;
+    }
+
+private:
+    Upstream upstream;
+
+public:
+    const size_t width;
+    const size_t height;
+
+private:
+    std::unique_ptr<pixel_t[]> buffer;
+};
+
+/* filter_desaturate, with the vectorized fixed-point kernel */
+struct desaturate {
+    static constexpr bool is_point = true;
+
+    static void apply(const pixel_t* in, pixel_t* out, size_t count) {
+        kernel_desaturate(in, out, count);
+    }
+
+    template <typename Upstream>
+    using node = point_node<desaturate, Upstream>;
+};
+
+/* filter_add_pixel, bytes wrap around and alpha is kept, the constants are folded in the loop */
+template <unsigned char R, unsigned char G, unsigned char B>
+struct add_pixel {
+    static constexpr bool is_point = true;
+
+    static void apply(const pixel_t* in, pixel_t* out, size_t count) {
+        for (size_t x = 0; x < count; x++) {
+            out[x].bytes[0] = in[x].bytes[0] + R;
+            out[x].bytes[1] = in[x].bytes[1] + G;
+            out[x].bytes[2] = in[x].bytes[2] + B;
+            out[x].bytes[3] = in[x].bytes[3];
+        }
+    }
+
+    template <typename Upstream>
+    using node = point_node<add_pixel, Upstream>;
+};
+
+/* nearest neighbour upscale, filter_scale_up, an input row serves Factor output rows */
+template <size_t Factor>
+struct scale {
+    static_assert(Factor > 0, "scale factor must be positive");
+
+    static constexpr bool is_point = false;
+
+    template <typename Upstream>
+    class node {
+    public:
+        static constexpr bool is_map = true;
+
+        using upstream_type = Upstream;
+        template <typename Other>
+        using rebind = node<Other>;
+
+        explicit node(const image_t* image)
+            : upstream(image), width(Factor * upstream.width), height(Factor * upstream.height),
+              buffer(row_buffer(upstream.width)) {}
+
+        bool valid() const {
+            return this->buffer != nullptr && this->upstream.valid();
+        }
+
+        const pixel_t* row(size_t y, pixel_t* out) {
+            if (this->cached == nullptr || this->cached_y != y / Factor) {
+                this->cached   = this->upstream.row(y / Factor, this->buffer.get());
+                this->cached_y = y / Factor;
+            }
+
+            for (size_t x = 0; x < this->upstream.width; x++) {
+                for (size_t k = 0; k < Factor; k++) {
+                    out[x * Factor + k] = this->cached[x];
+                }
+            }
+            return out;
+        }
+
+    private:
+        Upstream upstream;
+
+    public:
+        const size_t width;
+        const size_t height;
+
+    private:
+        std::unique_ptr<pixel_t[]> buffer;
+        const pixel_t* cached = nullptr;
+        size_t cached_y       = 0;
+    };
+};
+
+struct hflip {
+    static constexpr bool is_point = false;
+
+    template <typename Upstream>
+    class node {
+    public:
+        static constexpr bool is_map = true;
+
+        using upstream_type = Upstream;
+        template <typename Other>
+        using rebind = node<Other>;
+
+        explicit node(const image_t* image)
+            : upstream(image), width(upstream.width), height(upstream.height), buffer(row_buffer(width)) {}
+
+        bool valid() const {
+            return this->buffer != nullptr && this->upstream.valid();
+        }
+
+        const pixel_t* row(size_t y, pixel_t* out) {
+            kernel_reverse(this->upstream.row(y, this->buffer.get()), out, this->width);
+            return out;
+        }
+
+    private:
+        Upstream upstream;
+
+    public:
+        const size_t width;
+        const size_t height;
+
+    private:
+        std::unique_ptr<pixel_t[]> buffer;
+    };
+};
+
+/* only the row index changes, the rows go through untouched */
+struct vflip {
+    static constexpr bool is_point = false;
+
+    template <typename Upstream>
+    class node {
+    public:
+        static constexpr bool is_map = true;
+
+        using upstream_type = Upstream;
+        template <typename Other>
+        using rebind = node<Other>;
+
+        explicit node(const image_t* image) : upstream(image), width(upstream.width), height(upstream.height) {}
+
+        bool valid() const {
+            return this->upstream.valid();
+        }
+
+        const pixel_t* row(size_t y, pixel_t* out) {
+            return this->upstream.row(this->height - 1 - y, out);
+        }
+
+    private:
+        Upstream upstream;
+
+    public:
+        const size_t width;
+        const size_t height;
+    };
+};
+
+/*
+ * 3x3 stencils, the output is 2 pixels smaller in both directions. The three
+ * input rows of an output row are kept in a ring indexed by row modulo 3, so
+ * going down the frame computes every input row once.
+ */
+template <typename Kernel, typename Upstream>
+class stencil_node {
+public:
+    static constexpr bool is_map = false;
+
+    explicit stencil_node(const image_t* image)
+        : upstream(image), width(upstream.width - 2), height(upstream.height - 2),
+          ring(row_buffer(3 * upstream.width)) {}
+
+    bool valid() const {
+        return this->ring != nullptr && this->upstream.valid();
+    }
+
+    const pixel_t* row(size_t y, pixel_t* out) {
+        const pixel_t* rows[3];
+
+        for (size_t r = y; r < y + 3; r++) {
+            pixel_t* slot = &this->ring[(r % 3) * this->upstream.width];
+
+            if (this->tags[r % 3] != r + 1) {
+                const pixel_t* row = this->upstream.row(r, slot);
+                if (row != slot) {
+                    memcpy(slot, row, this->upstream.width * sizeof(pixel_t));
+                }
+                this->tags[r % 3] = r + 1;
+            }
+
+            rows[r - y] = slot;
+        }
+
+        Kernel::apply((const unsigned char*)rows[0], (const unsigned char*)rows[1], (const unsigned char*)rows[2],
+                      (unsigned char*)out, 4 * this->width);
+
+        /* alpha is copied from the center pixel */
+        for (size_t x = 0; x < this->width; x++) {
+            out[x].bytes[3] = rows[1][x + 1].bytes[3];
+        }
+        return out;
+    }
+
+private:
+    Upstream upstream;
+
+public:
+    const size_t width;
+    const size_t height;
+
+private:
+    std::unique_ptr<pixel_t[]> ring;
+    size_t tags[3] = {0, 0, 0}; /* row + 1 held by each slot, 0 when empty */
+};
+
+/* filter_sobel, on the rows as flat bytes where the neighbours of a channel are 4 bytes apart */
+struct sobel {
+    static constexpr bool is_point = false;
+
+    static void apply(const unsigned char* top, const unsigned char* middle, const unsigned char* bottom,
+                      unsigned char* out, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            int value_x = (top[i] - top[i + 8]) + 2 * (middle[i] - middle[i + 8]) + (bottom[i] - bottom[i + 8]);
+            int value_y = (top[i] + 2 * top[i + 4] + top[i + 8]) - (bottom[i] + 2 * bottom[i + 4] + bottom[i + 8]);
+            int value   = abs(value_x) + abs(value_y);
+
+            out[i] = (value > 255) ? 255 : value;
+        }
+    }
+
+    template <typename Upstream>
+    using node = stencil_node<sobel, Upstream>;
+};
+
+/* filter_convolution33 with the matrix of Weights, summed in the same order so rounding is unchanged */
+template <typename Weights>
+struct convolution33 {
+    static constexpr bool is_point = false;
+
+    static void apply(const unsigned char* top, const unsigned char* middle, const unsigned char* bottom,
+                      unsigned char* out, size_t count) {
+        const unsigned char* rows[3] = {top, middle, bottom};
+
+        for (size_t i = 0; i < count; i++) {
+            double value = 0;
+            for (int y = 0; y < 3; y++) {
+                for (int x = 0; x < 3; x++) {
+                    value += rows[y][i + 4 * x] * Weights::m[y][x];
+                }
+            }
+
+            out[i] = (unsigned char)((value < 0) ? 0 : ((value > 255) ? 255 : value));
+        }
+    }
+
+    template <typename Upstream>
+    using node = stencil_node<convolution33, Upstream>;
+};
+
+struct edge_detect_weights {
+    static constexpr double m[3][3] = {
+        {-1, -1, -1},
+        {-1, 8, -1},
+        {-1, -1, -1},
+    };
+};
+
+struct sharpen_weights {
+    static constexpr double m[3][3] = {
+        {0, -2, 0},
+        {-2, 9, -2},
+        {0, -2, 0},
+    };
+};
+
+struct box_blur_weights {
+    static constexpr double m[3][3] = {
+        {1.0 / 9.0, 1.0 / 9.0, 1.0 / 9.0},
+        {1.0 / 9.0, 1.0 / 9.0, 1.0 / 9.0},
+        {1.0 / 9.0, 1.0 / 9.0, 1.0 / 9.0},
+    };
+};
+
+/* the same matrix as filter_gaussian_blur */
+struct gaussian_blur_weights {
+    static constexpr double m[3][3] = {
+        {1.0 / 16.0, 2.0 / 16.0, 1.0 / 16.0},
+        {2.0 / 16.0, 4.0 / 16.0, 4.0 / 16.0},
+        {1.0 / 16.0, 2.0 / 16.0, 1.0 / 16.0},
+    };
+};
+
+using edge_detect   = convolution33<edge_detect_weights>;
+using sharpen       = convolution33<sharpen_weights>;
+using box_blur      = convolution33<box_blur_weights>;
+using gaussian_blur = convolution33<gaussian_blur_weights>;
+
+/* node of Stage over Node, a point stage goes under the scale and flip nodes ending Node */
+template <typename Stage, typename Node>
+struct attach {
+    using type = typename Stage::template node<Node>;
+};
+
+template <typename Stage, typename Node>
+    requires(Stage::is_point && Node::is_map)
+struct attach<Stage, Node> {
+    using type = typename Node::template rebind<typename attach<Stage, typename Node::upstream_type>::type>;
+};
+
+template <typename Node, typename... Stages>
+struct compose {
+    using type = Node;
+};
+
+template <typename Node, typename Stage, typename... Rest>
+struct compose<Node, Stage, Rest...> {
+    using type = typename compose<typename attach<Stage, Node>::type, Rest...>::type;
+};
+
+template <typename... Stages>
+struct chain {
+    using node_type = typename compose<source, Stages...>::type;
+
+    /* a newly allocated frame like the filters, the input is not freed */
+    static image_t* apply(image_t* image) {
+        trace_begin("fused_chain", image->id);
+
+        image_t* new_image = NULL;
+        node_type node(image);
+        if (!node.valid()) {
+            goto fail_exit;
+        }
+
+        new_image = image_create(image->id, node.width, node.height);
+        if (new_image == NULL) {
+            goto fail_exit;
+        }
+
+        /* the last stage writes in the frame, unless it returns a row it holds */
+        for (size_t y = 0; y < node.height; y++) {
+            pixel_t* out       = &new_image->pixels[y * node.width];
+            const pixel_t* row = node.row(y, out);
+            if (row != out) {
+                memcpy(out, row, node.width * sizeof(pixel_t));
+            }
+        }
+
+        trace_end("fused_chain", image->id, image->width * image->height);
+        return new_image;
+
+    fail_exit:
+        trace_end("fused_chain", image->id, 0);
+        return NULL;
+    }
+};
+
+} // namespace fused
+
+#endif /* INCLUDE_CHAIN_HPP_ */
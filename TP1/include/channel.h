@@ -0,0 +1,43 @@
+#ifndef INCLUDE_CHANNEL_H_
+#define INCLUDE_CHANNEL_H_
+
+#include <stddef.h>
+
+#include "image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Frames between processes over a SOCK_SEQPACKET socket pair, one message per
+ * frame: the id and size of the frame, and its memfd as SCM_RIGHTS ancillary
+ * data, so the pixels are never copied. The sender unmaps the frame and seals
+ * the memfd against writes and resizing before sending it, the receiver
+ * checks the seals and maps it read-only.
+ *
+ * Several processes may read the same end: every message goes to exactly one
+ * of them, which makes the socket a work queue. A reader sees the end of the
+ * channel once every process closed the other end.
+ */
+
+/* socket pair, fds[0] is written and fds[1] read */
+int channel_create(int fds[2]);
+
+/* sends and destroys image, a frame without a memfd is copied into one first */
+int channel_send(int fd, image_t* image);
+
+/* the frame with this id was dropped by the stage, so the receiver doesn't wait for it */
+int channel_send_drop(int fd, size_t id);
+
+/*
+ * Next frame, 1 with *image set, or NULL for a dropped frame whose id is in
+ * *id. 0 at the end of the channel, -1 on error.
+ */
+int channel_recv(int fd, image_t** image, size_t* id);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INCLUDE_CHANNEL_H_ */
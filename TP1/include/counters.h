@@ -0,0 +1,59 @@
+#ifndef INCLUDE_COUNTERS_H_
+#define INCLUDE_COUNTERS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Hardware performance counters (perf_event_open) of the pipeline stages and
+ * filters. Every thread opens its own group of counters the first time it
+ * enters a stage, trace_begin() and trace_end() read it, so a stage is
+ * counted on the thread that runs it, nested stages included. The counts
+ * are only merged by counters_print().
+ *
+ * Events the CPU or the kernel doesn't provide (virtual machines often have
+ * no PMU, perf_event_paranoid may forbid them) are left out and printed as
+ * `-`; counters_open() fails when none is available.
+ */
+
+typedef enum counters_event {
+    COUNTERS_CYCLES,
+    COUNTERS_INSTRUCTIONS,
+    COUNTERS_LLC_MISSES,
+    COUNTERS_DTLB_MISSES,
+    COUNTERS_EVENT_COUNT,
+} counters_event_t;
+
+/* counts since the thread opened its counters, scaled when the events were multiplexed */
+typedef struct counters_sample {
+    uint64_t values[COUNTERS_EVENT_COUNT];
+} counters_sample_t;
+
+extern bool counters_enabled;
+extern bool counters_supported[COUNTERS_EVENT_COUNT];
+
+int counters_open(void);
+int counters_close(void);
+
+void counters_begin(const char* name);
+void counters_end(const char* name, size_t pixels);
+
+/* counts of the calling thread, e.g. around a benchmark loop */
+int counters_read(counters_sample_t* sample);
+
+/* one row per stage with IPC and misses per pixel, merged over the threads */
+void counters_print(const char* title);
+
+/* the IPC, cycles/px, LLC miss/px and dTLB miss/px columns of counts over pixels */
+void counters_print_ratios(const counters_sample_t* counts, size_t pixels);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INCLUDE_COUNTERS_H_ */
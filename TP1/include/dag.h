@@ -0,0 +1,81 @@
+#ifndef INCLUDE_DAG_H_
+#define INCLUDE_DAG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "image.h"
+#include "registry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Fan-out of a decoded frame into several filter chains, the branches. A
+ * branch is written "PREFIX=FILTER[:VALUE],FILTER..." and its output frames
+ * are saved as PREFIX-NNNN.png. The branches are merged into a tree whose
+ * root is the decoded frame: branches starting with the same filters share
+ * those nodes, so a common prefix is computed once per frame.
+ */
+
+#define DAG_MAX_NODES 64
+#define DAG_MAX_CHILDREN 16
+#define DAG_MAX_OUTPUTS 16
+#define DAG_MAX_PREFIX 64
+
+typedef struct dag_node {
+    const filter_entry_t* filter; /* NULL for the root */
+    double value;
+    size_t child_count;
+    size_t children[DAG_MAX_CHILDREN]; /* indices in the node array */
+    size_t output_count;
+    size_t outputs[DAG_MAX_OUTPUTS]; /* branches ending at the node */
+} dag_node_t;
+
+typedef struct dag {
+    size_t node_count;
+    dag_node_t nodes[DAG_MAX_NODES];
+    size_t output_count;
+    char outputs[DAG_MAX_OUTPUTS][DAG_MAX_PREFIX];
+} dag_t;
+
+void dag_init(dag_t* dag);
+int dag_add_branch(dag_t* dag, const char* spec);
+
+/* children first, then outputs */
+static inline size_t dag_node_consumers(const dag_node_t* node) {
+    return node->child_count + node->output_count;
+}
+
+/*
+ * Image of a node for one frame, shared by the consumers of the node. Every
+ * consumer releases it once, the image is destroyed by the last one. The
+ * frame of the root also counts the frames derived from it, so the backends
+ * know when a decoded frame went through the whole tree.
+ */
+
+typedef struct dag_frame dag_frame_t;
+
+typedef struct dag_frame {
+    image_t* image;
+    const dag_node_t* node;
+    size_t refs;         /* consumers that didn't release the frame yet */
+    dag_frame_t* source; /* frame of the root */
+    size_t pending;      /* root only: frames of the tree still alive, itself included */
+} dag_frame_t;
+
+/* takes the ownership of image, source is NULL for the frame of the root */
+dag_frame_t* dag_frame_create(const dag_node_t* node, image_t* image, dag_frame_t* source);
+
+/* frame of the child of the node of parent, NULL if the filter failed */
+dag_frame_t* dag_frame_apply(const dag_t* dag, dag_frame_t* parent, size_t child);
+
+/* returns true when the last frame derived from the same decoded frame was released */
+bool dag_frame_release(dag_frame_t* frame);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INCLUDE_DAG_H_ */
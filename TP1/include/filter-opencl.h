@@ -0,0 +1,53 @@
+#ifndef INCLUDE_FILTER_OPENCL_H_
+#define INCLUDE_FILTER_OPENCL_H_
+
+#include <CL/cl.h>
+
+#include "image.h"
+
+/*
+ * OpenCL versions of the filters, with the kernels of source/kernel/filter.cl.
+ * Frames stay in device buffers from one filter to the next, pixels only go
+ * through the host in opencl_image_upload() and opencl_image_download(). The
+ * filters enqueue their kernel on the in-order queue of the context without
+ * waiting for it, except when tracing. The kernel arguments are set on every
+ * call, so a context is used by a single thread at a time.
+ */
+
+typedef struct filter_opencl {
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel scale_up;
+    cl_kernel desaturate;
+    cl_kernel horizontal_flip;
+    cl_kernel sobel;
+    cl_kernel convolution33;
+} filter_opencl_t;
+
+/* device-resident frame, the buffer is kept across frames and only grows */
+typedef struct opencl_image {
+    size_t id;
+    size_t width;
+    size_t height;
+    size_t capacity; /* pixels the buffer can hold */
+    cl_mem buffer;
+} opencl_image_t;
+
+int filter_opencl_init(filter_opencl_t* opencl, cl_device_id device_id);
+void filter_opencl_cleanup(filter_opencl_t* opencl);
+
+int opencl_image_reserve(filter_opencl_t* opencl, opencl_image_t* image, size_t id, size_t width, size_t height);
+void opencl_image_release(opencl_image_t* image);
+int opencl_image_upload(filter_opencl_t* opencl, const image_t* image, opencl_image_t* device_image);
+image_t* opencl_image_download(filter_opencl_t* opencl, const opencl_image_t* device_image);
+
+int filter_opencl_scale_up(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image,
+                           size_t factor);
+int filter_opencl_desaturate(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image);
+int filter_opencl_horizontal_flip(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image);
+int filter_opencl_sobel(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image);
+int filter_opencl_convolution33(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image,
+                                const double m[3][3]);
+
+#endif /* INCLUDE_FILTER_OPENCL_H_ */
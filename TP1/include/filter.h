@@ -8,6 +8,8 @@
 /* all filter return a newly allocated image, input image is not freed  */
 
 image_t* filter_scale_up(image_t* image, size_t factor);
+image_t* filter_resize_bilinear(image_t* image, size_t width, size_t height);
+image_t* filter_resize_area(image_t* image, size_t width, size_t height);
 image_t* filter_sobel(image_t* image);
 image_t* filter_to_hsv(image_t* image);
 image_t* filter_to_rgb(image_t* image);
@@ -19,6 +21,8 @@ image_t* filter_edge_detect(image_t* image);
 image_t* filter_sharpen(image_t* image);
 image_t* filter_box_blur(image_t* image);
 image_t* filter_gaussian_blur(image_t* image);
+image_t* filter_box_blur_radius(image_t* image, size_t radius);
+image_t* filter_gaussian_blur_sigma(image_t* image, double sigma);
 image_t* filter_horizontal_flip(image_t* image);
 image_t* filter_vertical_flip(image_t* image);
 
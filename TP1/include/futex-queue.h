@@ -0,0 +1,49 @@
+#ifndef INCLUDE_FUTEX_QUEUE_H_
+#define INCLUDE_FUTEX_QUEUE_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bounded blocking queue with the interface of queue_t that wakes exactly one
+ * thread per item. A thread that has to wait links a waiter on its stack at
+ * the end of a FIFO list and waits on the futex word of that waiter only. A
+ * push with waiting consumers hands the item to the first of them, a pop with
+ * waiting producers moves the item of the first of them into the queue, so
+ * every item wakes at most one thread, in arrival order.
+ *
+ * A waiter spins on its word before sleeping, the spin limit adapts to how
+ * long the recent handoffs took, and is 0 on a single CPU.
+ */
+
+typedef struct futex_waiter futex_waiter_t;
+
+typedef struct futex_waiter {
+    uint32_t state;
+    void* value;
+    futex_waiter_t* next;
+} futex_waiter_t;
+
+typedef struct futex_waiters {
+    futex_waiter_t* head;
+    futex_waiter_t* tail;
+} futex_waiters_t;
+
+typedef struct futex_queue {
+    size_t size;
+    size_t used;
+    size_t first;
+    void** items;
+    pthread_mutex_t mutex;
+    futex_waiters_t consumers;
+    futex_waiters_t producers;
+    unsigned int spin_limit;
+} futex_queue_t;
+
+futex_queue_t* futex_queue_create(size_t size);
+void futex_queue_destroy(futex_queue_t* queue);
+int futex_queue_push(futex_queue_t* queue, void* ptr);
+void* futex_queue_pop(futex_queue_t* queue);
+
+#endif /* INCLUDE_FUTEX_QUEUE_H_ */
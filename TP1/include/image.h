@@ -4,6 +4,7 @@
 #define INCLUDE_IMAGE_H_
 
 #include <dirent.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <sys/types.h>
@@ -17,8 +18,38 @@ typedef struct image {
     size_t width;
     size_t height;
     pixel_t* pixels;
+    size_t mapped_size; /* length of the mapping when pixels were mmap'ed, 0 otherwise */
+    int fd;             /* memfd holding the pixels, -1 when they are private to the process */
 } image_t;
 
+/*
+ * Allocation policy of the pixel buffers:
+ *  - malloc:   plain malloc, the default
+ *  - aligned:  buffers aligned on IMAGE_ALIGNMENT bytes
+ *  - thp:      aligned, frames of at least one huge page are mmap'ed on a huge page
+ *              boundary and advised as transparent huge pages
+ *  - hugetlb:  like thp but from the explicit huge page pool (MAP_HUGETLB), falls
+ *              back to thp when the pool is empty
+ *  - memfd:    a shared mapping of a memfd of its own, so the frame can be handed
+ *              to another process without copying the pixels
+ * With prefault, every page is touched in image_create() so the page faults
+ * don't land in the filter loops.
+ */
+
+#define IMAGE_ALIGNMENT 64
+
+typedef enum image_alloc {
+    IMAGE_ALLOC_MALLOC,
+    IMAGE_ALLOC_ALIGNED,
+    IMAGE_ALLOC_THP,
+    IMAGE_ALLOC_HUGETLB,
+    IMAGE_ALLOC_MEMFD,
+} image_alloc_t;
+
+int image_alloc_parse(const char* name, image_alloc_t* alloc);
+void image_alloc_configure(image_alloc_t alloc, bool prefault);
+void image_alloc_release(void); /* unmaps the frames kept for reuse */
+
 static inline pixel_t* image_get_pixel(image_t* image, unsigned int x, unsigned int y) {
     if (x >= image->width || y >= image->height) {
         return NULL;
@@ -30,21 +61,69 @@ static inline pixel_t* image_get_pixel(image_t* image, unsigned int x, unsigned
 image_t* image_create(size_t id, size_t width, size_t height);
 image_t* image_create_from_png(char* filename);
 image_t* image_copy(image_t* image);
+image_t* image_map_fd(size_t id, size_t width, size_t height, int fd); /* read-only, owns fd even on failure */
 void image_destroy(image_t* image);
 int image_save_png(image_t* image, char* filename);
+int image_encode_png(image_t* image, unsigned char** data, size_t* size); /* PNG file in a malloc'ed buffer */
+
+/*
+ * Frames are loaded from load_first, every shard_count frames, until the
+ * first missing frame or load_end. Processes sharing a sequence each take a
+ * shard, frames keep their index so the output names don't depend on the
+ * sharding.
+ */
 
 typedef struct image_dir {
     const char* input_dir_name;
     const char* output_dir_name;
     const char* save_prefix;
     size_t load_current;
+    size_t load_decoded; /* next id of the shard to go through, the ids before it are done */
+    size_t load_waiters; /* threads waiting for their turn */
+    pthread_mutex_t load_mutex;
+    pthread_cond_t load_changed;
     bool stop;
+    size_t load_first;
+    size_t load_end;
+    size_t shard_index;
+    size_t shard_count;
+    size_t save_count; /* frames saved so far, updated atomically */
+    bool no_save;      /* frames are only added to the manifest, no PNG is written */
 } image_dir_t;
 
 image_t* image_dir_load_next(image_dir_t* image_dir);
+
+/*
+ * image_dir_load_next() in steps, so the decoding can run in parallel:
+ * image_dir_next() hands out the frame ids in order, one thread at a time,
+ * image_dir_decode() decodes a frame on any thread, and image_dir_admit()
+ * lets the decoded frames through in id order, it waits for the ids before
+ * its own and takes the image, NULL when the frame is dropped.
+ * image_dir_load() is image_dir_decode() then image_dir_admit().
+ *
+ * Every id handed out by image_dir_next() must go through image_dir_load(),
+ * image_dir_admit() or image_dir_drop(), the later ones wait for it forever
+ * otherwise. image_dir_close() reports an id that didn't.
+ */
+bool image_dir_next(image_dir_t* image_dir, size_t* id);
+image_t* image_dir_decode(image_dir_t* image_dir, size_t id);
+image_t* image_dir_admit(image_dir_t* image_dir, size_t id, image_t* image);
+image_t* image_dir_load(image_dir_t* image_dir, size_t id);
 int image_dir_save(image_dir_t* image_dir, image_t* image);
+int image_dir_save_as(image_dir_t* image_dir, image_t* image, const char* save_prefix);
+
+/*
+ * With an output stream, loaders call image_dir_wait_output() before loading,
+ * it waits while the output is too far behind, and frames that won't be saved
+ * are dropped so the stream doesn't wait for them.
+ */
+void image_dir_wait_output(image_dir_t* image_dir);
+void image_dir_drop(image_dir_t* image_dir, size_t id);
 
+/* image_dir_select() starts the handout, not while a pipeline runs, image_dir_close() ends it */
 void image_dir_reset(image_dir_t* image_dir, const char* input_dir_name, const char* output_dir_name,
                      const char* save_prefix);
+void image_dir_select(image_dir_t* image_dir, size_t start, size_t end, size_t shard_index, size_t shard_count);
+int image_dir_close(image_dir_t* image_dir);
 
 #endif /* INCLUDE_IMAGE_H_ */
@@ -0,0 +1,19 @@
+#ifndef INCLUDE_KERNEL_H_
+#define INCLUDE_KERNEL_H_
+
+#include <stddef.h>
+
+#include "image.h"
+
+/*
+ * Vectorized per-pixel kernels used by the filters, they work on `count`
+ * consecutive pixels. Source and destination must not overlap. The best
+ * instruction set (AVX-512, AVX2 or the SSE2 baseline) is selected at load
+ * time. Results are bit-identical to the scalar filters.
+ */
+
+void kernel_desaturate(const pixel_t* src, pixel_t* dst, size_t count);
+void kernel_add_pixel(const pixel_t* src, pixel_t* dst, size_t count, const pixel_t* add_pixel);
+void kernel_reverse(const pixel_t* src, pixel_t* dst, size_t count);
+
+#endif /* INCLUDE_KERNEL_H_ */
@@ -0,0 +1,34 @@
+#ifndef INCLUDE_MANIFEST_H_
+#define INCLUDE_MANIFEST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Manifest of the output frames: one line per frame with its index, its size
+ * and a 64-bit XXH64 hash of its pixels, sorted by frame index. Two runs gave
+ * the same frames when their manifests are identical, whatever the order the
+ * frames were saved in and without decoding any PNG.
+ */
+
+extern bool manifest_enabled;
+
+int manifest_open(const char* filename);
+int manifest_close(void);
+
+void manifest_add(const image_t* image);
+
+uint64_t manifest_hash(const void* data, size_t size, uint64_t seed);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INCLUDE_MANIFEST_H_ */
@@ -3,6 +3,7 @@
 #ifndef INCLUDE_PIPELINE_H_
 #define INCLUDE_PIPELINE_H_
 
+#include "dag.h"
 #include "image.h"
 
 #ifdef __cplusplus
@@ -12,6 +13,27 @@ extern "C" {
 int pipeline_serial(image_dir_t* image_dir);
 int pipeline_pthread(image_dir_t* image_dir);
 int pipeline_tbb(image_dir_t* image_dir);
+int pipeline_openmp(image_dir_t* image_dir);
+int pipeline_coroutine(image_dir_t* image_dir);
+
+/* tbb pipeline with the default chain fused into one stage, pipeline_chain_fused() applies it to a frame */
+int pipeline_tbb_fused(image_dir_t* image_dir);
+image_t* pipeline_chain_fused(image_t* image);
+
+/* only built when OpenCL is found, runs on device pipeline_opencl_device of platform pipeline_opencl_platform */
+extern unsigned int pipeline_opencl_platform;
+extern unsigned int pipeline_opencl_device;
+int pipeline_opencl(image_dir_t* image_dir);
+
+/* the stages in processes, pipeline_process_workers processes per stage */
+extern unsigned int pipeline_process_workers;
+int pipeline_process(image_dir_t* image_dir);
+
+/* fan-out mode, every frame is decoded once and goes through all the branches of pipeline_dag */
+extern dag_t pipeline_dag;
+int pipeline_dag_serial(image_dir_t* image_dir);
+int pipeline_dag_pthread(image_dir_t* image_dir);
+int pipeline_dag_tbb(image_dir_t* image_dir);
 
 #ifdef __cplusplus
 } /* extern "C" */
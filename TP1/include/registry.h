@@ -0,0 +1,37 @@
+#ifndef INCLUDE_REGISTRY_H_
+#define INCLUDE_REGISTRY_H_
+
+#include <stddef.h>
+
+#include "image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Filters reachable by name. A filter is written "name" or "name:value",
+ * the value of the parameter (factor, radius, sigma...) defaults to
+ * default_value when omitted. Filters without parameter ignore it.
+ */
+
+typedef struct filter_entry {
+    const char* name;
+    const char* parameter; /* NULL when the filter has no parameter */
+    double default_value;
+    double min_value;
+    double max_value;
+    image_t* (*apply)(image_t* image, double value);
+} filter_entry_t;
+
+extern const filter_entry_t filter_registry[];
+extern const size_t filter_registry_count;
+
+const filter_entry_t* filter_registry_find(const char* name);
+int filter_registry_parse(const char* spec, const filter_entry_t** entry, double* value);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INCLUDE_REGISTRY_H_ */
@@ -0,0 +1,56 @@
+#ifndef INCLUDE_REORDER_H_
+#define INCLUDE_REORDER_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Bounded reorder buffer: items arrive in any order with their frame id and
+ * are released one by one in id order (first, first + stride, ...) to a
+ * single consumer.
+ *
+ * The bound is enforced at the source. A loader calls reorder_admit() before
+ * loading a frame, which waits until the frame is less than depth frames
+ * ahead of the next one to release, so reorder_put() never has to wait and
+ * can't deadlock a backend whose threads are shared between stages. Items put
+ * by a backend that doesn't admit grow the buffer past depth and are counted
+ * as overflows.
+ */
+
+typedef struct reorder_stats {
+    size_t max_held;              /* most items held at once */
+    size_t overflows;             /* items put beyond the window */
+    size_t admit_stalls;          /* admissions that waited for the window */
+    double admit_stall_seconds;   /* time spent in those waits */
+    size_t release_stalls;        /* takes that waited for the next item while later ones were held */
+    double release_stall_seconds; /* time spent in those waits */
+} reorder_stats_t;
+
+typedef struct reorder {
+    size_t depth;
+    size_t stride;
+    size_t next;     /* id of the next item to release */
+    size_t head;     /* slot of the next item */
+    size_t capacity; /* slots, depth until an overflow */
+    void** slots;
+    size_t held;
+    bool closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t released;
+    pthread_cond_t arrived;
+    reorder_stats_t stats;
+} reorder_t;
+
+reorder_t* reorder_create(size_t depth, size_t first, size_t stride);
+void reorder_destroy(reorder_t* reorder);
+
+void reorder_admit(reorder_t* reorder, size_t id);
+int reorder_put(reorder_t* reorder, size_t id, void* item);
+void reorder_skip(reorder_t* reorder, size_t id);
+
+/* returns the next item in id order, NULL once closed and empty, holes left at close are skipped */
+void* reorder_take(reorder_t* reorder);
+void reorder_close(reorder_t* reorder);
+
+#endif /* INCLUDE_REORDER_H_ */
@@ -0,0 +1,52 @@
+#ifndef INCLUDE_SERVICE_H_
+#define INCLUDE_SERVICE_H_
+
+#include <stddef.h>
+
+#include "image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Long-lived version of the pthread pipeline for callers that run the chain
+ * on many small batches. The threads and queues are created once and stay
+ * blocked on their queues between batches, frames keep coming from the same
+ * allocator arenas and huge page cache, so a batch only pays for its frames.
+ *
+ * One batch runs at a time: submit a directory or an array of frames, then
+ * wait for it. A directory batch is loaded like by the pipelines, from
+ * load_current to the first missing frame or load_end, and saved with
+ * image_dir_save(). A frame batch takes the ownership of the frames and
+ * returns the outputs in the same order.
+ */
+
+typedef struct pipeline_service pipeline_service_t;
+
+typedef struct pipeline_batch_stats {
+    size_t frames;          /* frames that went through the whole chain */
+    size_t dropped;         /* frames that couldn't be decoded or a filter failed on */
+    double first_seconds;   /* from the submit to the first frame out */
+    double latency_seconds; /* from the submit to the last frame out */
+} pipeline_batch_stats_t;
+
+/* threads_per_step threads per filter and for the output, 0 for one per online CPU */
+pipeline_service_t* pipeline_service_create(unsigned int threads_per_step);
+
+/* waits for the running batch and joins the threads */
+void pipeline_service_destroy(pipeline_service_t* service);
+
+/* fails while a batch is running */
+int pipeline_service_submit_dir(pipeline_service_t* service, image_dir_t* image_dir);
+
+/* outputs[i] is the result of frames[i], NULL if a filter failed on it */
+int pipeline_service_submit_frames(pipeline_service_t* service, image_t** frames, size_t count, image_t** outputs);
+
+int pipeline_service_wait(pipeline_service_t* service, pipeline_batch_stats_t* stats);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INCLUDE_SERVICE_H_ */
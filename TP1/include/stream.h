@@ -0,0 +1,37 @@
+#ifndef INCLUDE_STREAM_H_
+#define INCLUDE_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Output stream: instead of one PNG file per frame, the output frames are
+ * appended in frame order to a single file, as a sequence of PNG images that
+ * e.g. `ffmpeg -f image2pipe -i FILE` reads. The threads saving frames encode
+ * them in parallel and hand them to a reorder buffer, a single writer thread
+ * takes them in order and appends them with large buffered writes.
+ *
+ * Loaders that run on their own thread (pthread, tbb) call stream_admit()
+ * before every load, so no more than depth frames wait in the reorder buffer.
+ */
+
+extern bool stream_enabled;
+
+int stream_open(const char* filename, size_t depth, size_t first, size_t stride);
+int stream_close(void);
+
+void stream_admit(size_t frame);
+int stream_put(image_t* image);
+void stream_skip(size_t frame);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INCLUDE_STREAM_H_ */
@@ -0,0 +1,32 @@
+#ifndef INCLUDE_TILE_H_
+#define INCLUDE_TILE_H_
+
+#include <stddef.h>
+
+#include "image.h"
+
+/*
+ * Cache-blocked traversal of a filter output. The output is cut into tiles
+ * whose width keeps the 2 * halo + 1 input rows of a stencil and the output
+ * row in L1, and whose height keeps the whole input tile, halo included, in
+ * L2. The cache sizes are read once from sysfs.
+ *
+ * Output pixel (x, y) is computed from the input pixels around
+ * (x + halo, y + halo), so a 3x3 stencil has a halo of 1 and an output
+ * smaller by two pixels in both directions. Per-pixel filters (grayscale,
+ * fused chains of point filters) use a halo of 0.
+ */
+
+typedef struct tile {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+} tile_t;
+
+typedef void (*tile_kernel_t)(const image_t* input, image_t* output, const tile_t* tile, void* arg);
+
+void tile_get_size(size_t halo, size_t* width, size_t* height);
+void tile_for_each(const image_t* input, image_t* output, size_t halo, tile_kernel_t kernel, void* arg);
+
+#endif /* INCLUDE_TILE_H_ */
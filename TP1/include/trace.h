@@ -0,0 +1,30 @@
+#ifndef INCLUDE_TRACE_H_
+#define INCLUDE_TRACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Timeline of the pipeline execution in the Chrome trace event format, it can
+ * be opened with Perfetto (ui.perfetto.dev) or chrome://tracing. Every thread
+ * records its events into its own buffer without locking, the buffers are
+ * only merged when the trace is written by trace_close().
+ */
+
+extern bool trace_enabled;
+
+int trace_open(const char* filename);
+int trace_close(void);
+
+void trace_begin(const char* name, size_t frame);
+void trace_end(const char* name, size_t frame, size_t pixels);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* INCLUDE_TRACE_H_ */
@@ -0,0 +1,194 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "filter.h"
+#include "log.h"
+#include "trace.h"
+
+#define max(a, b) (((a) < (b)) ? (b) : (a))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+/* number of box passes approximating a gaussian */
+#define GAUSSIAN_BOX_PASSES 3
+
+#if defined(__x86_64__)
+#define BLUR_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define BLUR_CLONES
+#endif
+
+/* pixels are transposed in square blocks of that many pixels */
+#define TRANSPOSE_BLOCK 32
+
+/*
+ * Box blurs keep a running sum of the 2 * radius + 1 pixels under the window,
+ * one pixel enters and one leaves for every output, so the cost doesn't
+ * depend on the radius. Pixels outside the image repeat the nearest edge.
+ * All four channels are blurred, an opaque image stays opaque.
+ *
+ * Only the vertical pass is implemented: it keeps one running sum per channel
+ * of a row and vectorizes across the row. The horizontal pass runs it on the
+ * transposed image.
+ */
+
+BLUR_CLONES
+static int box_blur_columns(const image_t* image, image_t* new_image, size_t radius) {
+    size_t count = 4 * image->width;
+    size_t last  = image->height - 1;
+    float scale  = 1.0f / (2 * radius + 1);
+
+    int32_t* sums = malloc(count * sizeof(int32_t));
+    if (sums == NULL) {
+        LOG_ERROR_ERRNO("malloc");
+        goto fail_exit;
+    }
+
+    const unsigned char* pixels = (const unsigned char*)image->pixels;
+    unsigned char* new_pixels   = (unsigned char*)new_image->pixels;
+
+    /* window centered on row 0: radius + 1 copies of the edge and the next rows */
+    for (size_t i = 0; i < count; i++) {
+        sums[i] = pixels[i] * (int32_t)(radius + 1);
+    }
+    for (size_t j = 1; j <= min(radius, last); j++) {
+        for (size_t i = 0; i < count; i++) {
+            sums[i] += pixels[j * count + i];
+        }
+    }
+    if (radius > last) {
+        for (size_t i = 0; i < count; i++) {
+            sums[i] += pixels[last * count + i] * (int32_t)(radius - last);
+        }
+    }
+
+    for (size_t j = 0; j < image->height; j++) {
+        const unsigned char* entering = &pixels[min(j + radius + 1, last) * count];
+        const unsigned char* leaving  = &pixels[((j >= radius) ? j - radius : 0) * count];
+        unsigned char* new_row        = &new_pixels[j * count];
+
+        for (size_t i = 0; i < count; i++) {
+            new_row[i] = (int32_t)(sums[i] * scale + 0.5f);
+            sums[i] += entering[i] - leaving[i];
+        }
+    }
+
+    free(sums);
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+static void transpose(const image_t* image, image_t* new_image) {
+    size_t width          = image->width;
+    size_t height         = image->height;
+    const pixel_t* pixels = image->pixels;
+    pixel_t* new_pixels   = new_image->pixels;
+
+    for (size_t jj = 0; jj < height; jj += TRANSPOSE_BLOCK) {
+        for (size_t ii = 0; ii < width; ii += TRANSPOSE_BLOCK) {
+            size_t j_end = min(jj + TRANSPOSE_BLOCK, height);
+            size_t i_end = min(ii + TRANSPOSE_BLOCK, width);
+
+            for (size_t i = ii; i < i_end; i++) {
+                for (size_t j = jj; j < j_end; j++) {
+                    new_pixels[i * height + j] = pixels[j * width + i];
+                }
+            }
+        }
+    }
+}
+
+/* box blurs of the given radii along the columns, buffers[0] holds the input, returns the buffer of the output */
+static image_t* box_blur_columns_passes(image_t* buffers[2], const size_t* radii, size_t count) {
+    for (size_t p = 0; p < count; p++) {
+        if (box_blur_columns(buffers[p % 2], buffers[(p + 1) % 2], radii[p]) < 0) {
+            return NULL;
+        }
+    }
+
+    return buffers[count % 2];
+}
+
+/*
+ * Runs the box blurs of the given radii horizontally, then vertically. Box
+ * blurs commute, so this is the same as chaining the 2D box blurs but the
+ * image is only transposed twice.
+ */
+static image_t* box_blur_passes(image_t* image, const size_t* radii, size_t count) {
+    image_t* transposed[2] = {NULL, NULL};
+    image_t* buffers[2]    = {NULL, NULL};
+
+    transposed[0] = image_create(image->id, image->height, image->width);
+    transposed[1] = image_create(image->id, image->height, image->width);
+    buffers[0]    = image_create(image->id, image->width, image->height);
+    buffers[1]    = image_create(image->id, image->width, image->height);
+    if (transposed[0] == NULL || transposed[1] == NULL || buffers[0] == NULL || buffers[1] == NULL) {
+        goto fail_exit;
+    }
+
+    transpose(image, transposed[0]);
+    image_t* horizontal = box_blur_columns_passes(transposed, radii, count);
+    if (horizontal == NULL) {
+        goto fail_exit;
+    }
+
+    transpose(horizontal, buffers[0]);
+    image_t* new_image = box_blur_columns_passes(buffers, radii, count);
+    if (new_image == NULL) {
+        goto fail_exit;
+    }
+
+    image_destroy(transposed[0]);
+    image_destroy(transposed[1]);
+    image_destroy((new_image == buffers[0]) ? buffers[1] : buffers[0]);
+    return new_image;
+
+fail_exit:
+    for (int i = 0; i < 2; i++) {
+        if (transposed[i] != NULL) {
+            image_destroy(transposed[i]);
+        }
+        if (buffers[i] != NULL) {
+            image_destroy(buffers[i]);
+        }
+    }
+    return NULL;
+}
+
+image_t* filter_box_blur_radius(image_t* image, size_t radius) {
+    trace_begin(__func__, image->id);
+
+    image_t* new_image = box_blur_passes(image, &radius, 1);
+
+    trace_end(__func__, image->id, (new_image != NULL) ? image->width * image->height : 0);
+    return new_image;
+}
+
+image_t* filter_gaussian_blur_sigma(image_t* image, double sigma) {
+    trace_begin(__func__, image->id);
+
+    /*
+     * Widths of the boxes whose successive application has the variance of
+     * the gaussian: m boxes of odd width wl and the others of width wl + 2.
+     */
+    const int n = GAUSSIAN_BOX_PASSES;
+    double wl   = floor(sqrt(12.0 * sigma * sigma / n + 1));
+    if (fmod(wl, 2) == 0) {
+        wl--;
+    }
+    wl    = max(wl, 1);
+    int m = (int)round((12.0 * sigma * sigma - n * wl * wl - 4 * n * wl - 3 * n) / (-4 * wl - 4));
+
+    size_t radii[GAUSSIAN_BOX_PASSES];
+    for (int i = 0; i < n; i++) {
+        double width = (i < m) ? wl : wl + 2;
+        radii[i]     = (size_t)(width - 1) / 2;
+    }
+
+    image_t* new_image = box_blur_passes(image, radii, n);
+
+    trace_end(__func__, image->id, (new_image != NULL) ? image->width * image->height : 0);
+    return new_image;
+}
@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "channel.h"
+#include "log.h"
+
+#define CHANNEL_SEALS (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+/* width and height are 0 for a dropped frame, which comes without a memfd */
+typedef struct channel_header {
+    uint64_t id;
+    uint64_t width;
+    uint64_t height;
+} channel_header_t;
+
+int channel_create(int fds[2]) {
+    int sockets[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) < 0) {
+        LOG_ERROR_ERRNO("socketpair");
+        return -1;
+    }
+
+    /* only one direction is used, the reading end can't send back */
+    if (shutdown(sockets[1], SHUT_WR) < 0) {
+        LOG_ERROR_ERRNO("shutdown");
+        close(sockets[0]);
+        close(sockets[1]);
+        return -1;
+    }
+
+    fds[0] = sockets[0];
+    fds[1] = sockets[1];
+    return 0;
+}
+
+static int channel_send_message(int fd, const channel_header_t* header, int frame_fd) {
+    struct iovec iov = {.iov_base = (void*)header, .iov_len = sizeof(*header)};
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+
+    if (frame_fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control    = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level     = SOL_SOCKET;
+        cmsg->cmsg_type      = SCM_RIGHTS;
+        cmsg->cmsg_len       = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &frame_fd, sizeof(int));
+    }
+
+    /* a reader that died must not kill the writer with SIGPIPE */
+    while (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+        if (errno != EINTR) {
+            LOG_ERROR_ERRNO("sendmsg");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* frames allocated without the memfd policy pay one copy */
+static int channel_copy_to_memfd(image_t* image) {
+    size_t size = image->width * image->height * sizeof(pixel_t);
+
+    int fd = memfd_create("frame", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        LOG_ERROR_ERRNO("memfd_create");
+        return -1;
+    }
+
+    const unsigned char* bytes = (const unsigned char*)image->pixels;
+    for (size_t offset = 0; offset < size;) {
+        ssize_t written = write(fd, &bytes[offset], size - offset);
+        if (written < 0 && errno != EINTR) {
+            LOG_ERROR_ERRNO("write");
+            close(fd);
+            return -1;
+        }
+        offset += (written > 0) ? written : 0;
+    }
+
+    return fd;
+}
+
+int channel_send(int fd, image_t* image) {
+    channel_header_t header = {.id = image->id, .width = image->width, .height = image->height};
+    int frame_fd            = image->fd;
+
+    if (frame_fd < 0) {
+        frame_fd = channel_copy_to_memfd(image);
+        if (frame_fd < 0) {
+            goto fail_destroy;
+        }
+    } else if (image->pixels != NULL) {
+        /* F_SEAL_WRITE is refused while a writable shared mapping exists */
+        munmap(image->pixels, image->mapped_size);
+        image->pixels = NULL;
+    }
+
+    /* a frame received from another stage is already sealed */
+    if (fcntl(frame_fd, F_ADD_SEALS, CHANNEL_SEALS) < 0 && errno != EPERM) {
+        LOG_ERROR_ERRNO("fcntl");
+        goto fail_close;
+    }
+
+    if (channel_send_message(fd, &header, frame_fd) < 0) {
+        goto fail_close;
+    }
+
+    if (frame_fd != image->fd) {
+        close(frame_fd);
+    }
+    image_destroy(image);
+    return 0;
+
+fail_close:
+    if (frame_fd != image->fd) {
+        close(frame_fd);
+    }
+fail_destroy:
+    image_destroy(image);
+    return -1;
+}
+
+int channel_send_drop(int fd, size_t id) {
+    channel_header_t header = {.id = id, .width = 0, .height = 0};
+    return channel_send_message(fd, &header, -1);
+}
+
+int channel_recv(int fd, image_t** image, size_t* id) {
+    channel_header_t header;
+    struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    ssize_t length;
+    while ((length = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) < 0) {
+        if (errno != EINTR) {
+            LOG_ERROR_ERRNO("recvmsg");
+            return -1;
+        }
+    }
+
+    if (length == 0) {
+        return 0;
+    }
+
+    int frame_fd         = -1;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+        memcpy(&frame_fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    if (length != sizeof(header) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) {
+        LOG_ERROR("truncated frame message");
+        goto fail_close;
+    }
+
+    *id    = header.id;
+    *image = NULL;
+
+    if (header.width == 0 || header.height == 0) {
+        if (frame_fd >= 0) {
+            close(frame_fd);
+        }
+        return 1;
+    }
+
+    if (frame_fd < 0) {
+        LOG_ERROR("frame %zu came without its memfd", *id);
+        return -1;
+    }
+
+    /* the seals guarantee the sender can't change or shrink the pixels under the mapping */
+    struct stat stat;
+    int seals = fcntl(frame_fd, F_GET_SEALS);
+    if (seals < 0 || (seals & CHANNEL_SEALS) != CHANNEL_SEALS) {
+        LOG_ERROR("frame %zu is not sealed", *id);
+        goto fail_close;
+    }
+
+    if (header.width > SIZE_MAX / sizeof(pixel_t) / header.height || fstat(frame_fd, &stat) < 0 ||
+        (uint64_t)stat.st_size < header.width * header.height * sizeof(pixel_t)) {
+        LOG_ERROR("frame %zu is smaller than %zux%zu", *id, (size_t)header.width, (size_t)header.height);
+        goto fail_close;
+    }
+
+    *image = image_map_fd(header.id, header.width, header.height, frame_fd);
+    if (*image == NULL) {
+        return -1;
+    }
+
+    return 1;
+
+fail_close:
+    if (frame_fd >= 0) {
+        close(frame_fd);
+    }
+    return -1;
+}
@@ -0,0 +1,350 @@
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "counters.h"
+#include "log.h"
+
+/* nesting of the stages of a thread, and distinct stages, beyond that they are not counted */
+#define COUNTERS_MAX_DEPTH 16
+#define COUNTERS_MAX_STAGES 64
+
+typedef struct counters_event_config {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+} counters_event_config_t;
+
+typedef struct counters_stage {
+    const char* name;
+    size_t calls;
+    size_t pixels;
+    counters_sample_t counts;
+} counters_stage_t;
+
+typedef struct counters_entry {
+    const char* name;
+    counters_sample_t start;
+} counters_entry_t;
+
+typedef struct counters_thread counters_thread_t;
+
+typedef struct counters_thread {
+    counters_thread_t* next;
+    int leader; /* fd of the group leader, -1 when the counters couldn't be opened */
+    int fds[COUNTERS_EVENT_COUNT];
+    size_t depth;
+    counters_entry_t stack[COUNTERS_MAX_DEPTH];
+    size_t stage_count;
+    counters_stage_t stages[COUNTERS_MAX_STAGES];
+} counters_thread_t;
+
+/* LLC misses are the generic cache misses event, the last level cache on most CPUs */
+static const counters_event_config_t counters_events[COUNTERS_EVENT_COUNT] = {
+    [COUNTERS_CYCLES]       = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [COUNTERS_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [COUNTERS_LLC_MISSES]   = {"LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    [COUNTERS_DTLB_MISSES]  = {"dTLB misses", PERF_TYPE_HW_CACHE,
+                               PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+bool counters_enabled = false;
+bool counters_supported[COUNTERS_EVENT_COUNT];
+
+static int counters_errors[COUNTERS_EVENT_COUNT];
+
+static unsigned int counters_generation;
+static counters_thread_t* counters_threads;
+static __thread counters_thread_t* counters_local;
+static __thread unsigned int counters_local_generation; /* counters_local may be freed, compare this instead */
+
+static int counters_open_event(counters_event_t event, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size           = sizeof(attr);
+    attr.type           = counters_events[event].type;
+    attr.config         = counters_events[event].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    /* the calling thread, on any CPU */
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static counters_thread_t* counters_get_thread(void) {
+    if (counters_local != NULL && counters_local_generation == counters_generation) {
+        return counters_local;
+    }
+
+    counters_thread_t* thread = calloc(1, sizeof(*thread));
+    if (thread == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        return NULL;
+    }
+
+    thread->leader = -1;
+
+    /* one group, so the events of a stage are counted over the same time */
+    for (int event = 0; event < COUNTERS_EVENT_COUNT; event++) {
+        thread->fds[event] = -1;
+        if (!counters_supported[event]) {
+            continue;
+        }
+
+        thread->fds[event] = counters_open_event(event, thread->leader);
+        if (thread->fds[event] < 0) {
+            LOG_ERROR_ERRNO("perf_event_open");
+            break;
+        }
+
+        if (thread->leader < 0) {
+            thread->leader = thread->fds[event];
+        }
+    }
+
+    /* lock-free push, the list is only walked once every thread is done */
+    thread->next = __atomic_load_n(&counters_threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&counters_threads, &thread->next, thread, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+    }
+
+    counters_local = thread;
+    counters_local_generation = counters_generation;
+    return thread;
+}
+
+static int counters_read_thread(counters_thread_t* thread, counters_sample_t* sample) {
+    /* nr, time enabled, time running, then the values in the order the events were opened */
+    uint64_t buffer[3 + COUNTERS_EVENT_COUNT];
+
+    if (thread->leader < 0 || read(thread->leader, buffer, sizeof(buffer)) < 0) {
+        return -1;
+    }
+
+    uint64_t enabled = buffer[1];
+    uint64_t running = buffer[2];
+    size_t index     = 3;
+
+    for (int event = 0; event < COUNTERS_EVENT_COUNT; event++) {
+        sample->values[event] = 0;
+        if (thread->fds[event] < 0) {
+            continue;
+        }
+
+        /* the group shared the PMU with other events, extrapolate to the whole time */
+        if (running > 0) {
+            sample->values[event] = (double)buffer[index] * enabled / running;
+        }
+        index++;
+    }
+
+    return 0;
+}
+
+static counters_stage_t* counters_find_stage(counters_stage_t* stages, size_t* count, size_t max_count,
+                                             const char* name) {
+    for (size_t i = 0; i < *count; i++) {
+        if (strcmp(stages[i].name, name) == 0) {
+            return &stages[i];
+        }
+    }
+
+    if (*count == max_count) {
+        return NULL;
+    }
+
+    counters_stage_t* stage = &stages[(*count)++];
+    memset(stage, 0, sizeof(*stage));
+    stage->name = name;
+    return stage;
+}
+
+void counters_begin(const char* name) {
+    counters_thread_t* thread = counters_get_thread();
+    if (thread == NULL) {
+        return;
+    }
+
+    /* too deep, the stage is skipped but the nesting is kept */
+    if (thread->depth < COUNTERS_MAX_DEPTH) {
+        counters_entry_t* entry = &thread->stack[thread->depth];
+        entry->name             = name;
+        if (counters_read_thread(thread, &entry->start) < 0) {
+            entry->name = NULL;
+        }
+    }
+    thread->depth++;
+}
+
+void counters_end(const char* name, size_t pixels) {
+    counters_sample_t now;
+
+    counters_thread_t* thread = counters_get_thread();
+    if (thread == NULL || thread->depth == 0) {
+        return;
+    }
+
+    thread->depth--;
+    if (thread->depth >= COUNTERS_MAX_DEPTH) {
+        return;
+    }
+
+    counters_entry_t* entry = &thread->stack[thread->depth];
+    if (entry->name == NULL || counters_read_thread(thread, &now) < 0) {
+        return;
+    }
+
+    counters_stage_t* stage = counters_find_stage(thread->stages, &thread->stage_count, COUNTERS_MAX_STAGES, name);
+    if (stage == NULL) {
+        return;
+    }
+
+    stage->calls++;
+    stage->pixels += pixels;
+    for (int event = 0; event < COUNTERS_EVENT_COUNT; event++) {
+        stage->counts.values[event] += now.values[event] - entry->start.values[event];
+    }
+}
+
+int counters_read(counters_sample_t* sample) {
+    counters_thread_t* thread = counters_get_thread();
+    if (thread == NULL) {
+        return -1;
+    }
+
+    return counters_read_thread(thread, sample);
+}
+
+int counters_open(void) {
+    bool any = false;
+
+    for (int event = 0; event < COUNTERS_EVENT_COUNT; event++) {
+        int fd = counters_open_event(event, -1);
+
+        counters_supported[event] = (fd >= 0);
+        if (fd < 0) {
+            counters_errors[event] = errno;
+            continue;
+        }
+
+        close(fd);
+        any = true;
+    }
+
+    if (!any) {
+        /* ENOENT without a PMU (most virtual machines), EACCES with perf_event_paranoid */
+        LOG_ERROR("no hardware counter available: %s", strerror(counters_errors[COUNTERS_CYCLES]));
+        return -1;
+    }
+
+    counters_threads = NULL;
+    counters_generation++;
+    counters_enabled = true;
+
+    return 0;
+}
+
+int counters_close(void) {
+    if (!counters_enabled) {
+        return 0;
+    }
+
+    counters_enabled = false;
+
+    counters_thread_t* threads = __atomic_load_n(&counters_threads, __ATOMIC_ACQUIRE);
+    counters_threads           = NULL;
+
+    while (threads != NULL) {
+        counters_thread_t* thread = threads;
+        threads                   = thread->next;
+
+        for (int event = 0; event < COUNTERS_EVENT_COUNT; event++) {
+            if (thread->fds[event] >= 0) {
+                close(thread->fds[event]);
+            }
+        }
+        free(thread);
+    }
+
+    return 0;
+}
+
+static int counters_compare_cycles(const void* a, const void* b) {
+    const counters_stage_t* stage_a = a;
+    const counters_stage_t* stage_b = b;
+
+    uint64_t cycles_a = stage_a->counts.values[COUNTERS_CYCLES];
+    uint64_t cycles_b = stage_b->counts.values[COUNTERS_CYCLES];
+    return (cycles_a < cycles_b) - (cycles_a > cycles_b);
+}
+
+static void counters_print_value(counters_event_t event, double value, double divisor) {
+    if (!counters_supported[event] || divisor == 0) {
+        printf(" %12s", "-");
+    } else {
+        printf(" %12.3f", value / divisor);
+    }
+}
+
+void counters_print_ratios(const counters_sample_t* counts, size_t pixels) {
+    const uint64_t* values = counts->values;
+
+    counters_print_value(COUNTERS_INSTRUCTIONS, values[COUNTERS_INSTRUCTIONS],
+                         counters_supported[COUNTERS_CYCLES] ? values[COUNTERS_CYCLES] : 0);
+    counters_print_value(COUNTERS_CYCLES, values[COUNTERS_CYCLES], pixels);
+    counters_print_value(COUNTERS_LLC_MISSES, values[COUNTERS_LLC_MISSES], pixels);
+    counters_print_value(COUNTERS_DTLB_MISSES, values[COUNTERS_DTLB_MISSES], pixels);
+}
+
+void counters_print(const char* title) {
+    counters_stage_t stages[COUNTERS_MAX_STAGES];
+    size_t stage_count = 0;
+
+    if (!counters_enabled) {
+        return;
+    }
+
+    counters_thread_t* thread = __atomic_load_n(&counters_threads, __ATOMIC_ACQUIRE);
+    for (; thread != NULL; thread = thread->next) {
+        for (size_t i = 0; i < thread->stage_count; i++) {
+            counters_stage_t* stage = &thread->stages[i];
+            counters_stage_t* total = counters_find_stage(stages, &stage_count, COUNTERS_MAX_STAGES, stage->name);
+            if (total == NULL) {
+                continue;
+            }
+
+            total->calls += stage->calls;
+            total->pixels += stage->pixels;
+            for (int event = 0; event < COUNTERS_EVENT_COUNT; event++) {
+                total->counts.values[event] += stage->counts.values[event];
+            }
+        }
+    }
+
+    qsort(stages, stage_count, sizeof(stages[0]), counters_compare_cycles);
+
+    /* stages include the stages nested in them, the pixels are the ones they output */
+    printf("\n%-24s %8s %10s %12s %12s %12s %12s %12s\n", title, "calls", "Mpixel", "Mcycles", "IPC", "cycles/px",
+           "LLC miss/px", "dTLB miss/px");
+    for (size_t i = 0; i < stage_count; i++) {
+        counters_stage_t* stage = &stages[i];
+
+        printf("%-24s %8zu %10.2f", stage->name, stage->calls, stage->pixels / 1e6);
+        counters_print_value(COUNTERS_CYCLES, stage->counts.values[COUNTERS_CYCLES], 1e6);
+        counters_print_ratios(&stage->counts, stage->pixels);
+        printf("\n");
+    }
+
+    for (int event = 0; event < COUNTERS_EVENT_COUNT; event++) {
+        if (!counters_supported[event]) {
+            printf("%s not available: %s\n", counters_events[event].name, strerror(counters_errors[event]));
+        }
+    }
+    fflush(stdout);
+}
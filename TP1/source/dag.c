@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dag.h"
+#include "log.h"
+#include "pipeline.h"
+
+dag_t pipeline_dag;
+
+void dag_init(dag_t* dag) {
+    memset(dag, 0, sizeof(*dag));
+    dag->node_count = 1;
+}
+
+/* child of the node applying filter with value, created when no branch added it yet */
+static dag_node_t* dag_get_child(dag_t* dag, dag_node_t* node, const filter_entry_t* filter, double value) {
+    for (size_t i = 0; i < node->child_count; i++) {
+        dag_node_t* child = &dag->nodes[node->children[i]];
+        if (child->filter == filter && child->value == value) {
+            return child;
+        }
+    }
+
+    if (dag->node_count == DAG_MAX_NODES || node->child_count == DAG_MAX_CHILDREN) {
+        LOG_ERROR("too many filters in the branches");
+        return NULL;
+    }
+
+    node->children[node->child_count++] = dag->node_count;
+
+    dag_node_t* child = &dag->nodes[dag->node_count++];
+    child->filter     = filter;
+    child->value      = value;
+    return child;
+}
+
+int dag_add_branch(dag_t* dag, const char* spec) {
+    char filter_spec[128];
+
+    size_t length = strcspn(spec, "=");
+    if (length == 0 || spec[length] != '=' || spec[length + 1] == '\0') {
+        LOG_ERROR("expected PREFIX=FILTER[,FILTER...] instead of `%s`", spec);
+        goto fail_exit;
+    }
+
+    if (length >= DAG_MAX_PREFIX || memchr(spec, '/', length) != NULL) {
+        LOG_ERROR("invalid branch prefix `%.*s`", (int)length, spec);
+        goto fail_exit;
+    }
+
+    if (dag->output_count == DAG_MAX_OUTPUTS) {
+        LOG_ERROR("too many branches, at most %d", DAG_MAX_OUTPUTS);
+        goto fail_exit;
+    }
+
+    for (size_t i = 0; i < dag->output_count; i++) {
+        if (strncmp(dag->outputs[i], spec, length) == 0 && dag->outputs[i][length] == '\0') {
+            LOG_ERROR("two branches with prefix `%s`", dag->outputs[i]);
+            goto fail_exit;
+        }
+    }
+
+    dag_node_t* node = &dag->nodes[0];
+    const char* next = &spec[length + 1];
+
+    while (1) {
+        size_t filter_length = strcspn(next, ",");
+        if (filter_length >= sizeof(filter_spec)) {
+            LOG_ERROR("filter too long in branch `%s`", spec);
+            goto fail_exit;
+        }
+
+        memcpy(filter_spec, next, filter_length);
+        filter_spec[filter_length] = '\0';
+
+        const filter_entry_t* filter;
+        double value;
+        if (filter_registry_parse(filter_spec, &filter, &value) < 0) {
+            goto fail_exit;
+        }
+
+        node = dag_get_child(dag, node, filter, value);
+        if (node == NULL) {
+            goto fail_exit;
+        }
+
+        if (next[filter_length] == '\0') {
+            break;
+        }
+        next += filter_length + 1;
+    }
+
+    if (node->output_count == DAG_MAX_OUTPUTS) {
+        LOG_ERROR("too many branches, at most %d", DAG_MAX_OUTPUTS);
+        goto fail_exit;
+    }
+
+    node->outputs[node->output_count++] = dag->output_count;
+    memcpy(dag->outputs[dag->output_count], spec, length);
+    dag->outputs[dag->output_count][length] = '\0';
+    dag->output_count++;
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+dag_frame_t* dag_frame_create(const dag_node_t* node, image_t* image, dag_frame_t* source) {
+    dag_frame_t* frame = malloc(sizeof(*frame));
+    if (frame == NULL) {
+        LOG_ERROR_ERRNO("malloc");
+        return NULL;
+    }
+
+    frame->image   = image;
+    frame->node    = node;
+    frame->refs    = dag_node_consumers(node);
+    frame->source  = (source != NULL) ? source : frame;
+    frame->pending = 1;
+
+    /* the parent still holds its reference, so pending can't drop to zero meanwhile */
+    if (source != NULL) {
+        __atomic_fetch_add(&source->pending, 1, __ATOMIC_RELAXED);
+    }
+
+    return frame;
+}
+
+dag_frame_t* dag_frame_apply(const dag_t* dag, dag_frame_t* parent, size_t child) {
+    const dag_node_t* node = &dag->nodes[parent->node->children[child]];
+
+    image_t* image = node->filter->apply(parent->image, node->value);
+    if (image == NULL) {
+        LOG_ERROR("filter `%s` failed on frame %zu", node->filter->name, parent->image->id);
+        return NULL;
+    }
+
+    dag_frame_t* frame = dag_frame_create(node, image, parent->source);
+    if (frame == NULL) {
+        image_destroy(image);
+    }
+
+    return frame;
+}
+
+bool dag_frame_release(dag_frame_t* frame) {
+    if (__atomic_sub_fetch(&frame->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return false;
+    }
+
+    dag_frame_t* source = frame->source;
+
+    image_destroy(frame->image);
+    frame->image = NULL;
+    if (frame != source) {
+        free(frame);
+    }
+
+    if (__atomic_sub_fetch(&source->pending, 1, __ATOMIC_ACQ_REL) > 0) {
+        return false;
+    }
+
+    free(source);
+    return true;
+}
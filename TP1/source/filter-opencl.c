@@ -0,0 +1,299 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter-opencl.h"
+#include "log.h"
+#include "opencl.h"
+#include "trace.h"
+
+/* same layout as matrix33_t in filter.cl */
+typedef struct opencl_matrix33 {
+    cl_double m[9];
+} opencl_matrix33_t;
+
+static cl_kernel create_kernel(cl_program program, const char* name) {
+    cl_int status;
+    cl_kernel kernel = clCreateKernel(program, name, &status);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clCreateKernel(%s) (%d)", name, status);
+        return NULL;
+    }
+
+    return kernel;
+}
+
+int filter_opencl_init(filter_opencl_t* opencl, cl_device_id device_id) {
+    char* code = NULL;
+    size_t len = 0;
+    cl_int status;
+
+    memset(opencl, 0, sizeof(*opencl));
+
+    opencl->context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &status);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clCreateContext (%d)", status);
+        goto fail_exit;
+    }
+
+    opencl->queue = clCreateCommandQueue(opencl->context, device_id, 0, &status);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clCreateCommandQueue (%d)", status);
+        goto fail_cleanup;
+    }
+
+    if (opencl_load_kernel_code(&code, &len) < 0) {
+        LOG_ERROR("failed to load the kernel code");
+        goto fail_cleanup;
+    }
+
+    opencl->program = clCreateProgramWithSource(opencl->context, 1, (const char**)&code, &len, &status);
+    free(code);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clCreateProgramWithSource (%d)", status);
+        goto fail_cleanup;
+    }
+
+    status = clBuildProgram(opencl->program, 1, &device_id, NULL, NULL, NULL);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clBuildProgram (%d)", status);
+        opencl_print_build_log(opencl->program, device_id);
+        goto fail_cleanup;
+    }
+
+    opencl->scale_up        = create_kernel(opencl->program, "scale_up");
+    opencl->desaturate      = create_kernel(opencl->program, "desaturate");
+    opencl->horizontal_flip = create_kernel(opencl->program, "horizontal_flip");
+    opencl->sobel           = create_kernel(opencl->program, "sobel");
+    opencl->convolution33   = create_kernel(opencl->program, "convolution33");
+    if (opencl->scale_up == NULL || opencl->desaturate == NULL || opencl->horizontal_flip == NULL ||
+        opencl->sobel == NULL || opencl->convolution33 == NULL) {
+        goto fail_cleanup;
+    }
+
+    return 0;
+
+fail_cleanup:
+    filter_opencl_cleanup(opencl);
+fail_exit:
+    return -1;
+}
+
+void filter_opencl_cleanup(filter_opencl_t* opencl) {
+    cl_kernel kernels[] = {opencl->scale_up, opencl->desaturate, opencl->horizontal_flip, opencl->sobel,
+                           opencl->convolution33};
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (kernels[i] != NULL) {
+            clReleaseKernel(kernels[i]);
+        }
+    }
+
+    if (opencl->program != NULL) {
+        clReleaseProgram(opencl->program);
+    }
+    if (opencl->queue != NULL) {
+        clReleaseCommandQueue(opencl->queue);
+    }
+    if (opencl->context != NULL) {
+        clReleaseContext(opencl->context);
+    }
+
+    memset(opencl, 0, sizeof(*opencl));
+}
+
+int opencl_image_reserve(filter_opencl_t* opencl, opencl_image_t* image, size_t id, size_t width, size_t height) {
+    image->id     = id;
+    image->width  = width;
+    image->height = height;
+
+    if (image->buffer != NULL && image->capacity >= width * height) {
+        return 0;
+    }
+
+    opencl_image_release(image);
+
+    cl_int status;
+    size_t size   = width * height * sizeof(pixel_t);
+    image->buffer = clCreateBuffer(opencl->context, CL_MEM_READ_WRITE, size, NULL, &status);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clCreateBuffer (%d)", status);
+        image->buffer = NULL;
+        return -1;
+    }
+
+    image->capacity = width * height;
+    return 0;
+}
+
+void opencl_image_release(opencl_image_t* image) {
+    if (image->buffer != NULL) {
+        clReleaseMemObject(image->buffer);
+    }
+
+    image->buffer   = NULL;
+    image->capacity = 0;
+}
+
+int opencl_image_upload(filter_opencl_t* opencl, const image_t* image, opencl_image_t* device_image) {
+    trace_begin(__func__, image->id);
+
+    if (opencl_image_reserve(opencl, device_image, image->id, image->width, image->height) < 0) {
+        goto fail_exit;
+    }
+
+    /* blocking, the caller can destroy the image right away */
+    cl_int status = clEnqueueWriteBuffer(opencl->queue, device_image->buffer, CL_TRUE, 0,
+                                         image->width * image->height * sizeof(pixel_t), image->pixels, 0, NULL, NULL);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clEnqueueWriteBuffer (%d)", status);
+        goto fail_exit;
+    }
+
+    trace_end(__func__, image->id, image->width * image->height);
+    return 0;
+
+fail_exit:
+    trace_end(__func__, image->id, 0);
+    return -1;
+}
+
+image_t* opencl_image_download(filter_opencl_t* opencl, const opencl_image_t* device_image) {
+    trace_begin(__func__, device_image->id);
+
+    image_t* image = image_create(device_image->id, device_image->width, device_image->height);
+    if (image == NULL) {
+        goto fail_exit;
+    }
+
+    /* blocking, waits for the filters enqueued before */
+    cl_int status = clEnqueueReadBuffer(opencl->queue, device_image->buffer, CL_TRUE, 0,
+                                        image->width * image->height * sizeof(pixel_t), image->pixels, 0, NULL, NULL);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clEnqueueReadBuffer (%d)", status);
+        goto fail_destroy_image;
+    }
+
+    trace_end(__func__, device_image->id, image->width * image->height);
+    return image;
+
+fail_destroy_image:
+    image_destroy(image);
+fail_exit:
+    trace_end(__func__, device_image->id, 0);
+    return NULL;
+}
+
+/*
+ * Enqueues the kernel over the output. Kernels run asynchronously, a trace
+ * event would only measure the enqueue, so the queue is drained when tracing.
+ */
+static int enqueue_kernel(filter_opencl_t* opencl, cl_kernel kernel, const char* name, const opencl_image_t* image,
+                          cl_uint dimensions, const size_t* global_size) {
+    trace_begin(name, image->id);
+
+    cl_int status = clEnqueueNDRangeKernel(opencl->queue, kernel, dimensions, NULL, global_size, NULL, 0, NULL, NULL);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clEnqueueNDRangeKernel(%s) (%d)", name, status);
+        goto fail_exit;
+    }
+
+    if (trace_enabled && (status = clFinish(opencl->queue)) != CL_SUCCESS) {
+        LOG_ERROR("clFinish (%d)", status);
+        goto fail_exit;
+    }
+
+    trace_end(name, image->id, image->width * image->height);
+    return 0;
+
+fail_exit:
+    trace_end(name, image->id, 0);
+    return -1;
+}
+
+static int set_buffers(cl_kernel kernel, const opencl_image_t* image, const opencl_image_t* new_image) {
+    cl_int status = clSetKernelArg(kernel, 0, sizeof(cl_mem), &image->buffer);
+    if (status == CL_SUCCESS) {
+        status = clSetKernelArg(kernel, 1, sizeof(cl_mem), &new_image->buffer);
+    }
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clSetKernelArg (%d)", status);
+        return -1;
+    }
+
+    return 0;
+}
+
+int filter_opencl_scale_up(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image,
+                           size_t factor) {
+    if (opencl_image_reserve(opencl, new_image, image->id, factor * image->width, factor * image->height) < 0 ||
+        set_buffers(opencl->scale_up, image, new_image) < 0) {
+        return -1;
+    }
+
+    cl_uint width     = image->width;
+    cl_uint cl_factor = factor;
+    cl_int status     = clSetKernelArg(opencl->scale_up, 2, sizeof(cl_uint), &width);
+    if (status == CL_SUCCESS) {
+        status = clSetKernelArg(opencl->scale_up, 3, sizeof(cl_uint), &cl_factor);
+    }
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clSetKernelArg (%d)", status);
+        return -1;
+    }
+
+    size_t global_size[2] = {new_image->width, new_image->height};
+    return enqueue_kernel(opencl, opencl->scale_up, __func__, image, 2, global_size);
+}
+
+int filter_opencl_desaturate(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image) {
+    if (opencl_image_reserve(opencl, new_image, image->id, image->width, image->height) < 0 ||
+        set_buffers(opencl->desaturate, image, new_image) < 0) {
+        return -1;
+    }
+
+    size_t global_size[1] = {image->width * image->height};
+    return enqueue_kernel(opencl, opencl->desaturate, __func__, image, 1, global_size);
+}
+
+int filter_opencl_horizontal_flip(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image) {
+    if (opencl_image_reserve(opencl, new_image, image->id, image->width, image->height) < 0 ||
+        set_buffers(opencl->horizontal_flip, image, new_image) < 0) {
+        return -1;
+    }
+
+    size_t global_size[2] = {image->width, image->height};
+    return enqueue_kernel(opencl, opencl->horizontal_flip, __func__, image, 2, global_size);
+}
+
+int filter_opencl_sobel(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image) {
+    if (opencl_image_reserve(opencl, new_image, image->id, image->width - 2, image->height - 2) < 0 ||
+        set_buffers(opencl->sobel, image, new_image) < 0) {
+        return -1;
+    }
+
+    size_t global_size[2] = {new_image->width, new_image->height};
+    return enqueue_kernel(opencl, opencl->sobel, __func__, image, 2, global_size);
+}
+
+int filter_opencl_convolution33(filter_opencl_t* opencl, const opencl_image_t* image, opencl_image_t* new_image,
+                                const double m[3][3]) {
+    if (opencl_image_reserve(opencl, new_image, image->id, image->width - 2, image->height - 2) < 0 ||
+        set_buffers(opencl->convolution33, image, new_image) < 0) {
+        return -1;
+    }
+
+    opencl_matrix33_t matrix;
+    for (int y = 0; y < 3; y++) {
+        for (int x = 0; x < 3; x++) {
+            matrix.m[3 * y + x] = m[y][x];
+        }
+    }
+
+    cl_int status = clSetKernelArg(opencl->convolution33, 2, sizeof(matrix), &matrix);
+    if (status != CL_SUCCESS) {
+        LOG_ERROR("clSetKernelArg (%d)", status);
+        return -1;
+    }
+
+    size_t global_size[2] = {new_image->width, new_image->height};
+    return enqueue_kernel(opencl, opencl->convolution33, __func__, image, 2, global_size);
+}
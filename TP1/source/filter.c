@@ -2,8 +2,12 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "image.h"
+#include "kernel.h"
+#include "tile.h"
+#include "trace.h"
 
 #define max(a, b) (((a) < (b)) ? (b) : (a))
 #define min(a, b) (((a) < (b)) ? (a) : (b))
@@ -113,82 +117,51 @@ done:
     hsv[2] = v;
 }
 
-image_t* filter_scale_up(image_t* image, size_t factor) {
-    image_t* new_image = image_create(image->id, factor * image->width, factor * image->height);
-    if (new_image == NULL) {
-        goto fail_exit;
-    }
+static void sobel_tile(const image_t* image, image_t* new_image, const tile_t* tile, void* arg) {
+    size_t count = 4 * tile->width;
 
-    for (int j = 0; j < image->height; j++) {
-        for (int i = 0; i < image->width; i++) {
-            pixel_t* pixel = image_get_pixel(image, i, j);
+    for (size_t j = tile->y; j < tile->y + tile->height; j++) {
+        /* rows as flat bytes, the neighbours of a channel are 4 bytes apart */
+        const unsigned char* top    = (const unsigned char*)&image->pixels[(j + 0) * image->width + tile->x];
+        const unsigned char* middle = (const unsigned char*)&image->pixels[(j + 1) * image->width + tile->x];
+        const unsigned char* bottom = (const unsigned char*)&image->pixels[(j + 2) * image->width + tile->x];
+        unsigned char* new_row      = (unsigned char*)&new_image->pixels[j * new_image->width + tile->x];
 
-            for (int kj = 0; kj < factor; kj++) {
-                for (int ki = 0; ki < factor; ki++) {
-                    pixel_t* new_pixel = image_get_pixel(new_image, factor * i + ki, factor * j + kj);
-                    *new_pixel         = *pixel;
-                }
-            }
-        }
-    }
+        for (size_t i = 0; i < count; i++) {
+            int value_x = (top[i] - top[i + 8]) + 2 * (middle[i] - middle[i + 8]) + (bottom[i] - bottom[i + 8]);
+            int value_y = (top[i] + 2 * top[i + 4] + top[i + 8]) - (bottom[i] + 2 * bottom[i + 4] + bottom[i + 8]);
 
-    return new_image;
+            new_row[i] = clamp(abs(value_x) + abs(value_y), 0, 255);
+        }
 
-fail_exit:
-    return NULL;
+        /* alpha is copied from the center pixel */
+        for (size_t i = 3; i < count; i += 4) {
+            new_row[i] = middle[i + 4];
+        }
+    }
 }
 
 image_t* filter_sobel(image_t* image) {
+    trace_begin(__func__, image->id);
+
     image_t* new_image = image_create(image->id, image->width - 2, image->height - 2);
     if (new_image == NULL) {
         goto fail_exit;
     }
 
-    const int gx[3][3] = {
-        {1, 0, -1},
-        {2, 0, -2},
-        {1, 0, -1},
-    };
-
-    const int gy[3][3] = {
-        {1, 2, 1},
-        {0, 0, 0},
-        {-1, -2, -1},
-    };
-
-    for (int j = 1; j < image->height - 1; j++) {
-        for (int i = 1; i < image->width - 1; i++) {
-            int values_x[4] = {0, 0, 0, 0};
-            int values_y[4] = {0, 0, 0, 0};
-
-            for (int y = -1; y <= 1; y++) {
-                for (int x = -1; x <= 1; x++) {
-                    pixel_t* pixel = image_get_pixel(image, i + x, j + y);
-
-                    for (int k = 0; k < 4; k++) {
-                        values_x[k] += pixel->bytes[k] * gx[y + 1][x + 1];
-                        values_y[k] += pixel->bytes[k] * gy[y + 1][x + 1];
-                    }
-                }
-            }
-
-            pixel_t* new_pixel = image_get_pixel(new_image, i - 1, j - 1);
-            pixel_t* pixel     = image_get_pixel(image, i, j);
-
-            for (int k = 0; k < 3; k++) {
-                new_pixel->bytes[k] = clamp(abs(values_x[k]) + abs(values_y[k]), 0, 255);
-            }
-            new_pixel->bytes[3] = pixel->bytes[3];
-        }
-    }
+    tile_for_each(image, new_image, 1, sobel_tile, NULL);
 
+    trace_end(__func__, image->id, image->width * image->height);
     return new_image;
 
 fail_exit:
+    trace_end(__func__, image->id, 0);
     return NULL;
 }
 
 image_t* filter_to_hsv(image_t* image) {
+    trace_begin(__func__, image->id);
+
     image_t* new_image = image_create(image->id, image->width, image->height);
     if (new_image == NULL) {
         goto fail_exit;
@@ -204,13 +177,17 @@ image_t* filter_to_hsv(image_t* image) {
         }
     }
 
+    trace_end(__func__, image->id, image->width * image->height);
     return new_image;
 
 fail_exit:
+    trace_end(__func__, image->id, 0);
     return NULL;
 }
 
 image_t* filter_to_rgb(image_t* image) {
+    trace_begin(__func__, image->id);
+
     image_t* new_image = image_create(image->id, image->width, image->height);
     if (new_image == NULL) {
         goto fail_exit;
@@ -226,100 +203,96 @@ image_t* filter_to_rgb(image_t* image) {
         }
     }
 
+    trace_end(__func__, image->id, image->width * image->height);
     return new_image;
 
 fail_exit:
+    trace_end(__func__, image->id, 0);
     return NULL;
 }
 
 image_t* filter_add_pixel(image_t* image, pixel_t* add_pixel) {
+    trace_begin(__func__, image->id);
+
     image_t* new_image = image_create(image->id, image->width, image->height);
     if (new_image == NULL) {
         goto fail_exit;
     }
 
-    for (int j = 0; j < image->height; j++) {
-        for (int i = 0; i < image->width; i++) {
-            pixel_t* pixel     = image_get_pixel(image, i, j);
-            pixel_t* new_pixel = image_get_pixel(new_image, i, j);
-
-            for (int k = 0; k < 3; k++) {
-                new_pixel->bytes[k] = pixel->bytes[k] + add_pixel->bytes[k];
-            }
-
-            new_pixel->bytes[3] = pixel->bytes[3];
-        }
-    }
+    kernel_add_pixel(image->pixels, new_image->pixels, image->width * image->height, add_pixel);
 
+    trace_end(__func__, image->id, image->width * image->height);
     return new_image;
 
 fail_exit:
+    trace_end(__func__, image->id, 0);
     return NULL;
 }
 
 image_t* filter_desaturate(image_t* image) {
+    trace_begin(__func__, image->id);
+
     image_t* new_image = image_create(image->id, image->width, image->height);
     if (new_image == NULL) {
         goto fail_exit;
     }
 
-    for (int j = 0; j < image->height; j++) {
-        for (int i = 0; i < image->width; i++) {
-            pixel_t* pixel     = image_get_pixel(image, i, j);
-            pixel_t* new_pixel = image_get_pixel(new_image, i, j);
-
-            double value = 0;
-            value += 0.30 * ((double)pixel->bytes[0]);
-            value += 0.59 * ((double)pixel->bytes[1]);
-            value += 0.11 * ((double)pixel->bytes[2]);
-
-            new_pixel->bytes[0] = (unsigned char)value;
-            new_pixel->bytes[1] = (unsigned char)value;
-            new_pixel->bytes[2] = (unsigned char)value;
-            new_pixel->bytes[3] = pixel->bytes[3];
-        }
-    }
+    /* fixed-point version of 0.30 r + 0.59 g + 0.11 b, see kernel.c */
+    kernel_desaturate(image->pixels, new_image->pixels, image->width * image->height);
 
+    trace_end(__func__, image->id, image->width * image->height);
     return new_image;
 
 fail_exit:
+    trace_end(__func__, image->id, 0);
     return NULL;
 }
 
-image_t* filter_convolution33(image_t* image, const double m[3][3]) {
-    image_t* new_image = image_create(image->id, image->width - 2, image->height - 2);
-    if (new_image == NULL) {
-        goto fail_exit;
-    }
-
-    for (int j = 1; j < image->height - 1; j++) {
-        for (int i = 1; i < image->width - 1; i++) {
-            double values[3] = {0, 0, 0};
+static void convolution33_tile(const image_t* image, image_t* new_image, const tile_t* tile, void* arg) {
+    const double(*m)[3] = arg;
+    size_t count        = 4 * tile->width;
 
-            for (int y = -1; y <= 1; y++) {
-                for (int x = -1; x <= 1; x++) {
-                    pixel_t* pixel = image_get_pixel(image, i + x, j + y);
+    for (size_t j = tile->y; j < tile->y + tile->height; j++) {
+        const unsigned char* rows[3] = {
+            (const unsigned char*)&image->pixels[(j + 0) * image->width + tile->x],
+            (const unsigned char*)&image->pixels[(j + 1) * image->width + tile->x],
+            (const unsigned char*)&image->pixels[(j + 2) * image->width + tile->x],
+        };
+        unsigned char* new_row = (unsigned char*)&new_image->pixels[j * new_image->width + tile->x];
 
-                    for (int k = 0; k < 3; k++) {
-                        values[k] += pixel->bytes[k] * m[y + 1][x + 1];
-                    }
+        for (size_t i = 0; i < count; i++) {
+            /* same summation order as a per-pixel loop, so rounding is unchanged */
+            double value = 0;
+            for (int y = 0; y < 3; y++) {
+                for (int x = 0; x < 3; x++) {
+                    value += rows[y][i + 4 * x] * m[y][x];
                 }
             }
 
-            pixel_t* new_pixel = image_get_pixel(new_image, i - 1, j - 1);
-            pixel_t* pixel     = image_get_pixel(image, i, j);
-
-            for (int k = 0; k < 3; k++) {
-                new_pixel->bytes[k] = (unsigned char)clamp(values[k], 0, 255);
-            }
+            new_row[i] = (unsigned char)clamp(value, 0, 255);
+        }
 
-            new_pixel->bytes[3] = pixel->bytes[3];
+        for (size_t i = 3; i < count; i += 4) {
+            new_row[i] = rows[1][i + 4];
         }
     }
+}
+
+image_t* filter_convolution33(image_t* image, const double m[3][3]) {
+    trace_begin(__func__, image->id);
+
+    image_t* new_image = image_create(image->id, image->width - 2, image->height - 2);
+    if (new_image == NULL) {
+        goto fail_exit;
+    }
+
+    tile_for_each(image, new_image, 1, convolution33_tile, (void*)m);
 
+    trace_end(__func__, image->id, image->width * image->height);
     return new_image;
 
 fail_exit:
+    trace_end(__func__, image->id, 0);
     return NULL;
 }
 
@@ -330,7 +303,11 @@ image_t* filter_edge_identity(image_t* image) {
         {0, 0, 0},
     };
 
-    return filter_convolution33(image, m);
+    trace_begin(__func__, image->id);
+    image_t* new_image = filter_convolution33(image, m);
+    trace_end(__func__, image->id, image->width * image->height);
+
+    return new_image;
 }
 
 image_t* filter_edge_detect(image_t* image) {
@@ -340,7 +317,11 @@ image_t* filter_edge_detect(image_t* image) {
         {-1, -1, -1},
     };
 
-    return filter_convolution33(image, m);
+    trace_begin(__func__, image->id);
+    image_t* new_image = filter_convolution33(image, m);
+    trace_end(__func__, image->id, image->width * image->height);
+
+    return new_image;
 }
 
 image_t* filter_sharpen(image_t* image) {
@@ -350,7 +331,11 @@ image_t* filter_sharpen(image_t* image) {
         {0, -2, 0},
     };
 
-    return filter_convolution33(image, m);
+    trace_begin(__func__, image->id);
+    image_t* new_image = filter_convolution33(image, m);
+    trace_end(__func__, image->id, image->width * image->height);
+
+    return new_image;
 }
 
 image_t* filter_box_blur(image_t* image) {
@@ -360,7 +345,11 @@ image_t* filter_box_blur(image_t* image) {
         {1.0 / 9.0, 1.0 / 9.0, 1.0 / 9.0},
     };
 
-    return filter_convolution33(image, m);
+    trace_begin(__func__, image->id);
+    image_t* new_image = filter_convolution33(image, m);
+    trace_end(__func__, image->id, image->width * image->height);
+
+    return new_image;
 }
 
 image_t* filter_gaussian_blur(image_t* image) {
@@ -370,47 +359,52 @@ image_t* filter_gaussian_blur(image_t* image) {
         {1.0 / 16.0, 2.0 / 16.0, 1.0 / 16.0},
     };
 
-    return filter_convolution33(image, m);
+    trace_begin(__func__, image->id);
+    image_t* new_image = filter_convolution33(image, m);
+    trace_end(__func__, image->id, image->width * image->height);
+
+    return new_image;
 }
 
 image_t* filter_horizontal_flip(image_t* image) {
+    trace_begin(__func__, image->id);
+
     image_t* new_image = image_create(image->id, image->width, image->height);
     if (new_image == NULL) {
         goto fail_exit;
     }
 
     for (int j = 0; j < image->height; j++) {
-        for (int i = 0; i < image->width; i++) {
-            pixel_t* pixel     = image_get_pixel(image, i, j);
-            pixel_t* new_pixel = image_get_pixel(new_image, (image->width - 1) - i, j);
-
-            *new_pixel = *pixel;
-        }
+        kernel_reverse(image_get_pixel(image, 0, j), image_get_pixel(new_image, 0, j), image->width);
     }
 
+    trace_end(__func__, image->id, image->width * image->height);
     return new_image;
 
 fail_exit:
+    trace_end(__func__, image->id, 0);
     return NULL;
 }
 
 image_t* filter_vertical_flip(image_t* image) {
+    trace_begin(__func__, image->id);
+
     image_t* new_image = image_create(image->id, image->width, image->height);
     if (new_image == NULL) {
         goto fail_exit;
     }
 
     for (int j = 0; j < image->height; j++) {
-        for (int i = 0; i < image->width; i++) {
-            pixel_t* pixel     = image_get_pixel(image, i, j);
-            pixel_t* new_pixel = image_get_pixel(new_image, i, (image->height - j) - 1);
+        pixel_t* row     = image_get_pixel(image, 0, j);
+        pixel_t* new_row = image_get_pixel(new_image, 0, (image->height - j) - 1);
 
-            *new_pixel = *pixel;
-        }
+        memcpy(new_row, row, image->width * sizeof(pixel_t));
     }
 
+    trace_end(__func__, image->id, image->width * image->height);
     return new_image;
 
 fail_exit:
+    trace_end(__func__, image->id, 0);
     return NULL;
 }
@@ -0,0 +1,201 @@
+#include <errno.h>
+#include <linux/futex.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "futex-queue.h"
+#include "log.h"
+
+/* bounds of the adaptive spin, in polls of the waiter state */
+#define FUTEX_QUEUE_MAX_SPIN 4096
+#define FUTEX_QUEUE_MIN_SPIN 16
+
+/*
+ * Waiter states: the waiter spins while WAITING, then announces SLEEPING
+ * before its futex wait. The waker swaps in READY and only makes the wake
+ * system call when the waiter was asleep.
+ */
+enum {
+    FUTEX_WAITER_WAITING,
+    FUTEX_WAITER_READY,
+    FUTEX_WAITER_SLEEPING,
+};
+
+static long futex(uint32_t* word, int op, uint32_t value) {
+    return syscall(SYS_futex, word, op, value, NULL, NULL, 0);
+}
+
+static void waiters_append(futex_waiters_t* waiters, futex_waiter_t* waiter) {
+    waiter->next = NULL;
+    if (waiters->tail != NULL) {
+        waiters->tail->next = waiter;
+    } else {
+        waiters->head = waiter;
+    }
+    waiters->tail = waiter;
+}
+
+static futex_waiter_t* waiters_take(futex_waiters_t* waiters) {
+    futex_waiter_t* waiter = waiters->head;
+    if (waiter != NULL) {
+        waiters->head = waiter->next;
+        if (waiters->head == NULL) {
+            waiters->tail = NULL;
+        }
+    }
+    return waiter;
+}
+
+/* called without the queue lock, the waiter can return and free its stack as soon as it sees READY */
+static void waiter_wake(futex_waiter_t* waiter) {
+    uint32_t* state = &waiter->state;
+    if (__atomic_exchange_n(state, FUTEX_WAITER_READY, __ATOMIC_RELEASE) == FUTEX_WAITER_SLEEPING) {
+        futex(state, FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+static void waiter_wait(futex_queue_t* queue, futex_waiter_t* waiter) {
+    unsigned int limit = __atomic_load_n(&queue->spin_limit, __ATOMIC_RELAXED);
+
+    for (unsigned int spin = 0; spin < limit; spin++) {
+        if (__atomic_load_n(&waiter->state, __ATOMIC_ACQUIRE) == FUTEX_WAITER_READY) {
+            /* the handoff came while spinning, the limit moves toward twice the spins it took */
+            int new_limit = (int)limit + ((int)(2 * spin) - (int)limit) / 8 + 1;
+            new_limit     = (new_limit < FUTEX_QUEUE_MAX_SPIN) ? new_limit : FUTEX_QUEUE_MAX_SPIN;
+            new_limit     = (new_limit > FUTEX_QUEUE_MIN_SPIN) ? new_limit : FUTEX_QUEUE_MIN_SPIN;
+            __atomic_store_n(&queue->spin_limit, new_limit, __ATOMIC_RELAXED);
+            return;
+        }
+#if defined(__x86_64__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    if (limit > FUTEX_QUEUE_MIN_SPIN) {
+        __atomic_store_n(&queue->spin_limit, limit - limit / 8, __ATOMIC_RELAXED);
+    }
+
+    uint32_t expected = FUTEX_WAITER_WAITING;
+    if (!__atomic_compare_exchange_n(&waiter->state, &expected, FUTEX_WAITER_SLEEPING, false, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    /* spurious wakeups and EINTR just wait again */
+    while (__atomic_load_n(&waiter->state, __ATOMIC_ACQUIRE) == FUTEX_WAITER_SLEEPING) {
+        futex(&waiter->state, FUTEX_WAIT_PRIVATE, FUTEX_WAITER_SLEEPING);
+    }
+}
+
+futex_queue_t* futex_queue_create(size_t size) {
+    futex_queue_t* queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        goto fail_exit;
+    }
+
+    queue->size  = size;
+    queue->items = calloc(size, sizeof(void*));
+    if (queue->items == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        goto fail_free_queue;
+    }
+
+    errno = pthread_mutex_init(&queue->mutex, NULL);
+    if (errno != 0) {
+        LOG_ERROR_ERRNO("pthread_mutex_init");
+        goto fail_free_items;
+    }
+
+    /* nobody can hand off while a waiter spins on the only CPU */
+    queue->spin_limit = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? FUTEX_QUEUE_MIN_SPIN : 0;
+
+    return queue;
+
+fail_free_items:
+    free(queue->items);
+fail_free_queue:
+    free(queue);
+fail_exit:
+    return NULL;
+}
+
+void futex_queue_destroy(futex_queue_t* queue) {
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue->items);
+    free(queue);
+}
+
+int futex_queue_push(futex_queue_t* queue, void* ptr) {
+    errno = pthread_mutex_lock(&queue->mutex);
+    if (errno != 0) {
+        LOG_ERROR_ERRNO("pthread_mutex_lock");
+        goto fail_exit;
+    }
+
+    /* a waiting consumer means the queue is empty, the item goes straight to it */
+    futex_waiter_t* consumer = waiters_take(&queue->consumers);
+    if (consumer != NULL) {
+        consumer->value = ptr;
+        pthread_mutex_unlock(&queue->mutex);
+        waiter_wake(consumer);
+        return 0;
+    }
+
+    if (queue->used < queue->size) {
+        queue->items[(queue->first + queue->used++) % queue->size] = ptr;
+        pthread_mutex_unlock(&queue->mutex);
+        return 0;
+    }
+
+    /* full, the consumer that makes room moves the item into the queue */
+    futex_waiter_t producer = {.state = FUTEX_WAITER_WAITING, .value = ptr};
+    waiters_append(&queue->producers, &producer);
+    pthread_mutex_unlock(&queue->mutex);
+
+    waiter_wait(queue, &producer);
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+void* futex_queue_pop(futex_queue_t* queue) {
+    errno = pthread_mutex_lock(&queue->mutex);
+    if (errno != 0) {
+        LOG_ERROR_ERRNO("pthread_mutex_lock");
+        goto fail_exit;
+    }
+
+    if (queue->used == 0) {
+        futex_waiter_t consumer = {.state = FUTEX_WAITER_WAITING, .value = NULL};
+        waiters_append(&queue->consumers, &consumer);
+        pthread_mutex_unlock(&queue->mutex);
+
+        waiter_wait(queue, &consumer);
+        return consumer.value;
+    }
+
+    void* value  = queue->items[queue->first];
+    queue->first = (queue->first + 1) % queue->size;
+    queue->used--;
+
+    /* a waiting producer means the queue was full, its item takes the free slot */
+    futex_waiter_t* producer = waiters_take(&queue->producers);
+    if (producer != NULL) {
+        queue->items[(queue->first + queue->used++) % queue->size] = producer->value;
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+
+    if (producer != NULL) {
+        waiter_wake(producer);
+    }
+
+    return value;
+
+fail_exit:
+    return NULL;
+}
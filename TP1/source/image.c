@@ -1,11 +1,234 @@
 /* DO NOT EDIT THIS FILE */
 
+#define _GNU_SOURCE
+
 #include <png.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "image.h"
 #include "log.h"
+#include "manifest.h"
+#include "stream.h"
+#include "trace.h"
+
+#define HUGE_PAGE_SIZE (2ul * 1024 * 1024)
+
+/*
+ * Unmapped frames are kept for reuse, faulting fresh huge pages costs more
+ * than the TLB saves. The cache holds at most MAPPING_CACHE_BYTES, about the
+ * frames in flight of a pipeline at 1080p, image_alloc_release() empties it.
+ */
+#define MAPPING_CACHE_SIZE 64
+#define MAPPING_CACHE_BYTES (256ul * 1024 * 1024)
+
+typedef struct mapping {
+    void* pixels;
+    size_t size;
+} mapping_t;
+
+static pthread_mutex_t mapping_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mapping_t mapping_cache[MAPPING_CACHE_SIZE];
+static size_t mapping_cache_count = 0;
+static size_t mapping_cache_bytes = 0;
+
+static image_alloc_t image_alloc = IMAGE_ALLOC_MALLOC;
+static bool image_alloc_prefault = false;
+
+int image_alloc_parse(const char* name, image_alloc_t* alloc) {
+    if (strcmp("malloc", name) == 0) {
+        *alloc = IMAGE_ALLOC_MALLOC;
+    } else if (strcmp("aligned", name) == 0) {
+        *alloc = IMAGE_ALLOC_ALIGNED;
+    } else if (strcmp("thp", name) == 0) {
+        *alloc = IMAGE_ALLOC_THP;
+    } else if (strcmp("hugetlb", name) == 0) {
+        *alloc = IMAGE_ALLOC_HUGETLB;
+    } else if (strcmp("memfd", name) == 0) {
+        *alloc = IMAGE_ALLOC_MEMFD;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+void image_alloc_configure(image_alloc_t alloc, bool prefault) {
+    image_alloc          = alloc;
+    image_alloc_prefault = prefault;
+}
+
+static void prefault_pixels(void* pixels, size_t size, size_t page_size) {
+    volatile unsigned char* bytes = pixels;
+
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        bytes[offset] = 0;
+    }
+}
+
+void image_alloc_release(void) {
+    pthread_mutex_lock(&mapping_cache_mutex);
+    for (size_t i = 0; i < mapping_cache_count; i++) {
+        munmap(mapping_cache[i].pixels, mapping_cache[i].size);
+    }
+    mapping_cache_count = 0;
+    mapping_cache_bytes = 0;
+    pthread_mutex_unlock(&mapping_cache_mutex);
+}
+
+static void* mapping_cache_get(size_t size) {
+    void* pixels = NULL;
+
+    pthread_mutex_lock(&mapping_cache_mutex);
+    for (size_t i = 0; i < mapping_cache_count; i++) {
+        if (mapping_cache[i].size == size) {
+            pixels           = mapping_cache[i].pixels;
+            mapping_cache[i] = mapping_cache[--mapping_cache_count];
+            mapping_cache_bytes -= size;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mapping_cache_mutex);
+
+    return pixels;
+}
+
+static void mapping_cache_put(void* pixels, size_t size) {
+    pthread_mutex_lock(&mapping_cache_mutex);
+    if (mapping_cache_count < MAPPING_CACHE_SIZE && mapping_cache_bytes + size <= MAPPING_CACHE_BYTES) {
+        mapping_cache[mapping_cache_count++] = (mapping_t){.pixels = pixels, .size = size};
+        mapping_cache_bytes += size;
+        pixels = NULL;
+    }
+    pthread_mutex_unlock(&mapping_cache_mutex);
+
+    if (pixels != NULL) {
+        munmap(pixels, size);
+    }
+}
+
+/* mmap a region aligned on a huge page, the unaligned head and tail are given back */
+static void* map_huge_pages(size_t size) {
+    size_t mapped_size = size + HUGE_PAGE_SIZE;
+
+    unsigned char* mapping = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR_ERRNO("mmap");
+        return NULL;
+    }
+
+    unsigned char* start = (unsigned char*)(((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    unsigned char* end   = start + size;
+
+    if (start > mapping) {
+        munmap(mapping, start - mapping);
+    }
+    if (end < mapping + mapped_size) {
+        munmap(end, mapping + mapped_size - end);
+    }
+
+    /* kernels without THP still get an aligned buffer, said once */
+    static bool madvise_failed = false;
+    if (madvise(start, size, MADV_HUGEPAGE) < 0 && !__atomic_exchange_n(&madvise_failed, true, __ATOMIC_RELAXED)) {
+        LOG_WARNING("madvise(MADV_HUGEPAGE): %s, the frames use normal pages", strerror(errno));
+    }
+
+    return start;
+}
+
+static int image_alloc_pixels(image_t* image) {
+    size_t size = (image->width * image->height) * sizeof(*image->pixels);
+
+    image->mapped_size = 0;
+    image->fd          = -1;
+
+    if (image_alloc == IMAGE_ALLOC_MEMFD) {
+        /* sealing lets the receiving process trust the size and content */
+        image->fd = memfd_create("frame", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (image->fd < 0) {
+            LOG_ERROR_ERRNO("memfd_create");
+            return -1;
+        }
+
+        if (ftruncate(image->fd, size) < 0) {
+            LOG_ERROR_ERRNO("ftruncate");
+            goto fail_close;
+        }
+
+        void* pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, image->fd, 0);
+        if (pixels == MAP_FAILED) {
+            LOG_ERROR_ERRNO("mmap");
+            goto fail_close;
+        }
+
+        image->pixels      = pixels;
+        image->mapped_size = size;
+        goto done;
+    }
+
+    if (image_alloc == IMAGE_ALLOC_MALLOC) {
+        image->pixels = malloc(size);
+        if (image->pixels == NULL) {
+            LOG_ERROR_ERRNO("malloc");
+            return -1;
+        }
+        goto done;
+    }
+
+    if (image_alloc == IMAGE_ALLOC_ALIGNED || size < HUGE_PAGE_SIZE) {
+        void* pixels = NULL;
+        errno        = posix_memalign(&pixels, IMAGE_ALIGNMENT, size);
+        if (errno != 0) {
+            LOG_ERROR_ERRNO("posix_memalign");
+            return -1;
+        }
+        image->pixels = pixels;
+        goto done;
+    }
+
+    size_t huge_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    image->pixels = mapping_cache_get(huge_size);
+    if (image->pixels != NULL) {
+        image->mapped_size = huge_size;
+        return 0;
+    }
+
+    if (image_alloc == IMAGE_ALLOC_HUGETLB) {
+        int flags    = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (image_alloc_prefault ? MAP_POPULATE : 0);
+        void* pixels = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (pixels != MAP_FAILED) {
+            image->pixels      = pixels;
+            image->mapped_size = huge_size;
+            return 0;
+        }
+    }
+
+    image->pixels = map_huge_pages(huge_size);
+    if (image->pixels == NULL) {
+        return -1;
+    }
+    image->mapped_size = huge_size;
+
+    if (image_alloc_prefault) {
+        prefault_pixels(image->pixels, huge_size, HUGE_PAGE_SIZE);
+    }
+    return 0;
+
+done:
+    if (image_alloc_prefault) {
+        prefault_pixels(image->pixels, size, sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+
+fail_close:
+    close(image->fd);
+    image->fd = -1;
+    return -1;
+}
 
 image_t* image_create(size_t id, size_t width, size_t height) {
     image_t* image = calloc(1, sizeof(*image));
@@ -18,9 +241,7 @@ image_t* image_create(size_t id, size_t width, size_t height) {
     image->width  = width;
     image->height = height;
 
-    image->pixels = malloc((image->width * image->height) * sizeof(*image->pixels));
-    if (image->pixels == NULL) {
-        LOG_ERROR_ERRNO("malloc");
+    if (image_alloc_pixels(image) < 0) {
         goto fail_free_image;
     }
 
@@ -58,14 +279,18 @@ image_t* image_create_from_png(char* filename) {
         goto fail_free_png_struct;
     }
 
+    /* libpng errors longjmp here, the pointers set after setjmp() must be volatile to be seen */
+    image_t* volatile image          = NULL;
+    png_bytep* volatile row_pointers = NULL;
+
     if (setjmp(png_jmpbuf(png))) {
-        goto fail_free_png_info;
+        goto fail_free_rows;
     }
 
     png_init_io(png, file);
     png_read_info(png, info);
 
-    image_t* image = image_create(0, png_get_image_width(png, info), png_get_image_height(png, info));
+    image = image_create(0, png_get_image_width(png, info), png_get_image_height(png, info));
     if (image == NULL) {
         goto fail_free_png_info;
     }
@@ -107,7 +332,7 @@ image_t* image_create_from_png(char* filename) {
 
     /* read image data */
 
-    png_bytep* row_pointers = calloc(image->height, sizeof(*row_pointers));
+    row_pointers = calloc(image->height, sizeof(*row_pointers));
     if (row_pointers == NULL) {
         goto fail_free_image;
     }
@@ -148,17 +373,21 @@ image_t* image_create_from_png(char* filename) {
     return image;
 
 fail_free_rows:
-    for (int j = 0; j < image->height; j++) {
-        if (row_pointers[j] != NULL) {
-            free(row_pointers[j]);
+    if (row_pointers != NULL) {
+        for (int j = 0; j < image->height; j++) {
+            if (row_pointers[j] != NULL) {
+                free(row_pointers[j]);
+            }
         }
+        free(row_pointers);
     }
-    free(row_pointers);
 fail_free_image:
-    image_destroy(image);
+    if (image != NULL) {
+        image_destroy(image);
+    }
 fail_free_png_info:
     png_destroy_read_struct(&png, &info, NULL);
-    goto fail_free_image;
+    goto fail_close_file;
 fail_free_png_struct:
     png_destroy_read_struct(&png, NULL, NULL);
 fail_close_file:
@@ -188,31 +417,59 @@ fail_exit:
     return NULL;
 }
 
-void image_destroy(image_t* image) {
-    if (image->pixels != NULL) {
-        free(image->pixels);
+image_t* image_map_fd(size_t id, size_t width, size_t height, int fd) {
+    size_t size = (width * height) * sizeof(pixel_t);
+
+    image_t* image = calloc(1, sizeof(*image));
+    if (image == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        goto fail_close;
+    }
+
+    void* pixels = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (pixels == MAP_FAILED) {
+        LOG_ERROR_ERRNO("mmap");
+        goto fail_free_image;
     }
+
+    image->id          = id;
+    image->width       = width;
+    image->height      = height;
+    image->pixels      = pixels;
+    image->mapped_size = size;
+    image->fd          = fd;
+
+    return image;
+
+fail_free_image:
     free(image);
+fail_close:
+    close(fd);
+    return NULL;
 }
 
-int image_save_png(image_t* image, char* filename) {
-    if (image == NULL || filename == NULL) {
-        LOG_ERROR_NULL_PTR();
-        goto fail_exit;
+void image_destroy(image_t* image) {
+    /* memfd mappings are never cached, they may be read-only or shared with another process */
+    if (image->fd >= 0) {
+        if (image->pixels != NULL) {
+            munmap(image->pixels, image->mapped_size);
+        }
+        close(image->fd);
+    } else if (image->mapped_size != 0) {
+        mapping_cache_put(image->pixels, image->mapped_size);
+    } else if (image->pixels != NULL) {
+        free(image->pixels);
     }
+    free(image);
+}
 
+static int image_write_png(image_t* image, FILE* file) {
     /* source: https://gist.github.com/niw/5963798 */
 
-    FILE* file = fopen(filename, "wb");
-    if (file == NULL) {
-        LOG_ERROR_ERRNO("fopen");
-        goto fail_exit;
-    }
-
     png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (png == NULL) {
         LOG_ERROR("couldn't create png_struct");
-        goto fail_close_file;
+        goto fail_exit;
     }
 
     png_infop info = png_create_info_struct(png);
@@ -273,7 +530,6 @@ int image_save_png(image_t* image, char* filename) {
     free(row_pointers);
 
     png_destroy_write_struct(&png, &info);
-    fclose(file);
 
     return 0;
 
@@ -286,55 +542,212 @@ fail_free_rows:
     free(row_pointers);
 fail_free_png_info:
     png_destroy_write_struct(&png, &info);
-    goto fail_close_file;
+    goto fail_exit;
 fail_free_png_struct:
     png_destroy_write_struct(&png, NULL);
+fail_exit:
+    return -1;
+}
+
+int image_save_png(image_t* image, char* filename) {
+    if (image == NULL || filename == NULL) {
+        LOG_ERROR_NULL_PTR();
+        goto fail_exit;
+    }
+
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        LOG_ERROR_ERRNO("fopen");
+        goto fail_exit;
+    }
+
+    if (image_write_png(image, file) < 0) {
+        goto fail_close_file;
+    }
+
+    fclose(file);
+    return 0;
+
 fail_close_file:
     fclose(file);
 fail_exit:
     return -1;
 }
 
-image_t* image_dir_load_next(image_dir_t* image_dir) {
-    const size_t buffer_size = 256;
-    char buffer[buffer_size];
+int image_encode_png(image_t* image, unsigned char** data, size_t* size) {
+    if (image == NULL || data == NULL || size == NULL) {
+        LOG_ERROR_NULL_PTR();
+        goto fail_exit;
+    }
 
-    if (image_dir->stop) {
-        goto stop_exit;
+    char* buffer = NULL;
+    FILE* file   = open_memstream(&buffer, size);
+    if (file == NULL) {
+        LOG_ERROR_ERRNO("open_memstream");
+        goto fail_exit;
+    }
+
+    if (image_write_png(image, file) < 0) {
+        goto fail_close_file;
+    }
+
+    if (fclose(file) != 0) {
+        LOG_ERROR_ERRNO("fclose");
+        goto fail_free_buffer;
     }
 
-    int count = snprintf(buffer, buffer_size, "%s/%04ld.png", image_dir->input_dir_name, image_dir->load_current);
+    *data = (unsigned char*)buffer;
+    return 0;
+
+fail_close_file:
+    fclose(file);
+fail_free_buffer:
+    free(buffer);
+fail_exit:
+    return -1;
+}
+
+static int image_dir_path(image_dir_t* image_dir, size_t id, char* buffer, size_t buffer_size) {
+    int count = snprintf(buffer, buffer_size, "%s/%04ld.png", image_dir->input_dir_name, id);
     if (count >= buffer_size - 1) {
         LOG_ERROR("buffer too small");
-        goto fail_exit;
+        return -1;
+    }
+
+    return 0;
+}
+
+bool image_dir_next(image_dir_t* image_dir, size_t* id) {
+    const size_t buffer_size = 256;
+    char buffer[buffer_size];
+
+    /* load_end drops when a frame fails to decode, on another thread */
+    size_t frame = image_dir->load_current;
+    if (image_dir->stop || frame >= __atomic_load_n(&image_dir->load_end, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+    if (image_dir_path(image_dir, frame, buffer, buffer_size) < 0) {
+        return false;
     }
 
     if (access(buffer, F_OK) < 0) {
-        if (image_dir->load_current == 0) {
+        if (frame == image_dir->load_first) {
             LOG_ERROR("no image found in directory `%s`", image_dir->input_dir_name);
         }
-        goto fail_exit;
+        return false;
     }
 
-    image_t* image = image_create_from_png(buffer);
-    if (image == NULL) {
-        goto fail_exit;
+    image_dir->load_current += image_dir->shard_count;
+    *id = frame;
+    return true;
+}
+
+/* with load_mutex held, returns once every id of the shard before this one went through */
+static void image_dir_wait_turn(image_dir_t* image_dir, size_t id) {
+    image_dir->load_waiters++;
+    while (image_dir->load_decoded != id) {
+        pthread_cond_wait(&image_dir->load_changed, &image_dir->load_mutex);
+    }
+    image_dir->load_waiters--;
+}
+
+/* with load_mutex held, lets the next id of the shard through */
+static void image_dir_pass_turn(image_dir_t* image_dir, size_t id) {
+    image_dir->load_decoded = id + image_dir->shard_count;
+    if (image_dir->load_waiters > 0) {
+        pthread_cond_broadcast(&image_dir->load_changed);
+    }
+}
+
+image_t* image_dir_decode(image_dir_t* image_dir, size_t id) {
+    const size_t buffer_size = 256;
+    char buffer[buffer_size];
+    image_t* image = NULL;
+
+    trace_begin("image_dir_load", id);
+
+    if (image_dir_path(image_dir, id, buffer, buffer_size) == 0) {
+        image = image_create_from_png(buffer);
+    }
+
+    if (image != NULL) {
+        image->id = id;
     }
 
-    image->id = image_dir->load_current++;
+    trace_end("image_dir_load", id, (image != NULL) ? image->width * image->height : 0);
     return image;
+}
 
-stop_exit:
-fail_exit:
+/*
+ * The decoding runs in parallel, but a frame only goes out once the frames
+ * before it went through: when one of them failed, the sequence ends there and
+ * the later frames are dropped, whatever the order the decodes finished in.
+ */
+image_t* image_dir_admit(image_dir_t* image_dir, size_t id, image_t* image) {
+    pthread_mutex_lock(&image_dir->load_mutex);
+    image_dir_wait_turn(image_dir, id);
+
+    size_t end    = __atomic_load_n(&image_dir->load_end, __ATOMIC_RELAXED);
+    bool admitted = image != NULL && id < end;
+
+    /* the sequence ends at the first frame that can't be decoded, the frames handed out after it are dropped */
+    if (image == NULL && id < end) {
+        __atomic_store_n(&image_dir->load_end, id, __ATOMIC_RELAXED);
+    }
+
+    image_dir_pass_turn(image_dir, id);
+    pthread_mutex_unlock(&image_dir->load_mutex);
+
+    if (admitted) {
+        return image;
+    }
+
+    if (image != NULL) {
+        image_destroy(image);
+    }
+
+    stream_skip(id);
     return NULL;
 }
 
+image_t* image_dir_load(image_dir_t* image_dir, size_t id) {
+    return image_dir_admit(image_dir, id, image_dir_decode(image_dir, id));
+}
+
+image_t* image_dir_load_next(image_dir_t* image_dir) {
+    size_t id;
+
+    if (!image_dir_next(image_dir, &id)) {
+        return NULL;
+    }
+
+    return image_dir_load(image_dir, id);
+}
+
 int image_dir_save(image_dir_t* image_dir, image_t* image) {
+    return image_dir_save_as(image_dir, image, image_dir->save_prefix);
+}
+
+int image_dir_save_as(image_dir_t* image_dir, image_t* image, const char* save_prefix) {
     const size_t buffer_size = 256;
     char buffer[buffer_size];
 
-    int count =
-        snprintf(buffer, buffer_size, "%s/%s-%04ld.png", image_dir->output_dir_name, image_dir->save_prefix, image->id);
+    trace_begin("image_dir_save", image->id);
+
+    manifest_add(image);
+    if (image_dir->no_save) {
+        goto saved;
+    }
+
+    if (stream_enabled) {
+        if (stream_put(image) < 0) {
+            goto fail_exit;
+        }
+        goto saved;
+    }
+
+    int count = snprintf(buffer, buffer_size, "%s/%s-%04ld.png", image_dir->output_dir_name, save_prefix, image->id);
     if (count >= buffer_size - 1) {
         LOG_ERROR("buffer too small");
         goto fail_exit;
@@ -344,16 +757,67 @@ int image_dir_save(image_dir_t* image_dir, image_t* image) {
         goto fail_exit;
     }
 
+saved:
+    __atomic_fetch_add(&image_dir->save_count, 1, __ATOMIC_RELAXED);
+    trace_end("image_dir_save", image->id, image->width * image->height);
     return 0;
 
 fail_exit:
+    trace_end("image_dir_save", image->id, 0);
     return -1;
 }
 
+void image_dir_wait_output(image_dir_t* image_dir) {
+    stream_admit(image_dir->load_current);
+}
+
+void image_dir_drop(image_dir_t* image_dir, size_t id) {
+    /* an id that was handed out but never loaded, the later ones wait for it */
+    pthread_mutex_lock(&image_dir->load_mutex);
+    if (id >= image_dir->load_decoded) {
+        image_dir_wait_turn(image_dir, id);
+        image_dir_pass_turn(image_dir, id);
+    }
+    pthread_mutex_unlock(&image_dir->load_mutex);
+
+    stream_skip(id);
+}
+
+int image_dir_close(image_dir_t* image_dir) {
+    size_t decoded = image_dir->load_decoded;
+
+    pthread_cond_destroy(&image_dir->load_changed);
+    pthread_mutex_destroy(&image_dir->load_mutex);
+
+    if (decoded != image_dir->load_current) {
+        LOG_ERROR("frame %zu was handed out but never loaded or dropped", decoded);
+        return -1;
+    }
+
+    return 0;
+}
+
 void image_dir_reset(image_dir_t* image_dir, const char* input_dir_name, const char* output_dir_name,
                      const char* save_prefix) {
     image_dir->input_dir_name  = input_dir_name;
     image_dir->output_dir_name = output_dir_name;
     image_dir->save_prefix     = save_prefix;
-    image_dir->load_current    = 0;
+    image_dir->save_count      = 0;
+    image_dir->no_save         = false;
+    image_dir_select(image_dir, 0, SIZE_MAX, 0, 1);
+}
+
+void image_dir_select(image_dir_t* image_dir, size_t start, size_t end, size_t shard_index, size_t shard_count) {
+    /* first frame of the range that belongs to the shard */
+    size_t first = start + (shard_index + shard_count - start % shard_count) % shard_count;
+
+    image_dir->load_first   = first;
+    image_dir->load_current = first;
+    image_dir->load_decoded = first;
+    image_dir->load_waiters = 0;
+    pthread_mutex_init(&image_dir->load_mutex, NULL);
+    pthread_cond_init(&image_dir->load_changed, NULL);
+    image_dir->load_end     = end;
+    image_dir->shard_index  = shard_index;
+    image_dir->shard_count  = shard_count;
 }
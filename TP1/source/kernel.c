@@ -0,0 +1,156 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kernel.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "kernels expect the bytes of pixel_t to be little-endian packed in an uint32_t"
+#endif
+
+#if defined(__x86_64__)
+#define KERNEL_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define KERNEL_CLONES
+#endif
+
+#define KERNEL_LANES 16
+
+typedef uint32_t v16u32 __attribute__((vector_size(KERNEL_LANES * sizeof(uint32_t))));
+typedef int32_t v16i32 __attribute__((vector_size(KERNEL_LANES * sizeof(int32_t))));
+typedef uint8_t v64u8 __attribute__((vector_size(KERNEL_LANES * sizeof(uint32_t))));
+
+/*
+ * filter_desaturate computes (unsigned char)(0.30 r + 0.59 g + 0.11 b) in
+ * double. With 16-bit fixed-point weights, t = 30 r + 59 g + 11 b is at most
+ * 25500, and t / 100 is a multiply by 5243 and a shift by 19, which is exact
+ * below 43699. That matches the double result except when t is a multiple
+ * of 100: the double sum can land just below the integer and be truncated
+ * one lower. For a given (r, g) only b = b0, b0 + 100 and b0 + 200 give such
+ * a t, so bit b / 100 of desaturate_round_down[r][g] tells whether double
+ * rounding takes one off.
+ */
+
+static pthread_once_t desaturate_once = PTHREAD_ONCE_INIT;
+static unsigned char desaturate_round_down[256][256];
+
+static unsigned char desaturate_reference(unsigned int r, unsigned int g, unsigned int b) {
+    double value = 0;
+    value += 0.30 * ((double)r);
+    value += 0.59 * ((double)g);
+    value += 0.11 * ((double)b);
+
+    return (unsigned char)value;
+}
+
+static void desaturate_init(void) {
+    for (unsigned int r = 0; r < 256; r++) {
+        for (unsigned int g = 0; g < 256; g++) {
+            /* 11 * 91 = 1001, so 91 is the inverse of 11 modulo 100 */
+            unsigned int b0 = ((100 - (30 * r + 59 * g) % 100) * 91) % 100;
+
+            for (unsigned int b = b0; b < 256; b += 100) {
+                unsigned int t = 30 * r + 59 * g + 11 * b;
+                if (desaturate_reference(r, g, b) != t / 100) {
+                    desaturate_round_down[r][g] |= 1 << (b / 100);
+                }
+            }
+        }
+    }
+}
+
+static inline uint32_t desaturate_pixel(uint32_t pixel) {
+    unsigned int r = pixel & 0xff;
+    unsigned int g = (pixel >> 8) & 0xff;
+    unsigned int b = (pixel >> 16) & 0xff;
+    unsigned int t = 30 * r + 59 * g + 11 * b;
+    unsigned int q = (t * 5243) >> 19;
+
+    if (t == q * 100) {
+        q -= (desaturate_round_down[r][g] >> (b / 100)) & 1;
+    }
+
+    return (q * 0x010101) | (pixel & 0xff000000);
+}
+
+KERNEL_CLONES
+void kernel_desaturate(const pixel_t* src, pixel_t* dst, size_t count) {
+    pthread_once(&desaturate_once, desaturate_init);
+
+    size_t i = 0;
+    for (; i + KERNEL_LANES <= count; i += KERNEL_LANES) {
+        v16u32 pixels;
+        memcpy(&pixels, &src[i], sizeof(pixels));
+
+        v16u32 t = 30 * (pixels & 0xff) + 59 * ((pixels >> 8) & 0xff) + 11 * ((pixels >> 16) & 0xff);
+        v16u32 q = (t * 5243) >> 19;
+
+        /* lanes where double rounding may differ, or-reduced to know if any needs a fix */
+        v16i32 exact = (t == q * 100);
+        v16i32 any   = exact | __builtin_shufflevector(exact, exact, 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+        any |= __builtin_shufflevector(any, any, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3);
+        any |= __builtin_shufflevector(any, any, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1);
+        any |= __builtin_shufflevector(any, any, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0);
+
+        if (any[0]) {
+            for (int lane = 0; lane < KERNEL_LANES; lane++) {
+                if (exact[lane]) {
+                    uint32_t pixel = pixels[lane];
+                    q[lane] -= (desaturate_round_down[pixel & 0xff][(pixel >> 8) & 0xff] >> (((pixel >> 16) & 0xff) / 100)) & 1;
+                }
+            }
+        }
+
+        v16u32 output = (q * 0x010101) | (pixels & 0xff000000);
+        memcpy(&dst[i], &output, sizeof(output));
+    }
+
+    for (; i < count; i++) {
+        uint32_t pixel;
+        memcpy(&pixel, &src[i], sizeof(pixel));
+        pixel = desaturate_pixel(pixel);
+        memcpy(&dst[i], &pixel, sizeof(pixel));
+    }
+}
+
+KERNEL_CLONES
+void kernel_add_pixel(const pixel_t* src, pixel_t* dst, size_t count, const pixel_t* add_pixel) {
+    /* bytes wrap around like the unsigned char additions, alpha is kept */
+    v64u8 add;
+    for (int lane = 0; lane < KERNEL_LANES; lane++) {
+        add[4 * lane + 0] = add_pixel->bytes[0];
+        add[4 * lane + 1] = add_pixel->bytes[1];
+        add[4 * lane + 2] = add_pixel->bytes[2];
+        add[4 * lane + 3] = 0;
+    }
+
+    size_t i = 0;
+    for (; i + KERNEL_LANES <= count; i += KERNEL_LANES) {
+        v64u8 pixels;
+        memcpy(&pixels, &src[i], sizeof(pixels));
+        pixels += add;
+        memcpy(&dst[i], &pixels, sizeof(pixels));
+    }
+
+    for (; i < count; i++) {
+        for (int k = 0; k < 3; k++) {
+            dst[i].bytes[k] = src[i].bytes[k] + add_pixel->bytes[k];
+        }
+        dst[i].bytes[3] = src[i].bytes[3];
+    }
+}
+
+KERNEL_CLONES
+void kernel_reverse(const pixel_t* src, pixel_t* dst, size_t count) {
+    size_t i = 0;
+    for (; i + KERNEL_LANES <= count; i += KERNEL_LANES) {
+        v16u32 pixels;
+        memcpy(&pixels, &src[count - i - KERNEL_LANES], sizeof(pixels));
+        pixels = __builtin_shufflevector(pixels, pixels, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        memcpy(&dst[i], &pixels, sizeof(pixels));
+    }
+
+    for (; i < count; i++) {
+        dst[i] = src[count - i - 1];
+    }
+}
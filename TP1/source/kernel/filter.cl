@@ -0,0 +1,96 @@
+/*
+ * OpenCL versions of the filters of filter.c, one work-item per output pixel.
+ * Pixels are uchar4 with the same layout as pixel_t. The results must match
+ * the C filters bit for bit, so desaturate and convolution33 compute in double
+ * with contraction into fma disabled, like the C code compiled without
+ * -ffp-contract=fast.
+ */
+
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#pragma OPENCL FP_CONTRACT OFF
+
+typedef struct matrix33 {
+    double m[9];
+} matrix33_t;
+
+/* global size: the size of the output */
+__kernel void scale_up(__global const uchar4* input, __global uchar4* output, uint width, uint factor) {
+    size_t x         = get_global_id(0);
+    size_t y         = get_global_id(1);
+    size_t new_width = get_global_size(0);
+
+    output[y * new_width + x] = input[(y / factor) * width + x / factor];
+}
+
+/* global size: the pixel count */
+__kernel void desaturate(__global const uchar4* input, __global uchar4* output) {
+    size_t i = get_global_id(0);
+    uchar4 p = input[i];
+
+    double value = 0;
+    value += 0.30 * ((double)p.x);
+    value += 0.59 * ((double)p.y);
+    value += 0.11 * ((double)p.z);
+
+    uchar v   = convert_uchar_rtz(value);
+    output[i] = (uchar4)(v, v, v, p.w);
+}
+
+/* global size: the size of the image */
+__kernel void horizontal_flip(__global const uchar4* input, __global uchar4* output) {
+    size_t x     = get_global_id(0);
+    size_t y     = get_global_id(1);
+    size_t width = get_global_size(0);
+
+    output[y * width + x] = input[y * width + (width - 1 - x)];
+}
+
+/* global size: the size of the output, the input has one more pixel on every side */
+__kernel void sobel(__global const uchar4* input, __global uchar4* output) {
+    size_t x         = get_global_id(0);
+    size_t y         = get_global_id(1);
+    size_t new_width = get_global_size(0);
+    size_t width     = new_width + 2;
+
+    __global const uchar4* top    = &input[(y + 0) * width + x];
+    __global const uchar4* middle = &input[(y + 1) * width + x];
+    __global const uchar4* bottom = &input[(y + 2) * width + x];
+
+    int4 t0 = convert_int4(top[0]);
+    int4 t1 = convert_int4(top[1]);
+    int4 t2 = convert_int4(top[2]);
+    int4 m0 = convert_int4(middle[0]);
+    int4 m2 = convert_int4(middle[2]);
+    int4 b0 = convert_int4(bottom[0]);
+    int4 b1 = convert_int4(bottom[1]);
+    int4 b2 = convert_int4(bottom[2]);
+
+    int4 value_x = (t0 - t2) + 2 * (m0 - m2) + (b0 - b2);
+    int4 value_y = (t0 + 2 * t1 + t2) - (b0 + 2 * b1 + b2);
+
+    uchar4 value = convert_uchar4_sat(abs(value_x) + abs(value_y));
+    value.w      = middle[1].w;
+
+    output[y * new_width + x] = value;
+}
+
+/* global size: the size of the output, the input has one more pixel on every side */
+__kernel void convolution33(__global const uchar4* input, __global uchar4* output, matrix33_t matrix) {
+    size_t x         = get_global_id(0);
+    size_t y         = get_global_id(1);
+    size_t new_width = get_global_size(0);
+    size_t width     = new_width + 2;
+
+    /* same summation order as the C filter */
+    double4 value = (double4)(0);
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            value += convert_double4(input[(y + j) * width + x + i]) * matrix.m[3 * j + i];
+        }
+    }
+
+    uchar4 new_value = convert_uchar4_sat_rtz(value);
+    new_value.w      = input[(y + 1) * width + x + 1].w;
+
+    output[y * new_width + x] = new_value;
+}
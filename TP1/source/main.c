@@ -1,14 +1,22 @@
 /* DO NOT EDIT THIS FILE */
 
+#include <limits.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "counters.h"
 #include "image.h"
 #include "log.h"
+#include "manifest.h"
 #include "pipeline.h"
+#include "service.h"
+#include "stream.h"
+#include "trace.h"
 
 static void show_help(FILE* f, const char* exec_name) {
     fprintf(f, "Usage: %s [OPTION]...\n", exec_name);
@@ -17,7 +25,40 @@ static void show_help(FILE* f, const char* exec_name) {
     fprintf(f, "  --directory PATH                path to read images\n");
     fprintf(f, "  --out PATH                      path to write images\n");
     fprintf(f, "  --quiet                         don't print anything\n");
-    fprintf(f, "  --pipeline [serial|pthread|tbb] pipeline algorithm to use\n");
+    fprintf(f, "  --trace FILE                    write a Chrome trace (Perfetto) of the pipeline execution\n");
+    fprintf(f, "  --counters                      print the IPC and cache/TLB misses per pixel of every stage\n");
+    fprintf(f, "                                  from the hardware performance counters\n");
+    fprintf(f, "  --alloc [malloc|aligned|thp|hugetlb|memfd]\n");
+    fprintf(f, "                                  allocation policy of the frames (default: malloc, memfd\n");
+    fprintf(f, "                                  with the process pipeline)\n");
+    fprintf(f, "  --prefault                      touch the frame pages when they are allocated\n");
+    fprintf(f, "  --range START:END               only process frames START (included) to END (excluded),\n");
+    fprintf(f, "                                  either bound can be omitted\n");
+    fprintf(f, "  --shard I/N                     only process frames whose index modulo N is I\n");
+    fprintf(f, "  --shard env                     take I and N from the rank and size set by the MPI\n");
+    fprintf(f, "                                  launcher (Open MPI, MPICH/PMI or Slurm)\n");
+    fprintf(f, "  --stats FILE                    write the frame count and duration of the run as CSV\n");
+    fprintf(f, "  --manifest FILE                 write the hash of the pixels of every output frame\n");
+    fprintf(f, "  --no-save                       don't write the output PNGs, e.g. with --manifest\n");
+    fprintf(f, "  --stream FILE                   append the output PNGs to FILE in frame order instead of\n");
+    fprintf(f, "                                  writing one file per frame (ffmpeg -f image2pipe)\n");
+    fprintf(f, "  --reorder-depth N               frames the stream holds back while waiting for an earlier\n");
+    fprintf(f, "                                  one, the loader waits beyond that (default: 64)\n");
+    fprintf(f, "  --pipeline [serial|pthread|tbb|tbb-fused|openmp|coroutine|process|opencl]\n");
+    fprintf(f, "                                  pipeline algorithm to use, tbb-fused runs the filters\n");
+    fprintf(f, "                                  of tbb as a single stage compiled from chain.hpp, process\n");
+    fprintf(f, "                                  runs every stage in its own processes\n");
+    fprintf(f, "  --stage-processes N             processes per stage of the process pipeline (default: 1)\n");
+    fprintf(f, "  --batch-size N                  run the pthread pipeline as a service on batches of N\n");
+    fprintf(f, "                                  frames, its threads stay up between the batches, and print\n");
+    fprintf(f, "                                  the latency of every batch\n");
+    fprintf(f, "  --branch PREFIX=FILTER[:VALUE][,FILTER[:VALUE]...]\n");
+    fprintf(f, "                                  instead of the default chain, run every frame through\n");
+    fprintf(f, "                                  these filters and save them as PREFIX-NNNN.png, can be\n");
+    fprintf(f, "                                  repeated to decode the frames once for several outputs\n");
+    fprintf(f, "                                  (serial, pthread and tbb pipelines)\n");
+    fprintf(f, "  --opencl-platform N             OpenCL platform index of the opencl pipeline (default: 0)\n");
+    fprintf(f, "  --opencl-device N               OpenCL device index of the opencl pipeline (default: 0)\n");
 }
 
 static void fail_missing_argument(const char* exec_name, const char* opt) {
@@ -38,6 +79,18 @@ static void fail_unknown_pipeline_algorithm(const char* exec_name, const char* a
     exit(1);
 }
 
+static void fail_unknown_alloc_policy(const char* exec_name, const char* arg) {
+    fprintf(stderr, "%s: unrecognized argument '%s' for option `--alloc`\n", exec_name, arg);
+    fprintf(stderr, "Try '%s --help' for more information.\n", exec_name);
+    exit(1);
+}
+
+static void fail_argument_parsing(const char* exec_name, const char* arg_name, const char* arg) {
+    fprintf(stderr, "%s: failed to parse '%s' for argument `%s`\n", exec_name, arg, arg_name);
+    fprintf(stderr, "Try '%s --help' for more information.\n", exec_name);
+    exit(1);
+}
+
 static void fail_multiple_pipeline(const char* exec_name) {
     fprintf(stderr, "%s: zero or one option `--pipeline` must be specified\n", exec_name);
     fprintf(stderr, "Try '%s --help' for more information.\n", exec_name);
@@ -46,6 +99,161 @@ static void fail_multiple_pipeline(const char* exec_name) {
 
 static image_dir_t image_dir = {.load_current = 0, .stop = false};
 
+static int parse_index(const char* arg, const char** end, size_t* value) {
+    char* number_end;
+
+    *value = strtoull(arg, &number_end, 10);
+    if (number_end == arg || *arg == '-') {
+        return -1;
+    }
+
+    *end = number_end;
+    return 0;
+}
+
+/* START:END, START: or :END */
+static int parse_range(const char* arg, size_t* start, size_t* end) {
+    *start = 0;
+    *end   = SIZE_MAX;
+
+    if (*arg != ':' && parse_index(arg, &arg, start) < 0) {
+        return -1;
+    }
+
+    if (*arg++ != ':') {
+        return -1;
+    }
+
+    if (*arg != '\0' && (parse_index(arg, &arg, end) < 0 || *arg != '\0')) {
+        return -1;
+    }
+
+    return (*start <= *end) ? 0 : -1;
+}
+
+static int parse_shard_env(size_t* index, size_t* count) {
+    static const char* const variables[][2] = {
+        {"OMPI_COMM_WORLD_RANK", "OMPI_COMM_WORLD_SIZE"},
+        {"PMI_RANK", "PMI_SIZE"},
+        {"SLURM_PROCID", "SLURM_NTASKS"},
+    };
+
+    for (size_t i = 0; i < sizeof(variables) / sizeof(variables[0]); i++) {
+        const char* rank = getenv(variables[i][0]);
+        const char* size = getenv(variables[i][1]);
+        const char* end;
+
+        if (rank == NULL || size == NULL) {
+            continue;
+        }
+
+        if (parse_index(rank, &end, index) < 0 || *end != '\0' || parse_index(size, &end, count) < 0 ||
+            *end != '\0') {
+            return -1;
+        }
+
+        return 0;
+    }
+
+    LOG_ERROR("no MPI rank found in the environment");
+    return -1;
+}
+
+/* I/N or env */
+static int parse_shard(const char* arg, size_t* index, size_t* count) {
+    if (strcmp(arg, "env") == 0) {
+        if (parse_shard_env(index, count) < 0) {
+            return -1;
+        }
+    } else if (parse_index(arg, &arg, index) < 0 || *arg++ != '/' || parse_index(arg, &arg, count) < 0 ||
+               *arg != '\0') {
+        return -1;
+    }
+
+    return (*count > 0 && *index < *count) ? 0 : -1;
+}
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int write_stats(const char* filename, image_dir_t* image_dir, size_t range_start, size_t range_end,
+                       double seconds) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        LOG_ERROR_ERRNO("fopen");
+        return -1;
+    }
+
+    /* an unbounded range is written with an empty END */
+    char end[32] = "";
+    if (range_end != SIZE_MAX) {
+        snprintf(end, sizeof(end), "%zu", range_end);
+    }
+
+    fprintf(file, "pipeline,shard,shards,start,end,frames,seconds,frames_per_sec\n");
+    fprintf(file, "%s,%zu,%zu,%zu,%s,%zu,%.6f,%.3f\n", image_dir->save_prefix, image_dir->shard_index,
+            image_dir->shard_count, range_start, end, image_dir->save_count, seconds,
+            (seconds > 0) ? image_dir->save_count / seconds : 0);
+
+    return (fclose(file) == 0) ? 0 : -1;
+}
+
+/* the service loads load_current to load_end, which is moved batch_size frames of the shard at a time */
+static int run_batches(image_dir_t* image_dir, size_t batch_size) {
+    size_t end                  = image_dir->load_end;
+    size_t stride               = image_dir->shard_count;
+    pipeline_service_t* service = pipeline_service_create(0);
+    int ret                     = 0;
+    if (service == NULL) {
+        return -1;
+    }
+
+    for (size_t batch = 0; !image_dir->stop; batch++) {
+        pipeline_batch_stats_t stats;
+        size_t current = image_dir->load_current;
+        if (current >= end) {
+            /* the first frame of the shard is past the range */
+            break;
+        }
+
+        size_t batch_end = end;
+        if (batch_size <= (end - current) / stride) {
+            batch_end = current + batch_size * stride;
+        }
+
+        image_dir->load_end = batch_end;
+        if (pipeline_service_submit_dir(service, image_dir) < 0) {
+            ret = -1;
+            break;
+        }
+
+        if (pipeline_service_wait(service, &stats) < 0) {
+            ret = -1;
+            break;
+        }
+
+        /* the previous batch ended on the last frame of the shard */
+        if (stats.frames + stats.dropped == 0) {
+            break;
+        }
+
+        printf("batch %zu: %zu frames in %.3f ms (first frame %.3f ms)\n", batch, stats.frames,
+               stats.latency_seconds * 1e3, stats.first_seconds * 1e3);
+
+        /* a missing frame ends the sequence, a frame that failed to decode lowered load_end */
+        if (batch_end == end || image_dir->load_current < batch_end ||
+            __atomic_load_n(&image_dir->load_end, __ATOMIC_RELAXED) < batch_end) {
+            break;
+        }
+    }
+
+    pipeline_service_destroy(service);
+    return ret;
+}
+
 static void sigint_handler(int sig) {
     printf("\n\rSIGINT received, stopping pipeline\n");
     image_dir.stop = true;
@@ -63,34 +271,85 @@ __attribute__((weak)) int pipeline_tbb(image_dir_t* image_dir) {
     return -1;
 }
 
+__attribute__((weak)) int pipeline_tbb_fused(image_dir_t* image_dir) {
+    return -1;
+}
+
+__attribute__((weak)) int pipeline_dag_tbb(image_dir_t* image_dir) {
+    return -1;
+}
+
+__attribute__((weak)) int pipeline_openmp(image_dir_t* image_dir) {
+    return -1;
+}
+
+__attribute__((weak)) int pipeline_coroutine(image_dir_t* image_dir) {
+    return -1;
+}
+
+__attribute__((weak)) unsigned int pipeline_opencl_platform = 0;
+__attribute__((weak)) unsigned int pipeline_opencl_device   = 0;
+
+__attribute__((weak)) int pipeline_opencl(image_dir_t* image_dir) {
+    LOG_ERROR("the opencl pipeline is not built, OpenCL was not found");
+    return -1;
+}
+
 int main(int argc, char* argv[]) {
     char* exec_name           = argv[0];
     bool use_pipeline_serial  = false;
     bool use_pipeline_pthread = false;
     bool use_pipeline_tbb     = false;
+    bool use_pipeline_fused   = false;
+    bool use_pipeline_openmp  = false;
+    bool use_pipeline_coro    = false;
+    bool use_pipeline_process = false;
+    bool use_pipeline_opencl  = false;
     int use_pipeline_count    = 0;
     char* input_dir_name;
     char* output_dir_name;
-    bool quiet = false;
+    char* trace_filename = NULL;
+    bool quiet           = false;
+    bool counters        = false;
+    image_alloc_t alloc  = IMAGE_ALLOC_MALLOC;
+    bool alloc_set       = false;
+    bool prefault        = false;
+    size_t range_start   = 0;
+    size_t range_end     = SIZE_MAX;
+    size_t shard_index   = 0;
+    size_t shard_count   = 1;
+    char* stats_filename = NULL;
+    char* manifest_name  = NULL;
+    bool no_save         = false;
+    char* stream_name    = NULL;
+    size_t reorder_depth = 64;
+    size_t batch_size    = 0;
 
     output_dir_name = NULL;
+    dag_init(&pipeline_dag);
 
     for (int i = 1; i < argc; i++) {
         if (strcmp("--directory", argv[i]) == 0) {
-            if (i > argc - 1) {
+            if (i + 1 >= argc) {
                 fail_missing_argument(exec_name, argv[i]);
             }
 
             input_dir_name = argv[++i];
 
         } else if (strcmp("--out", argv[i]) == 0) {
-            if (i > argc - 1) {
+            if (i + 1 >= argc) {
                 fail_missing_argument(exec_name, argv[i]);
             }
 
             output_dir_name = argv[++i];
+        } else if (strcmp("--trace", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            trace_filename = argv[++i];
         } else if (strcmp("--pipeline", argv[i]) == 0) {
-            if (i > argc - 1) {
+            if (i + 1 >= argc) {
                 fail_missing_argument(exec_name, argv[i]);
             }
 
@@ -103,13 +362,146 @@ int main(int argc, char* argv[]) {
             } else if (strcmp("tbb", argv[i + 1]) == 0) {
                 use_pipeline_tbb = true;
                 use_pipeline_count++;
+            } else if (strcmp("tbb-fused", argv[i + 1]) == 0) {
+                use_pipeline_fused = true;
+                use_pipeline_count++;
+            } else if (strcmp("openmp", argv[i + 1]) == 0) {
+                use_pipeline_openmp = true;
+                use_pipeline_count++;
+            } else if (strcmp("coroutine", argv[i + 1]) == 0) {
+                use_pipeline_coro = true;
+                use_pipeline_count++;
+            } else if (strcmp("process", argv[i + 1]) == 0) {
+                use_pipeline_process = true;
+                use_pipeline_count++;
+            } else if (strcmp("opencl", argv[i + 1]) == 0) {
+                use_pipeline_opencl = true;
+                use_pipeline_count++;
             } else {
                 fail_unknown_pipeline_algorithm(exec_name, argv[i + 1]);
             }
 
+            i++;
+        } else if (strcmp("--opencl-platform", argv[i]) == 0 || strcmp("--opencl-device", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            const char* end;
+            size_t index;
+            if (parse_index(argv[i + 1], &end, &index) < 0 || *end != '\0' || index > UINT_MAX) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+
+            if (strcmp("--opencl-platform", argv[i]) == 0) {
+                pipeline_opencl_platform = index;
+            } else {
+                pipeline_opencl_device = index;
+            }
+
+            i++;
+        } else if (strcmp("--stage-processes", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            const char* end;
+            size_t count;
+            if (parse_index(argv[i + 1], &end, &count) < 0 || *end != '\0' || count == 0 || count > UINT_MAX) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+
+            pipeline_process_workers = count;
+            i++;
+        } else if (strcmp("--batch-size", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            const char* end;
+            if (parse_index(argv[i + 1], &end, &batch_size) < 0 || *end != '\0' || batch_size == 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+
+            i++;
+        } else if (strcmp("--alloc", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            if (image_alloc_parse(argv[i + 1], &alloc) < 0) {
+                fail_unknown_alloc_policy(exec_name, argv[i + 1]);
+            }
+            alloc_set = true;
+
+            i++;
+        } else if (strcmp("--prefault", argv[i]) == 0) {
+            prefault = true;
+        } else if (strcmp("--range", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            if (parse_range(argv[i + 1], &range_start, &range_end) < 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+
+            i++;
+        } else if (strcmp("--shard", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            if (parse_shard(argv[i + 1], &shard_index, &shard_count) < 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+
+            i++;
+        } else if (strcmp("--stats", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            stats_filename = argv[++i];
+        } else if (strcmp("--manifest", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            manifest_name = argv[++i];
+        } else if (strcmp("--no-save", argv[i]) == 0) {
+            no_save = true;
+        } else if (strcmp("--stream", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            stream_name = argv[++i];
+        } else if (strcmp("--reorder-depth", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            const char* end;
+            if (parse_index(argv[i + 1], &end, &reorder_depth) < 0 || *end != '\0' || reorder_depth == 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+
             i++;
         } else if (strcmp("--quiet", argv[i]) == 0) {
             quiet = true;
+        } else if (strcmp("--counters", argv[i]) == 0) {
+            counters = true;
+        } else if (strcmp("--branch", argv[i]) == 0) {
+            if (i + 1 >= argc) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            if (dag_add_branch(&pipeline_dag, argv[i + 1]) < 0) {
+                fail_argument_parsing(exec_name, argv[i], argv[i + 1]);
+            }
+
+            i++;
         } else if (strcmp("--help", argv[i]) == 0) {
             show_help(stdout, exec_name);
             exit(0);
@@ -126,6 +518,32 @@ int main(int argc, char* argv[]) {
         use_pipeline_serial = true;
     }
 
+    /* the manifest and the stream have one frame per index, the branches save several */
+    bool use_dag = pipeline_dag.output_count > 0;
+    if (use_dag && (manifest_name != NULL || stream_name != NULL)) {
+        LOG_ERROR("--branch can't be combined with --manifest or --stream");
+        exit(1);
+    }
+
+    /* a frame lost in a crashed stage process would hold the stream back forever */
+    if (use_pipeline_process && stream_name != NULL) {
+        LOG_ERROR("--stream is not supported by the process pipeline");
+        exit(1);
+    }
+
+    /* the service runs the default chain of the pthread pipeline */
+    if (batch_size > 0 && (!use_pipeline_pthread || use_dag)) {
+        LOG_ERROR("--batch-size is only supported by the pthread pipeline without --branch");
+        exit(1);
+    }
+
+    /* frames in memfds go from one stage process to the next without a copy */
+    if (use_pipeline_process && !alloc_set) {
+        alloc = IMAGE_ALLOC_MEMFD;
+    }
+
+    image_alloc_configure(alloc, prefault);
+
     if (signal(SIGINT, sigint_handler) == SIG_ERR) {
         LOG_ERROR_ERRNO("signal");
         exit(1);
@@ -140,22 +558,110 @@ int main(int argc, char* argv[]) {
         output_dir_name = input_dir_name;
     }
 
+    if (trace_filename != NULL && trace_open(trace_filename) < 0) {
+        LOG_ERROR("failed to open trace `%s`", trace_filename);
+        exit(1);
+    }
+
+    if (counters && counters_open() < 0) {
+        LOG_ERROR("failed to open the performance counters");
+        exit(1);
+    }
+
+    if (manifest_name != NULL && manifest_open(manifest_name) < 0) {
+        LOG_ERROR("failed to open manifest `%s`", manifest_name);
+        exit(1);
+    }
+
     printf("Starting image pipeline, press CTRL+C to stop loading images\n");
 
-    int ret;
+    const char* save_prefix;
+    int (*pipeline)(image_dir_t*);
     if (use_pipeline_serial) {
-        image_dir_reset(&image_dir, input_dir_name, output_dir_name, "serial");
-        pipeline_serial(&image_dir);
+        save_prefix = "serial";
+        pipeline    = pipeline_serial;
     } else if (use_pipeline_pthread) {
-        image_dir_reset(&image_dir, input_dir_name, output_dir_name, "pthread");
-        pipeline_pthread(&image_dir);
+        save_prefix = "pthread";
+        pipeline    = pipeline_pthread;
     } else if (use_pipeline_tbb) {
-        image_dir_reset(&image_dir, input_dir_name, output_dir_name, "tbb");
-        pipeline_tbb(&image_dir);
+        save_prefix = "tbb";
+        pipeline    = pipeline_tbb;
+    } else if (use_pipeline_fused) {
+        save_prefix = "tbb";
+        pipeline    = pipeline_tbb_fused;
+    } else if (use_pipeline_openmp) {
+        save_prefix = "openmp";
+        pipeline    = pipeline_openmp;
+    } else if (use_pipeline_coro) {
+        save_prefix = "coroutine";
+        pipeline    = pipeline_coroutine;
+    } else if (use_pipeline_process) {
+        save_prefix = "process";
+        pipeline    = pipeline_process;
+    } else if (use_pipeline_opencl) {
+        save_prefix = "opencl";
+        pipeline    = pipeline_opencl;
     } else {
         LOG_ERROR("no pipeline configured");
         exit(1);
     }
 
+    if (use_dag) {
+        if (use_pipeline_serial) {
+            pipeline = pipeline_dag_serial;
+        } else if (use_pipeline_pthread) {
+            pipeline = pipeline_dag_pthread;
+        } else if (use_pipeline_tbb) {
+            pipeline = pipeline_dag_tbb;
+        } else {
+            LOG_ERROR("--branch is only supported by the serial, pthread and tbb pipelines");
+            exit(1);
+        }
+    }
+
+    image_dir_reset(&image_dir, input_dir_name, output_dir_name, save_prefix);
+    image_dir_select(&image_dir, range_start, range_end, shard_index, shard_count);
+    image_dir.no_save = no_save;
+
+    /* the stream starts at the first frame of the shard and follows its stride */
+    if (stream_name != NULL && !no_save &&
+        stream_open(stream_name, reorder_depth, image_dir.load_first, image_dir.shard_count) < 0) {
+        LOG_ERROR("failed to open stream `%s`", stream_name);
+        exit(1);
+    }
+
+    double start = now_seconds();
+    int ret      = (batch_size > 0) ? run_batches(&image_dir, batch_size) : pipeline(&image_dir);
+    if (image_dir_close(&image_dir) < 0) {
+        ret = -1;
+    }
+
+    /* the frames still held by the stream are part of the run */
+    if (stream_close() < 0) {
+        LOG_ERROR("failed to write stream `%s`", stream_name);
+        exit(1);
+    }
+
+    double end = now_seconds();
+
+    if (stats_filename != NULL && write_stats(stats_filename, &image_dir, range_start, range_end, end - start) < 0) {
+        LOG_ERROR("failed to write stats `%s`", stats_filename);
+        exit(1);
+    }
+
+    if (manifest_close() < 0) {
+        LOG_ERROR("failed to write manifest `%s`", manifest_name);
+        exit(1);
+    }
+
+    counters_print(save_prefix);
+    counters_close();
+    image_alloc_release();
+
+    if (trace_close() < 0) {
+        LOG_ERROR("failed to write trace `%s`", trace_filename);
+        exit(1);
+    }
+
     return (ret < 0) ? 1 : 0;
 }
@@ -0,0 +1,207 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "manifest.h"
+
+#define XXH_PRIME64_1 0x9e3779b185ebca87ull
+#define XXH_PRIME64_2 0xc2b2ae3d27d4eb4full
+#define XXH_PRIME64_3 0x165667b19e3779f9ull
+#define XXH_PRIME64_4 0x85ebca77c2b2ae63ull
+#define XXH_PRIME64_5 0x27d4eb2f165667c5ull
+
+typedef struct manifest_entry {
+    size_t frame;
+    size_t width;
+    size_t height;
+    uint64_t hash;
+} manifest_entry_t;
+
+bool manifest_enabled = false;
+
+static const char* manifest_filename;
+static pthread_mutex_t manifest_mutex = PTHREAD_MUTEX_INITIALIZER;
+static manifest_entry_t* manifest_entries;
+static size_t manifest_count;
+static size_t manifest_capacity;
+static bool manifest_failed;
+
+static inline uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const unsigned char* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t acc, uint64_t value) {
+    acc ^= xxh64_round(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/* XXH64 on little-endian hosts, four independent lanes run at memory speed */
+uint64_t manifest_hash(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* input = data;
+    const unsigned char* end   = input + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        for (; input + 32 <= end; input += 32) {
+            v1 = xxh64_round(v1, read64(input + 0));
+            v2 = xxh64_round(v2, read64(input + 8));
+            v3 = xxh64_round(v3, read64(input + 16));
+            v4 = xxh64_round(v4, read64(input + 24));
+        }
+
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = xxh64_merge_round(hash, v1);
+        hash = xxh64_merge_round(hash, v2);
+        hash = xxh64_merge_round(hash, v3);
+        hash = xxh64_merge_round(hash, v4);
+    } else {
+        hash = seed + XXH_PRIME64_5;
+    }
+
+    hash += size;
+
+    for (; input + 8 <= end; input += 8) {
+        hash ^= xxh64_round(0, read64(input));
+        hash = rotl64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    if (input + 4 <= end) {
+        hash ^= read32(input) * XXH_PRIME64_1;
+        hash = rotl64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        input += 4;
+    }
+
+    for (; input < end; input++) {
+        hash ^= *input * XXH_PRIME64_5;
+        hash = rotl64(hash, 11) * XXH_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+int manifest_open(const char* filename) {
+    if (filename == NULL) {
+        LOG_ERROR_NULL_PTR();
+        goto fail_exit;
+    }
+
+    manifest_filename = filename;
+    manifest_count    = 0;
+    manifest_failed   = false;
+    manifest_enabled  = true;
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+void manifest_add(const image_t* image) {
+    if (!manifest_enabled) {
+        return;
+    }
+
+    /* hashed outside of the lock, the frames are saved from several threads */
+    manifest_entry_t entry = {
+        .frame  = image->id,
+        .width  = image->width,
+        .height = image->height,
+        .hash   = manifest_hash(image->pixels, image->width * image->height * sizeof(pixel_t),
+                                ((uint64_t)image->width << 32) | image->height),
+    };
+
+    pthread_mutex_lock(&manifest_mutex);
+
+    if (manifest_count == manifest_capacity) {
+        size_t capacity           = (manifest_capacity == 0) ? 256 : 2 * manifest_capacity;
+        manifest_entry_t* entries = realloc(manifest_entries, capacity * sizeof(manifest_entry_t));
+        if (entries == NULL) {
+            LOG_ERROR_ERRNO("realloc");
+            manifest_failed = true;
+            goto unlock;
+        }
+
+        manifest_entries  = entries;
+        manifest_capacity = capacity;
+    }
+
+    manifest_entries[manifest_count++] = entry;
+
+unlock:
+    pthread_mutex_unlock(&manifest_mutex);
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const manifest_entry_t* entry_a = a;
+    const manifest_entry_t* entry_b = b;
+
+    return (entry_a->frame > entry_b->frame) - (entry_a->frame < entry_b->frame);
+}
+
+int manifest_close(void) {
+    if (!manifest_enabled) {
+        return 0;
+    }
+
+    manifest_enabled = false;
+
+    qsort(manifest_entries, manifest_count, sizeof(manifest_entry_t), compare_entries);
+
+    FILE* file = fopen(manifest_filename, "w");
+    if (file == NULL) {
+        LOG_ERROR_ERRNO("fopen");
+        goto fail_free_entries;
+    }
+
+    for (size_t i = 0; i < manifest_count; i++) {
+        manifest_entry_t* entry = &manifest_entries[i];
+        fprintf(file, "%04zu %zux%zu %016llx\n", entry->frame, entry->width, entry->height,
+                (unsigned long long)entry->hash);
+    }
+
+    if (fclose(file) != 0 || manifest_failed) {
+        goto fail_free_entries;
+    }
+
+    free(manifest_entries);
+    manifest_entries  = NULL;
+    manifest_capacity = 0;
+    return 0;
+
+fail_free_entries:
+    free(manifest_entries);
+    manifest_entries  = NULL;
+    manifest_capacity = 0;
+    return -1;
+}
@@ -0,0 +1,296 @@
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <latch>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "filter.h"
+#include "pipeline.h"
+}
+
+/*
+ * Every lane is a chain of async generators (load -> scale -> desaturate ->
+ * flip -> sobel) drained by a sink coroutine that saves frames. Handing a
+ * frame from one stage to the next is a symmetric transfer between coroutine
+ * frames on the same worker thread. Loads and saves hop to the I/O pool while
+ * they block on the filesystem, then hop back to the compute executor.
+ */
+
+class thread_pool {
+public:
+    explicit thread_pool(unsigned int count) {
+        for (unsigned int i = 0; i < count; i++) {
+            this->threads.emplace_back([this] { this->run(); });
+        }
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->cond.notify_all();
+
+        for (std::thread& thread : this->threads) {
+            thread.join();
+        }
+    }
+
+    void post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->ready.push_back(handle);
+        }
+        this->cond.notify_one();
+    }
+
+    /* co_await pool.schedule() resumes the coroutine on one of the pool threads */
+    auto schedule() {
+        struct awaiter {
+            thread_pool* pool;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle) const {
+                this->pool->post(handle);
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        return awaiter{this};
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->cond.wait(lock, [this] { return this->stopping || !this->ready.empty(); });
+                if (this->ready.empty()) {
+                    return;
+                }
+
+                handle = this->ready.front();
+                this->ready.pop_front();
+            }
+
+            handle.resume();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::coroutine_handle<>> ready;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
+
+/* lazily started generator of frames, NULL from next() marks the end of the stream */
+class frame_generator {
+public:
+    struct promise_type {
+        image_t* frame = NULL;
+        std::coroutine_handle<> consumer;
+
+        /* suspend the producer and transfer control straight back to the consumer */
+        struct transfer_to_consumer {
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) const noexcept {
+                return handle.promise().consumer;
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        frame_generator get_return_object() {
+            return frame_generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() const noexcept {
+            return {};
+        }
+
+        transfer_to_consumer final_suspend() const noexcept {
+            return {};
+        }
+
+        transfer_to_consumer yield_value(image_t* value) noexcept {
+            this->frame = value;
+            return {};
+        }
+
+        void return_void() noexcept {
+            this->frame = NULL;
+        }
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+
+    frame_generator(frame_generator&& other) noexcept : handle(other.handle) {
+        other.handle = nullptr;
+    }
+
+    frame_generator(const frame_generator&) = delete;
+
+    ~frame_generator() {
+        if (this->handle) {
+            this->handle.destroy();
+        }
+    }
+
+    /* co_await gen.next() resumes the producer until it yields a frame or finishes */
+    auto next() {
+        struct awaiter {
+            std::coroutine_handle<promise_type> producer;
+
+            bool await_ready() const noexcept {
+                return this->producer.done();
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) const noexcept {
+                this->producer.promise().consumer = consumer;
+                return this->producer;
+            }
+
+            image_t* await_resume() const noexcept {
+                return this->producer.done() ? NULL : this->producer.promise().frame;
+            }
+        };
+
+        return awaiter{this->handle};
+    }
+
+private:
+    explicit frame_generator(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/* fire and forget coroutine, its frame is freed when the body returns */
+struct lane_task {
+    struct promise_type {
+        lane_task get_return_object() const noexcept {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() const noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() const noexcept {
+            return {};
+        }
+
+        void return_void() const noexcept {}
+
+        void unhandled_exception() const {
+            std::terminate();
+        }
+    };
+};
+
+typedef struct pipeline_coroutine {
+    image_dir_t* image_dir;
+    std::mutex load_mutex;
+    thread_pool* compute;
+    thread_pool* io;
+    std::latch* lanes_done;
+} pipeline_coroutine_t;
+
+static frame_generator stage_load(pipeline_coroutine_t* pipeline) {
+    while (true) {
+        co_await pipeline->io->schedule();
+        image_t* frame;
+        {
+            std::lock_guard<std::mutex> lock(pipeline->load_mutex);
+            frame = image_dir_load_next(pipeline->image_dir);
+        }
+        co_await pipeline->compute->schedule();
+
+        if (frame == NULL) {
+            co_return;
+        }
+
+        co_yield frame;
+    }
+}
+
+static frame_generator stage_filter(frame_generator& input, image_t* (*filter)(image_t*)) {
+    while (image_t* frame = co_await input.next()) {
+        image_t* output = filter(frame);
+        image_destroy(frame);
+        if (output == NULL) {
+            printf("failed to apply filter on frame\n");
+            continue;
+        }
+
+        co_yield output;
+    }
+}
+
+static image_t* filter_scale_up_2(image_t* image) {
+    return filter_scale_up(image, 2);
+}
+
+static lane_task run_lane(pipeline_coroutine_t* pipeline) {
+    co_await pipeline->compute->schedule();
+
+    {
+        frame_generator loaded      = stage_load(pipeline);
+        frame_generator scaled      = stage_filter(loaded, filter_scale_up_2);
+        frame_generator desaturated = stage_filter(scaled, filter_desaturate);
+        frame_generator flipped     = stage_filter(desaturated, filter_horizontal_flip);
+        frame_generator edges       = stage_filter(flipped, filter_sobel);
+
+        while (image_t* frame = co_await edges.next()) {
+            co_await pipeline->io->schedule();
+            image_dir_save(pipeline->image_dir, frame);
+            image_destroy(frame);
+            co_await pipeline->compute->schedule();
+        }
+    }
+
+    pipeline->lanes_done->count_down();
+}
+
+int pipeline_coroutine(image_dir_t* image_dir) {
+    unsigned int lane_count = std::thread::hardware_concurrency();
+    if (lane_count == 0) {
+        lane_count = 1;
+    }
+
+    std::latch lanes_done(lane_count);
+    pipeline_coroutine_t pipeline;
+    pipeline.image_dir  = image_dir;
+    pipeline.lanes_done = &lanes_done;
+
+    {
+        thread_pool compute(lane_count);
+        thread_pool io(lane_count);
+        pipeline.compute = &compute;
+        pipeline.io      = &io;
+
+        for (unsigned int i = 0; i < lane_count; i++) {
+            run_lane(&pipeline);
+        }
+
+        lanes_done.wait();
+    }
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+
+#include "filter-opencl.h"
+#include "log.h"
+#include "opencl.h"
+#include "pipeline.h"
+
+unsigned int pipeline_opencl_platform = 0;
+unsigned int pipeline_opencl_device   = 0;
+
+/*
+ * Same chain as the serial pipeline with the OpenCL filters. A frame is
+ * uploaded once, goes through the filters in device buffers and is read back
+ * once. The filters are enqueued without waiting, so the device works on a
+ * frame while the host decodes the next one.
+ */
+int pipeline_opencl(image_dir_t* image_dir) {
+    filter_opencl_t opencl;
+    cl_device_id device_id;
+
+    /* input and ping-pong buffers of the filters, reused by every frame */
+    opencl_image_t input      = {0};
+    opencl_image_t buffers[2] = {{0}, {0}};
+
+    if (opencl_get_device_id(pipeline_opencl_platform, pipeline_opencl_device, &device_id) < 0) {
+        LOG_ERROR("failed to get OpenCL device %u of platform %u", pipeline_opencl_device, pipeline_opencl_platform);
+        goto fail_exit;
+    }
+
+    if (opencl_print_device_info(device_id) < 0 || filter_opencl_init(&opencl, device_id) < 0) {
+        goto fail_exit;
+    }
+
+    image_t* image = image_dir_load_next(image_dir);
+    while (image != NULL) {
+        int ret = opencl_image_upload(&opencl, image, &input);
+        image_destroy(image);
+        if (ret < 0) {
+            goto fail_cleanup;
+        }
+
+        if (filter_opencl_scale_up(&opencl, &input, &buffers[0], 2) < 0 ||
+            filter_opencl_desaturate(&opencl, &buffers[0], &buffers[1]) < 0 ||
+            filter_opencl_horizontal_flip(&opencl, &buffers[1], &buffers[0]) < 0 ||
+            filter_opencl_sobel(&opencl, &buffers[0], &buffers[1]) < 0) {
+            goto fail_cleanup;
+        }
+        clFlush(opencl.queue);
+
+        image = image_dir_load_next(image_dir);
+
+        image_t* result = opencl_image_download(&opencl, &buffers[1]);
+        if (result == NULL) {
+            if (image != NULL) {
+                image_destroy(image);
+            }
+            goto fail_cleanup;
+        }
+
+        image_dir_save(image_dir, result);
+        printf(".");
+        fflush(stdout);
+        image_destroy(result);
+    }
+
+    printf("\n");
+
+    opencl_image_release(&input);
+    opencl_image_release(&buffers[0]);
+    opencl_image_release(&buffers[1]);
+    filter_opencl_cleanup(&opencl);
+    return 0;
+
+fail_cleanup:
+    opencl_image_release(&input);
+    opencl_image_release(&buffers[0]);
+    opencl_image_release(&buffers[1]);
+    filter_opencl_cleanup(&opencl);
+fail_exit:
+    return -1;
+}
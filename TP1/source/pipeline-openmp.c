@@ -0,0 +1,110 @@
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <omp.h>
+
+#include "filter.h"
+#include "pipeline.h"
+
+/* maximum number of frames in flight, each one owns a slot until saved */
+#define PIPELINE_WINDOW 32
+
+typedef struct pipeline_openmp {
+    image_dir_t* image_dir;
+    image_t* slots[PIPELINE_WINDOW];
+    bool done;
+    char load_token;
+} pipeline_openmp_t;
+
+static void stage_load(pipeline_openmp_t* pipeline, image_t** slot) {
+    bool done;
+    __atomic_load(&pipeline->done, &done, __ATOMIC_ACQUIRE);
+    if (done) {
+        *slot = NULL;
+        return;
+    }
+
+    *slot = image_dir_load_next(pipeline->image_dir);
+    if (*slot == NULL) {
+        done = true;
+        __atomic_store(&pipeline->done, &done, __ATOMIC_RELEASE);
+    }
+}
+
+static void stage_filter(image_t** slot, image_t* (*filter)(image_t*)) {
+    if (*slot == NULL) {
+        return;
+    }
+
+    image_t* output = filter(*slot);
+    image_destroy(*slot);
+    if (output == NULL) {
+        printf("failed to apply filter on frame\n");
+    }
+
+    *slot = output;
+}
+
+static image_t* filter_scale_up_2(image_t* image) {
+    return filter_scale_up(image, 2);
+}
+
+static void stage_save(pipeline_openmp_t* pipeline, image_t** slot) {
+    if (*slot == NULL) {
+        return;
+    }
+
+    image_dir_save(pipeline->image_dir, *slot);
+    printf(".");
+    fflush(stdout);
+    image_destroy(*slot);
+    *slot = NULL;
+}
+
+int pipeline_openmp(image_dir_t* image_dir) {
+    pipeline_openmp_t pipeline = {
+        .image_dir = image_dir,
+        .done      = false,
+    };
+
+#pragma omp parallel
+#pragma omp single
+    {
+        for (size_t frame = 0;; frame++) {
+            image_t** slot = &pipeline.slots[frame % PIPELINE_WINDOW];
+
+            /* wait for the frame that used this slot PIPELINE_WINDOW frames ago */
+#pragma omp taskwait depend(inout : *slot)
+
+            bool done;
+            __atomic_load(&pipeline.done, &done, __ATOMIC_ACQUIRE);
+            if (done) {
+                break;
+            }
+
+            /* loads are chained on load_token to keep frame ids in order */
+#pragma omp task depend(inout : pipeline.load_token) depend(out : *slot) firstprivate(slot) shared(pipeline)
+            stage_load(&pipeline, slot);
+
+#pragma omp task depend(inout : *slot) firstprivate(slot)
+            stage_filter(slot, filter_scale_up_2);
+
+#pragma omp task depend(inout : *slot) firstprivate(slot)
+            stage_filter(slot, filter_desaturate);
+
+#pragma omp task depend(inout : *slot) firstprivate(slot)
+            stage_filter(slot, filter_horizontal_flip);
+
+#pragma omp task depend(inout : *slot) firstprivate(slot)
+            stage_filter(slot, filter_sobel);
+
+#pragma omp task depend(inout : *slot) firstprivate(slot) shared(pipeline)
+            stage_save(&pipeline, slot);
+        }
+
+#pragma omp taskwait
+    }
+
+    printf("\n");
+    return 0;
+}
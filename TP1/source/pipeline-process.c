@@ -0,0 +1,351 @@
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "channel.h"
+#include "filter.h"
+#include "log.h"
+#include "pipeline.h"
+
+/*
+ * Every stage of the default chain runs in its own pool of processes. Stage
+ * i reads channel i and writes channel i + 1, the parent process loads the
+ * frames into channel 0 and saves the ones coming out of the last channel.
+ * Frames are allocated in memfds and passed as file descriptors, so a frame
+ * crosses a process boundary without copying its pixels.
+ *
+ * A worker that crashes only loses the frame it was working on, the other
+ * workers of its stage go on. The loader reaps the dead workers while it
+ * waits for the window and gives their frame slot back, a worker that died
+ * idle lets one more frame in flight. When a whole stage is gone, its output
+ * channel ends and the parent stops loading.
+ */
+
+#define PROCESS_STAGE_COUNT 4
+#define PROCESS_MAX_WORKERS 64
+
+/* frames between the loader and the output, each is a memfd in flight */
+#define PROCESS_MAX_IN_FLIGHT 32
+
+/* how often the loader looks for dead workers while the window is full */
+#define PROCESS_REAP_INTERVAL_NS 100000000l
+
+static const char* process_stage_names[PROCESS_STAGE_COUNT] = {
+    "scale_up",
+    "desaturate",
+    "horizontal_flip",
+    "sobel",
+};
+
+unsigned int pipeline_process_workers = 1;
+
+typedef struct process_loader_args {
+    image_dir_t* image_dir;
+    int output;
+    sem_t* window;
+    pid_t (*workers)[PROCESS_MAX_WORKERS];
+    unsigned int worker_count;
+    size_t failures;
+    size_t loaded;
+} process_loader_args_t;
+
+static image_t* process_apply(int stage, image_t* image) {
+    switch (stage) {
+    case 0:
+        return filter_scale_up(image, 2);
+    case 1:
+        return filter_desaturate(image);
+    case 2:
+        return filter_horizontal_flip(image);
+    default:
+        return filter_sobel(image);
+    }
+}
+
+/* body of a worker process, the parent's stdio buffers were flushed so _exit() loses nothing */
+static void process_worker(int stage, int input, int output) {
+    while (1) {
+        image_t* image;
+        size_t id;
+
+        int ret = channel_recv(input, &image, &id);
+        if (ret <= 0) {
+            _exit(ret < 0 ? 1 : 0);
+        }
+
+        if (image == NULL) {
+            if (channel_send_drop(output, id) < 0) {
+                _exit(1);
+            }
+            continue;
+        }
+
+        image_t* result = process_apply(stage, image);
+        image_destroy(image);
+
+        if (result == NULL) {
+            LOG_ERROR("%s failed on frame %zu", process_stage_names[stage], id);
+            if (channel_send_drop(output, id) < 0) {
+                _exit(1);
+            }
+            continue;
+        }
+
+        if (channel_send(output, result) < 0) {
+            _exit(1);
+        }
+    }
+}
+
+/*
+ * Reaps the workers that are gone, all of them when options is 0, or only
+ * those already dead with WNOHANG. Reaped workers are cleared from the array
+ * and the ones that didn't exit cleanly are added to failures. Returns the
+ * number of workers reaped.
+ */
+static size_t process_reap_workers(pid_t workers[][PROCESS_MAX_WORKERS], unsigned int worker_count, int options,
+                                   size_t* failures) {
+    size_t reaped = 0;
+
+    for (int stage = 0; stage < PROCESS_STAGE_COUNT; stage++) {
+        for (unsigned int w = 0; w < worker_count; w++) {
+            int status;
+            if (workers[stage][w] <= 0) {
+                continue;
+            }
+
+            pid_t pid = waitpid(workers[stage][w], &status, options);
+            if (pid == 0) {
+                continue;
+            }
+
+            workers[stage][w] = 0;
+            reaped++;
+
+            if (pid < 0) {
+                LOG_ERROR_ERRNO("waitpid");
+                (*failures)++;
+            } else if (WIFSIGNALED(status)) {
+                LOG_ERROR("%s worker %u killed by signal %d (%s)", process_stage_names[stage], w, WTERMSIG(status),
+                          strsignal(WTERMSIG(status)));
+                (*failures)++;
+            } else if (WEXITSTATUS(status) != 0) {
+                LOG_ERROR("%s worker %u exited with status %d", process_stage_names[stage], w, WEXITSTATUS(status));
+                (*failures)++;
+            }
+        }
+    }
+
+    return reaped;
+}
+
+/* takes a slot of the window, a worker gone before the end of the loading held one that never comes back */
+static int process_loader_wait(process_loader_args_t* args) {
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += PROCESS_REAP_INTERVAL_NS;
+        if (deadline.tv_nsec >= 1000000000l) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000l;
+        }
+
+        if (sem_timedwait(args->window, &deadline) == 0) {
+            return 0;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        if (errno != ETIMEDOUT) {
+            LOG_ERROR_ERRNO("sem_timedwait");
+            return -1;
+        }
+
+        size_t dead = process_reap_workers(args->workers, args->worker_count, WNOHANG, &args->failures);
+        for (size_t i = 0; i < dead; i++) {
+            sem_post(args->window);
+        }
+    }
+}
+
+static void* process_loader(void* arg) {
+    process_loader_args_t* args = arg;
+
+    while (1) {
+        if (process_loader_wait(args) < 0) {
+            break;
+        }
+
+        image_t* image = image_dir_load_next(args->image_dir);
+        if (image == NULL) {
+            break;
+        }
+
+        /* every worker of the first stage is gone */
+        if (channel_send(args->output, image) < 0) {
+            break;
+        }
+        args->loaded++;
+    }
+
+    /* the first stage sees the end of its channel once its workers are the only ones left on it */
+    close(args->output);
+    return NULL;
+}
+
+static void process_close_channels(int channels[][2], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        for (int end = 0; end < 2; end++) {
+            if (channels[i][end] >= 0) {
+                close(channels[i][end]);
+                channels[i][end] = -1;
+            }
+        }
+    }
+}
+
+int pipeline_process(image_dir_t* image_dir) {
+    int channels[PROCESS_STAGE_COUNT + 1][2];
+    pid_t workers[PROCESS_STAGE_COUNT][PROCESS_MAX_WORKERS];
+    unsigned int worker_count = pipeline_process_workers;
+    sem_t window;
+    pthread_t loader;
+    size_t received = 0;
+    size_t failures = 0;
+    int ret         = 0;
+
+    if (worker_count == 0 || worker_count > PROCESS_MAX_WORKERS) {
+        LOG_ERROR("between 1 and %d processes per stage", PROCESS_MAX_WORKERS);
+        return -1;
+    }
+
+    memset(channels, -1, sizeof(channels));
+    memset(workers, 0, sizeof(workers));
+
+    for (int i = 0; i <= PROCESS_STAGE_COUNT; i++) {
+        if (channel_create(channels[i]) < 0) {
+            goto fail_close_channels;
+        }
+    }
+
+    /* buffered output would be written again by every child */
+    fflush(NULL);
+
+    for (int stage = 0; stage < PROCESS_STAGE_COUNT; stage++) {
+        for (unsigned int w = 0; w < worker_count; w++) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                LOG_ERROR_ERRNO("fork");
+                goto fail_stop_workers;
+            }
+
+            if (pid == 0) {
+                /* CTRL+C reaches the whole process group, the parent stops loading and the stages drain */
+                signal(SIGINT, SIG_IGN);
+
+                int input  = channels[stage][1];
+                int output = channels[stage + 1][0];
+                channels[stage][1]     = -1;
+                channels[stage + 1][0] = -1;
+                process_close_channels(channels, PROCESS_STAGE_COUNT + 1);
+
+                process_worker(stage, input, output);
+            }
+
+            workers[stage][w] = pid;
+        }
+    }
+
+    /* the parent keeps the input of the first stage and the output of the last one */
+    int input  = channels[0][0];
+    int output = channels[PROCESS_STAGE_COUNT][1];
+    channels[0][0]                   = -1;
+    channels[PROCESS_STAGE_COUNT][1] = -1;
+    process_close_channels(channels, PROCESS_STAGE_COUNT + 1);
+
+    if (sem_init(&window, 0, PROCESS_MAX_IN_FLIGHT) < 0) {
+        LOG_ERROR_ERRNO("sem_init");
+        close(input);
+        close(output);
+        process_reap_workers(workers, worker_count, 0, &failures);
+        return -1;
+    }
+
+    process_loader_args_t args = {
+        .image_dir    = image_dir,
+        .output       = input,
+        .window       = &window,
+        .workers      = workers,
+        .worker_count = worker_count,
+        .failures     = 0,
+        .loaded       = 0,
+    };
+    if (pthread_create(&loader, NULL, process_loader, &args) != 0) {
+        LOG_ERROR("pthread_create failed");
+        close(input);
+        close(output);
+        process_reap_workers(workers, worker_count, 0, &failures);
+        sem_destroy(&window);
+        return -1;
+    }
+
+    while (1) {
+        image_t* image;
+        size_t id;
+
+        int status = channel_recv(output, &image, &id);
+        if (status <= 0) {
+            ret = status;
+            break;
+        }
+
+        if (image == NULL) {
+            image_dir_drop(image_dir, id);
+        } else {
+            image_dir_save(image_dir, image);
+            image_destroy(image);
+        }
+
+        received++;
+        sem_post(&window);
+    }
+
+    /* when a stage is gone or the channel failed, the loader may still wait for the window */
+    __atomic_store_n(&image_dir->stop, true, __ATOMIC_RELAXED);
+    sem_post(&window);
+
+    close(output);
+    pthread_join(loader, NULL);
+    sem_destroy(&window);
+
+    /* the loader is joined, the workers it reaped are already counted */
+    process_reap_workers(workers, worker_count, 0, &args.failures);
+    if (args.failures > 0) {
+        ret = -1;
+    }
+
+    if (args.loaded != received) {
+        LOG_ERROR("%zu frames lost in crashed stages", args.loaded - received);
+        ret = -1;
+    }
+
+    return ret;
+
+fail_stop_workers:
+    process_close_channels(channels, PROCESS_STAGE_COUNT + 1);
+    process_reap_workers(workers, worker_count, 0, &failures);
+    return -1;
+
+fail_close_channels:
+    process_close_channels(channels, PROCESS_STAGE_COUNT + 1);
+    return -1;
+}
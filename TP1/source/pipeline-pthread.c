@@ -1,7 +1,13 @@
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <pthread.h>
+#include <semaphore.h>
 
+#include "dag.h"
 #include "filter.h"
+#include "futex-queue.h"
+#include "log.h"
 #include "pipeline.h"
 #include "queue.h"
 
@@ -14,8 +20,21 @@
 #endif
 
 #define NUM_PIPELINE_STEPS 4
+/* PNG DECODING THREADS BETWEEN THE INPUT THREAD AND THE FIRST STEP */
+#define NUM_DECODE_THREADS 4
 #define QUEUE_SIZE 32
 
+/* futex_queue_t wakes one thread per item, queue_t wakes every thread of the next step */
+#define USE_FUTEX_QUEUE 1
+
+#if USE_FUTEX_QUEUE
+#define queue_t futex_queue_t
+#define queue_create futex_queue_create
+#define queue_destroy futex_queue_destroy
+#define queue_push futex_queue_push
+#define queue_pop futex_queue_pop
+#endif
+
 enum OP{
 	OP_SCALE,
 	OP_DESATURATE,
@@ -24,27 +43,43 @@ enum OP{
 };
 
 struct pipeline_input_args{
-	struct queue *output;
+	queue_t *output;
 	image_dir_t *img_dir;
 	unsigned int parallel_pipelines;
 };
 
+struct pipeline_decode_args{
+	queue_t *input;
+	queue_t *output;
+	image_dir_t *img_dir;
+	unsigned int nulls; /* SHARE OF THE NULLS THE FIRST STEP WAITS FOR */
+};
+
+/* FRAME IDS GO THROUGH THE QUEUE AS id + 1, NULL STAYS THE END MARKER */
+#define ID_TO_ITEM(id) ((void *)(uintptr_t)((id) + 1))
+#define ITEM_TO_ID(item) ((size_t)(uintptr_t)(item) - 1)
+
 struct img_op_args{
-	struct queue *input;
-	struct queue *output;
+	queue_t *input;
+	queue_t *output;
+	image_dir_t *img_dir;
 	enum OP operation;
 };
 
 struct pipeline_output_args{
-	struct queue *input;
+	queue_t *input;
 	image_dir_t *img_dir;
 };
 
+/* ONLY HANDS OUT THE FRAME IDS IN ORDER, THE DECODE THREADS LOAD THEM */
 void * pipeline_input_callback(void *thread_args){
 	struct pipeline_input_args *args = (struct pipeline_input_args *)thread_args;
-	image_t *input = NULL;
-	while((input = image_dir_load_next(args->img_dir)) != NULL){
-		queue_push(args->output, input);
+	size_t id;
+	/* WITH AN OUTPUT STREAM, WAIT UNTIL THE FRAME FITS IN ITS REORDER BUFFER */
+	image_dir_wait_output(args->img_dir);
+	while(image_dir_next(args->img_dir, &id)){
+		queue_push(args->output, ID_TO_ITEM(id));
+		image_dir_wait_output(args->img_dir);
 	}
 	/* SEND AS MANY NULLS AS THERE ARE THREADS IN THE NEXT STEP */
 	for(unsigned int i = 0; i < args->parallel_pipelines; i++)
@@ -52,6 +87,21 @@ void * pipeline_input_callback(void *thread_args){
 	return NULL;
 }
 
+void * pipeline_decode_callback(void *thread_args){
+	struct pipeline_decode_args *args = (struct pipeline_decode_args *)thread_args;
+	void *item = NULL;
+	while((item = queue_pop(args->input)) != NULL){
+		/* A FRAME THAT CAN'T BE DECODED IS DROPPED BY image_dir_load */
+		image_t *input = image_dir_load(args->img_dir, ITEM_TO_ID(item));
+		if(input != NULL)
+			queue_push(args->output, input);
+	}
+	/* THE LAST DECODE THREAD'S NULLS COME AFTER EVERY FRAME, SOME THREADS OF THE NEXT STEP ARE STILL THERE FOR THEM */
+	for(unsigned int i = 0; i < args->nulls; i++)
+		queue_push(args->output, NULL);
+	return NULL;
+}
+
 void * img_op_callback(void *thread_args){
 	struct img_op_args *args = (struct img_op_args *)thread_args;
 	image_t *input = NULL;
@@ -71,10 +121,12 @@ void * img_op_callback(void *thread_args){
 			output = filter_sobel(input);
 			break;
 		}
+		size_t id = input->id;
 		image_destroy(input);
 		/* IN CASE IMAGE PROCESSING STEP FAILS */
 		if(output == NULL){
 			printf("ERROR IN IMG PROCESSING STEP: %d\n", args->operation);
+			image_dir_drop(args->img_dir, id);
 			continue;
 		} 
 		queue_push(args->output, output);
@@ -109,14 +161,24 @@ int pipeline_pthread(image_dir_t* image_dir) {
 
 	/* INIT COMPUTE THREADS */
 	for(unsigned int i = 0; i < NUM_PIPELINE_STEPS; i++){
-		args[i] = (struct img_op_args){.input = queues[i] , .output = queues[i + 1], .operation = (enum OP)(OP_SCALE + i)};
+		args[i] = (struct img_op_args){.input = queues[i] , .output = queues[i + 1], .img_dir = image_dir, .operation = (enum OP)(OP_SCALE + i)};
 		for(unsigned int j = 0; j < NUM_PARALLEL_PIPELINES; j++)
 			pthread_create(&threads[j][i], NULL, img_op_callback, &args[i]);
 	}
 
+	/* INIT DECODE THREADS, THE FIRST ONE ALSO SENDS THE REMAINDER OF THE NULLS */
+	queue_t *ids = queue_create(QUEUE_SIZE);
+	pthread_t decode_threads[NUM_DECODE_THREADS];
+	struct pipeline_decode_args decode_args[NUM_DECODE_THREADS];
+	for(unsigned int i = 0; i < NUM_DECODE_THREADS; i++){
+		unsigned int nulls = NUM_PARALLEL_PIPELINES / NUM_DECODE_THREADS + (i == 0 ? NUM_PARALLEL_PIPELINES % NUM_DECODE_THREADS : 0);
+		decode_args[i] = (struct pipeline_decode_args){.input = ids, .output = queues[0], .img_dir = image_dir, .nulls = nulls};
+		pthread_create(&decode_threads[i], NULL, pipeline_decode_callback, &decode_args[i]);
+	}
+
 	/* INIT PIPELINE INPUT THREAD */
 	pthread_t input_thread;
-	struct pipeline_input_args input_args = {.output = queues[0], .img_dir = image_dir, .parallel_pipelines = NUM_PARALLEL_PIPELINES};
+	struct pipeline_input_args input_args = {.output = ids, .img_dir = image_dir, .parallel_pipelines = NUM_DECODE_THREADS};
 	pthread_create(&input_thread, NULL, pipeline_input_callback, &input_args);
 
 	/* INIT PIPELINE OUTPUT THREAD */
@@ -129,6 +191,8 @@ int pipeline_pthread(image_dir_t* image_dir) {
 
 	/* WAIT FOR END AND CLEANUP */
 	pthread_join(input_thread, NULL);
+	for(unsigned int i = 0; i < NUM_DECODE_THREADS; i++)
+		pthread_join(decode_threads[i], NULL);
 	for(unsigned int i = 0; i < NUM_PARALLEL_PIPELINES; i++)
 		pthread_join(output_threads[i], NULL);
 	for(unsigned int i = 0; i < NUM_PIPELINE_STEPS; i++){
@@ -137,6 +201,118 @@ int pipeline_pthread(image_dir_t* image_dir) {
 	}
 	for(unsigned int i = 0; i < NUM_PIPELINE_STEPS + 1; i++)
 		queue_destroy(queues[i]);
+	queue_destroy(ids);
 
 	return 0;
 }
+
+/* DAG MODE: DECODED FRAMES IN FLIGHT AT ONCE */
+#define DAG_WINDOW 32
+
+/* A TASK IS A FRAME AND ONE OF ITS CONSUMERS, ANY WORKER TAKES ANY TASK */
+struct dag_task{
+	dag_frame_t *frame;
+	size_t consumer;
+};
+
+struct dag_worker_args{
+	queue_t *tasks;
+	image_dir_t *img_dir;
+	sem_t *window;
+};
+
+static int dag_push_tasks(queue_t *tasks, dag_frame_t *frame){
+	size_t consumers = dag_node_consumers(frame->node);
+	for(size_t i = 0; i < consumers; i++){
+		struct dag_task *task = malloc(sizeof(*task));
+		if(task == NULL){
+			LOG_ERROR_ERRNO("malloc");
+			/* THE CONSUMERS WITHOUT A TASK RELEASE THE FRAME NOW */
+			int done = 0;
+			for(; i < consumers; i++)
+				done |= dag_frame_release(frame);
+			return done;
+		}
+		*task = (struct dag_task){.frame = frame, .consumer = i};
+		queue_push(tasks, task);
+	}
+	return 0;
+}
+
+void * dag_worker_callback(void *thread_args){
+	struct dag_worker_args *args = (struct dag_worker_args *)thread_args;
+	struct dag_task *task = NULL;
+	while((task = (struct dag_task *)queue_pop(args->tasks)) != NULL){
+		dag_frame_t *frame = task->frame;
+		const dag_node_t *node = frame->node;
+		int done = 0;
+		if(task->consumer < node->child_count){
+			/* THE CHILD IS CREATED BEFORE THE PARENT IS RELEASED, THE TREE STAYS ALIVE */
+			dag_frame_t *child = dag_frame_apply(&pipeline_dag, frame, task->consumer);
+			if(child != NULL)
+				done |= dag_push_tasks(args->tasks, child);
+		} else {
+			size_t output = node->outputs[task->consumer - node->child_count];
+			image_dir_save_as(args->img_dir, frame->image, pipeline_dag.outputs[output]);
+		}
+		done |= dag_frame_release(frame);
+		free(task);
+		/* THE DECODED FRAME WENT THROUGH ALL THE BRANCHES */
+		if(done)
+			sem_post(args->window);
+	}
+	return NULL;
+}
+
+int pipeline_dag_pthread(image_dir_t* image_dir) {
+	pthread_t workers[NUM_PARALLEL_PIPELINES];
+	sem_t window;
+
+	/* EVERY CONSUMER OF EVERY NODE OF EVERY FRAME IN FLIGHT, SO PUSHING NEVER BLOCKS */
+	size_t tasks_per_frame = 0;
+	for(size_t i = 0; i < pipeline_dag.node_count; i++)
+		tasks_per_frame += dag_node_consumers(&pipeline_dag.nodes[i]);
+	queue_t *tasks = queue_create(DAG_WINDOW * tasks_per_frame + NUM_PARALLEL_PIPELINES);
+	if(tasks == NULL)
+		return -1;
+	sem_init(&window, 0, DAG_WINDOW);
+
+	struct dag_worker_args args = {.tasks = tasks, .img_dir = image_dir, .window = &window};
+	for(unsigned int i = 0; i < NUM_PARALLEL_PIPELINES; i++)
+		pthread_create(&workers[i], NULL, dag_worker_callback, &args);
+
+	/* THE MAIN THREAD DECODES, AT MOST DAG_WINDOW FRAMES AHEAD OF THE LAST FINISHED ONE */
+	int ret = 0;
+	while(1){
+		sem_wait(&window);
+		image_t *input = image_dir_load_next(image_dir);
+		if(input == NULL){
+			sem_post(&window);
+			break;
+		}
+		dag_frame_t *frame = dag_frame_create(&pipeline_dag.nodes[0], input, NULL);
+		if(frame == NULL){
+			image_destroy(input);
+			ret = -1;
+			sem_post(&window);
+			break;
+		}
+		if(dag_push_tasks(tasks, frame))
+			sem_post(&window);
+		printf(".");
+		fflush(stdout);
+	}
+	printf("\n");
+
+	/* WAIT FOR EVERY FRAME, THEN STOP THE WORKERS */
+	for(unsigned int i = 0; i < DAG_WINDOW; i++)
+		sem_wait(&window);
+	for(unsigned int i = 0; i < NUM_PARALLEL_PIPELINES; i++)
+		queue_push(tasks, NULL);
+	for(unsigned int i = 0; i < NUM_PARALLEL_PIPELINES; i++)
+		pthread_join(workers[i], NULL);
+
+	sem_destroy(&window);
+	queue_destroy(tasks);
+	return ret;
+}
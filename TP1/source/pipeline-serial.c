@@ -48,3 +48,56 @@ int pipeline_serial(image_dir_t* image_dir) {
 fail_exit:
     return -1;
 }
+
+/* saves the outputs of the node then goes down its children, depth first */
+static int pipeline_dag_serial_node(image_dir_t* image_dir, const dag_node_t* node, image_t* image) {
+    for (size_t i = 0; i < node->output_count; i++) {
+        if (image_dir_save_as(image_dir, image, pipeline_dag.outputs[node->outputs[i]]) < 0) {
+            goto fail_exit;
+        }
+    }
+
+    for (size_t i = 0; i < node->child_count; i++) {
+        const dag_node_t* child = &pipeline_dag.nodes[node->children[i]];
+
+        image_t* output = child->filter->apply(image, child->value);
+        if (output == NULL) {
+            goto fail_exit;
+        }
+
+        int ret = pipeline_dag_serial_node(image_dir, child, output);
+        image_destroy(output);
+        if (ret < 0) {
+            goto fail_exit;
+        }
+    }
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+int pipeline_dag_serial(image_dir_t* image_dir) {
+    while (1) {
+        image_t* image = image_dir_load_next(image_dir);
+        if (image == NULL) {
+            break;
+        }
+
+        int ret = pipeline_dag_serial_node(image_dir, &pipeline_dag.nodes[0], image);
+        image_destroy(image);
+        if (ret < 0) {
+            goto fail_exit;
+        }
+
+        printf(".");
+        fflush(stdout);
+    }
+
+    printf("\n");
+    return 0;
+
+fail_exit:
+    return -1;
+}
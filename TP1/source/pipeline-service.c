@@ -0,0 +1,411 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "filter.h"
+#include "futex-queue.h"
+#include "log.h"
+#include "service.h"
+
+#define SERVICE_STEP_COUNT 4
+#define SERVICE_DECODE_THREADS 4
+#define SERVICE_QUEUE_SIZE 32
+
+/* frame ids go through the decode queue as id + 1, NULL stops a thread */
+#define SERVICE_ID_TO_ITEM(id) ((void*)(uintptr_t)((id) + 1))
+#define SERVICE_ITEM_TO_ID(item) ((size_t)(uintptr_t)(item)-1)
+
+typedef struct service_batch {
+    image_dir_t* image_dir; /* directory batch, NULL for a frame batch */
+    image_t** frames;
+    image_t** outputs;
+    size_t* ids;      /* ids of the frames, they carry their index through the chain */
+    size_t count;
+    size_t submitted; /* frames pushed into the chain so far */
+    bool loaded;      /* no more frames will be pushed */
+    size_t done;
+    size_t dropped;
+    double submit_time;
+    double first_time;
+    double end_time;
+} service_batch_t;
+
+typedef struct service_worker {
+    pipeline_service_t* service;
+    unsigned int step;  /* filter of the step, SERVICE_STEP_COUNT for the output */
+    unsigned int nulls; /* decode threads: share of the stop markers of the first step */
+} service_worker_t;
+
+struct pipeline_service {
+    unsigned int threads_per_step;
+    futex_queue_t* ids;
+    futex_queue_t* queues[SERVICE_STEP_COUNT + 1];
+
+    pthread_t loader;
+    pthread_t decoders[SERVICE_DECODE_THREADS];
+    pthread_t* workers; /* threads_per_step for every step and the output */
+    service_worker_t decoder_args[SERVICE_DECODE_THREADS];
+    service_worker_t* worker_args;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    bool running; /* a batch was submitted and is not complete */
+    bool started; /* the loader took the running batch */
+    bool shutdown;
+    service_batch_t batch;
+};
+
+static double service_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* with the mutex held */
+static void service_check_complete(pipeline_service_t* service) {
+    service_batch_t* batch = &service->batch;
+
+    if (batch->loaded && batch->done == batch->submitted) {
+        batch->end_time  = service_now();
+        service->running = false;
+        pthread_cond_broadcast(&service->changed);
+    }
+}
+
+static void service_finish_frame(pipeline_service_t* service, bool dropped) {
+    pthread_mutex_lock(&service->mutex);
+
+    service_batch_t* batch = &service->batch;
+    if (!dropped && batch->done == batch->dropped) {
+        batch->first_time = service_now();
+    }
+    batch->done++;
+    batch->dropped += dropped;
+    service_check_complete(service);
+
+    pthread_mutex_unlock(&service->mutex);
+}
+
+/* the counter goes up before the frame can come out, so done never passes submitted */
+static void service_count_submitted(pipeline_service_t* service) {
+    pthread_mutex_lock(&service->mutex);
+    service->batch.submitted++;
+    pthread_mutex_unlock(&service->mutex);
+}
+
+static void service_drop(pipeline_service_t* service, size_t id) {
+    if (service->batch.image_dir != NULL) {
+        image_dir_drop(service->batch.image_dir, id);
+    }
+    service_finish_frame(service, true);
+}
+
+static void* service_loader(void* arg) {
+    pipeline_service_t* service = arg;
+
+    while (1) {
+        pthread_mutex_lock(&service->mutex);
+        while (!service->shutdown && !(service->running && !service->started)) {
+            pthread_cond_wait(&service->changed, &service->mutex);
+        }
+
+        if (service->shutdown) {
+            pthread_mutex_unlock(&service->mutex);
+            break;
+        }
+
+        service->started       = true;
+        service_batch_t* batch = &service->batch;
+        pthread_mutex_unlock(&service->mutex);
+
+        if (batch->image_dir != NULL) {
+            size_t id;
+
+            /* with an output stream, wait until the frame fits in its reorder buffer */
+            image_dir_wait_output(batch->image_dir);
+            while (image_dir_next(batch->image_dir, &id)) {
+                service_count_submitted(service);
+                futex_queue_push(service->ids, SERVICE_ID_TO_ITEM(id));
+                image_dir_wait_output(batch->image_dir);
+            }
+        } else {
+            for (size_t i = 0; i < batch->count; i++) {
+                batch->frames[i]->id = i;
+                service_count_submitted(service);
+                futex_queue_push(service->queues[0], batch->frames[i]);
+            }
+        }
+
+        pthread_mutex_lock(&service->mutex);
+        batch->loaded = true;
+        service_check_complete(service);
+        pthread_mutex_unlock(&service->mutex);
+    }
+
+    for (unsigned int i = 0; i < SERVICE_DECODE_THREADS; i++) {
+        futex_queue_push(service->ids, NULL);
+    }
+    return NULL;
+}
+
+static void* service_decoder(void* arg) {
+    service_worker_t* worker    = arg;
+    pipeline_service_t* service = worker->service;
+    void* item;
+
+    while ((item = futex_queue_pop(service->ids)) != NULL) {
+        size_t id = SERVICE_ITEM_TO_ID(item);
+
+        /* a frame that can't be decoded was dropped from the stream by image_dir_load() */
+        image_t* image = image_dir_load(service->batch.image_dir, id);
+        if (image == NULL) {
+            service_finish_frame(service, true);
+            continue;
+        }
+        futex_queue_push(service->queues[0], image);
+    }
+
+    /* the last decoder's markers come after every frame, some threads of the first step are still there for them */
+    for (unsigned int i = 0; i < worker->nulls; i++) {
+        futex_queue_push(service->queues[0], NULL);
+    }
+    return NULL;
+}
+
+static image_t* service_apply(unsigned int step, image_t* image) {
+    switch (step) {
+    case 0:
+        return filter_scale_up(image, 2);
+    case 1:
+        return filter_desaturate(image);
+    case 2:
+        return filter_horizontal_flip(image);
+    default:
+        return filter_sobel(image);
+    }
+}
+
+static void* service_worker(void* arg) {
+    service_worker_t* worker    = arg;
+    pipeline_service_t* service = worker->service;
+    futex_queue_t* input        = service->queues[worker->step];
+    image_t* image;
+
+    while ((image = futex_queue_pop(input)) != NULL) {
+        size_t id       = image->id;
+        image_t* output = service_apply(worker->step, image);
+        image_destroy(image);
+
+        if (output == NULL) {
+            service_drop(service, id);
+            continue;
+        }
+        futex_queue_push(service->queues[worker->step + 1], output);
+    }
+
+    futex_queue_push(service->queues[worker->step + 1], NULL);
+    return NULL;
+}
+
+static void* service_output(void* arg) {
+    service_worker_t* worker    = arg;
+    pipeline_service_t* service = worker->service;
+    image_t* image;
+
+    while ((image = futex_queue_pop(service->queues[SERVICE_STEP_COUNT])) != NULL) {
+        service_batch_t* batch = &service->batch;
+
+        if (batch->image_dir != NULL) {
+            image_dir_save(batch->image_dir, image);
+            image_destroy(image);
+        } else {
+            size_t index          = image->id;
+            image->id             = batch->ids[index];
+            batch->outputs[index] = image;
+        }
+
+        service_finish_frame(service, false);
+    }
+
+    return NULL;
+}
+
+pipeline_service_t* pipeline_service_create(unsigned int threads_per_step) {
+    if (threads_per_step == 0) {
+        long cpus        = sysconf(_SC_NPROCESSORS_ONLN);
+        threads_per_step = (cpus > 0) ? cpus : 1;
+    }
+
+    pipeline_service_t* service = calloc(1, sizeof(*service));
+    if (service == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        goto fail_exit;
+    }
+
+    service->threads_per_step = threads_per_step;
+    pthread_mutex_init(&service->mutex, NULL);
+    pthread_cond_init(&service->changed, NULL);
+
+    size_t thread_count  = (SERVICE_STEP_COUNT + 1) * threads_per_step;
+    service->workers     = calloc(thread_count, sizeof(*service->workers));
+    service->worker_args = calloc(thread_count, sizeof(*service->worker_args));
+    service->ids         = futex_queue_create(SERVICE_QUEUE_SIZE);
+    if (service->workers == NULL || service->worker_args == NULL || service->ids == NULL) {
+        LOG_ERROR("failed to allocate the service");
+        goto fail_free_service;
+    }
+
+    for (int i = 0; i <= SERVICE_STEP_COUNT; i++) {
+        service->queues[i] = futex_queue_create(SERVICE_QUEUE_SIZE);
+        if (service->queues[i] == NULL) {
+            LOG_ERROR("failed to allocate the service");
+            goto fail_free_service;
+        }
+    }
+
+    /* the threads are never stopped halfway, a failed creation is fatal like in the pthread pipeline */
+    for (unsigned int step = 0; step <= SERVICE_STEP_COUNT; step++) {
+        for (unsigned int i = 0; i < threads_per_step; i++) {
+            size_t index                = step * threads_per_step + i;
+            service->worker_args[index] = (service_worker_t){.service = service, .step = step};
+            void* (*routine)(void*)     = (step < SERVICE_STEP_COUNT) ? service_worker : service_output;
+            if (pthread_create(&service->workers[index], NULL, routine, &service->worker_args[index]) != 0) {
+                LOG_ERROR("pthread_create failed");
+                exit(1);
+            }
+        }
+    }
+
+    /* the first decoder also sends the remainder of the markers */
+    for (unsigned int i = 0; i < SERVICE_DECODE_THREADS; i++) {
+        unsigned int nulls = threads_per_step / SERVICE_DECODE_THREADS;
+        if (i == 0) {
+            nulls += threads_per_step % SERVICE_DECODE_THREADS;
+        }
+
+        service->decoder_args[i] = (service_worker_t){.service = service, .nulls = nulls};
+        if (pthread_create(&service->decoders[i], NULL, service_decoder, &service->decoder_args[i]) != 0) {
+            LOG_ERROR("pthread_create failed");
+            exit(1);
+        }
+    }
+
+    if (pthread_create(&service->loader, NULL, service_loader, service) != 0) {
+        LOG_ERROR("pthread_create failed");
+        exit(1);
+    }
+
+    return service;
+
+fail_free_service:
+    for (int i = 0; i <= SERVICE_STEP_COUNT; i++) {
+        if (service->queues[i] != NULL) {
+            futex_queue_destroy(service->queues[i]);
+        }
+    }
+    if (service->ids != NULL) {
+        futex_queue_destroy(service->ids);
+    }
+    free(service->worker_args);
+    free(service->workers);
+    free(service);
+fail_exit:
+    return NULL;
+}
+
+void pipeline_service_destroy(pipeline_service_t* service) {
+    pipeline_service_wait(service, NULL);
+
+    pthread_mutex_lock(&service->mutex);
+    service->shutdown = true;
+    pthread_cond_broadcast(&service->changed);
+    pthread_mutex_unlock(&service->mutex);
+
+    /* the stop markers go down the chain like at the end of the pthread pipeline */
+    pthread_join(service->loader, NULL);
+    for (unsigned int i = 0; i < SERVICE_DECODE_THREADS; i++) {
+        pthread_join(service->decoders[i], NULL);
+    }
+    for (size_t i = 0; i < (SERVICE_STEP_COUNT + 1) * service->threads_per_step; i++) {
+        pthread_join(service->workers[i], NULL);
+    }
+
+    for (int i = 0; i <= SERVICE_STEP_COUNT; i++) {
+        futex_queue_destroy(service->queues[i]);
+    }
+    futex_queue_destroy(service->ids);
+    pthread_cond_destroy(&service->changed);
+    pthread_mutex_destroy(&service->mutex);
+    free(service->worker_args);
+    free(service->workers);
+    free(service->batch.ids);
+    free(service);
+}
+
+static int service_submit(pipeline_service_t* service, const service_batch_t* batch) {
+    pthread_mutex_lock(&service->mutex);
+    if (service->running) {
+        pthread_mutex_unlock(&service->mutex);
+        LOG_ERROR("a batch is already running");
+        return -1;
+    }
+
+    free(service->batch.ids);
+    service->batch             = *batch;
+    service->batch.submit_time = service_now();
+    service->running           = true;
+    service->started           = false;
+    pthread_cond_broadcast(&service->changed);
+    pthread_mutex_unlock(&service->mutex);
+
+    return 0;
+}
+
+int pipeline_service_submit_dir(pipeline_service_t* service, image_dir_t* image_dir) {
+    service_batch_t batch = {.image_dir = image_dir};
+    return service_submit(service, &batch);
+}
+
+int pipeline_service_submit_frames(pipeline_service_t* service, image_t** frames, size_t count, image_t** outputs) {
+    service_batch_t batch = {.frames = frames, .outputs = outputs, .count = count};
+
+    batch.ids = malloc(count * sizeof(*batch.ids));
+    if (batch.ids == NULL && count > 0) {
+        LOG_ERROR_ERRNO("malloc");
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        batch.ids[i] = frames[i]->id;
+        outputs[i]   = NULL;
+    }
+
+    if (service_submit(service, &batch) < 0) {
+        free(batch.ids);
+        return -1;
+    }
+
+    return 0;
+}
+
+int pipeline_service_wait(pipeline_service_t* service, pipeline_batch_stats_t* stats) {
+    pthread_mutex_lock(&service->mutex);
+    while (service->running) {
+        pthread_cond_wait(&service->changed, &service->mutex);
+    }
+
+    if (stats != NULL) {
+        service_batch_t* batch = &service->batch;
+
+        stats->frames          = batch->done - batch->dropped;
+        stats->dropped         = batch->dropped;
+        stats->first_seconds   = (batch->done > batch->dropped) ? batch->first_time - batch->submit_time : 0;
+        stats->latency_seconds = batch->end_time - batch->submit_time;
+    }
+    pthread_mutex_unlock(&service->mutex);
+
+    return 0;
+}
@@ -1,7 +1,12 @@
 #include <iostream>
 #include <thread>
 
+/* LAB MACHINES SHIP THE LEGACY TBB HEADERS, ONETBB DROPPED tbb/pipeline.h */
+#if __has_include(<tbb/pipeline.h>)
 #define SERVER_RUN 1
+#else
+#define SERVER_RUN 0
+#endif
 
 #if SERVER_RUN
 /* FOR RUNNING ON LAB MACHINE WHERE TBB LIB VERSION IS OLDER */
@@ -10,15 +15,25 @@
 #define FILTER_SERIAL tbb::filter::serial_in_order
 #define FLOW_TYPE tbb::flow_control
 #define MAX_THREAD_COUNT 96
+#define LIMITER_DECREMENT(limiter) ((limiter).decrement)
 #else
 #include <tbb/tbb.h>
 #define FILTER_PARALLEL filter_mode::parallel
 #define FILTER_SERIAL filter_mode::serial_in_order
 #define FLOW_TYPE detail::d1::flow_control
 #define MAX_THREAD_COUNT 8
+#define LIMITER_DECREMENT(limiter) ((limiter).decrementer())
 #endif
+#include <tbb/flow_graph.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "chain.hpp"
 
 extern "C" {
+#include "dag.h"
 #include "filter.h"
 #include "pipeline.h"
 }
@@ -31,19 +46,57 @@ enum OP{
 	OP_DESATURATE,
 	OP_HOR_FLIP,
 	OP_EDGE_DETECT,
+	OP_FUSED,
 };
 
+/* THE FOUR STAGES OF THE PIPELINE IN ONE PASS, SEE chain.hpp */
+typedef fused::chain<fused::scale<2>, fused::desaturate, fused::hflip, fused::sobel> DefaultChain;
+
+/* ONLY HANDS OUT THE FRAME IDS IN ORDER, THE DECODING IS LEFT TO THE PARALLEL PipelineDecode */
 class PipelineInput{
 public:
     PipelineInput(image_dir_t* image_dir){
         this->image_dir = image_dir;
     }
 
-    image_t * operator()(FLOW_TYPE &flow) const {
-        image_t *img = image_dir_load_next(this->image_dir);
-        if(img) return img;
-        flow.stop();
-        return NULL;
+    size_t operator()(FLOW_TYPE &flow) const {
+        size_t id = 0;
+        /* WITH AN OUTPUT STREAM, WAIT UNTIL THE FRAME FITS IN ITS REORDER BUFFER */
+        image_dir_wait_output(this->image_dir);
+        if(!image_dir_next(this->image_dir, &id)) flow.stop();
+        return id;
+    }
+
+private:
+    image_dir_t* image_dir;
+};
+
+/* A FRAME THAT FAILED TO DECODE GOES ON AS NULL WITH ITS ID */
+typedef std::pair<size_t, image_t *> Decoded;
+
+class PipelineDecode{
+public:
+    PipelineDecode(image_dir_t* image_dir){
+        this->image_dir = image_dir;
+    }
+
+    Decoded operator()(size_t id) const {
+        return Decoded(id, image_dir_decode(this->image_dir, id));
+    }
+
+private:
+    image_dir_t* image_dir;
+};
+
+/* IN ORDER, SO image_dir_admit NEVER WAITS: A FRAME AFTER ONE THAT FAILED IS DROPPED AND GOES DOWN AS NULL */
+class PipelineAdmit{
+public:
+    PipelineAdmit(image_dir_t* image_dir){
+        this->image_dir = image_dir;
+    }
+
+    image_t * operator()(Decoded decoded) const {
+        return image_dir_admit(this->image_dir, decoded.first, decoded.second);
     }
 
 private:
@@ -52,10 +105,11 @@ private:
 
 class PipelineCompute{
 public:
-    PipelineCompute(enum OP operation): operation(operation) {}
+    PipelineCompute(enum OP operation, image_dir_t* image_dir): operation(operation), image_dir(image_dir) {}
 
     image_t * operator()(image_t *input) const {
         image_t *output = NULL;
+        if(!input) return NULL;
         switch (this->operation){
 		case OP_SCALE:
 			output = filter_scale_up(input, 2);
@@ -68,14 +122,20 @@ public:
             break;
 		case OP_EDGE_DETECT:
 			output = filter_sobel(input);
+            break;
+		case OP_FUSED:
+			output = DefaultChain::apply(input);
             break;
 		}
+        /* A FRAME LOST HERE MUST NOT HOLD BACK THE OUTPUT STREAM */
+        if(!output) image_dir_drop(this->image_dir, input->id);
         image_destroy(input);
         return output;
     }
 
 private:
     const enum OP operation; 
+    image_dir_t* image_dir;
 };
 
 class PipelineOutput{
@@ -98,12 +158,144 @@ private:
 int pipeline_tbb(image_dir_t* image_dir) {
     parallel_pipeline(
         MAX_THREAD_COUNT,
-        make_filter<void, image_t *>(FILTER_SERIAL, PipelineInput(image_dir))      &
-        make_filter<image_t *, image_t *>(FILTER_PARALLEL, PipelineCompute(OP_SCALE))       &
-        make_filter<image_t *, image_t *>(FILTER_PARALLEL, PipelineCompute(OP_DESATURATE))  &
-        make_filter<image_t *, image_t *>(FILTER_PARALLEL, PipelineCompute(OP_HOR_FLIP))    &
-        make_filter<image_t *, image_t *>(FILTER_PARALLEL, PipelineCompute(OP_EDGE_DETECT)) &
-        make_filter<image_t *, void>(FILTER_PARALLEL, PipelineOutput(image_dir))            
+        make_filter<void, size_t>(FILTER_SERIAL, PipelineInput(image_dir))                             &
+        make_filter<size_t, Decoded>(FILTER_PARALLEL, PipelineDecode(image_dir))                       &
+        make_filter<Decoded, image_t *>(FILTER_SERIAL, PipelineAdmit(image_dir))                       &
+        make_filter<image_t *, image_t *>(FILTER_PARALLEL, PipelineCompute(OP_SCALE, image_dir))       &
+        make_filter<image_t *, image_t *>(FILTER_PARALLEL, PipelineCompute(OP_DESATURATE, image_dir))  &
+        make_filter<image_t *, image_t *>(FILTER_PARALLEL, PipelineCompute(OP_HOR_FLIP, image_dir))    &
+        make_filter<image_t *, image_t *>(FILTER_PARALLEL, PipelineCompute(OP_EDGE_DETECT, image_dir)) &
+        make_filter<image_t *, void>(FILTER_PARALLEL, PipelineOutput(image_dir))                       
     );
     return 0;
 }
+
+/* SAME OUTPUT AS pipeline_tbb, THE INTERMEDIATE FRAMES ARE NEVER ALLOCATED */
+int pipeline_tbb_fused(image_dir_t* image_dir) {
+    parallel_pipeline(
+        MAX_THREAD_COUNT,
+        make_filter<void, size_t>(FILTER_SERIAL, PipelineInput(image_dir))                         &
+        make_filter<size_t, Decoded>(FILTER_PARALLEL, PipelineDecode(image_dir))                   &
+        make_filter<Decoded, image_t *>(FILTER_SERIAL, PipelineAdmit(image_dir))                   &
+        make_filter<image_t *, image_t *>(FILTER_PARALLEL, PipelineCompute(OP_FUSED, image_dir))   &
+        make_filter<image_t *, void>(FILTER_PARALLEL, PipelineOutput(image_dir))
+    );
+    return 0;
+}
+
+image_t* pipeline_chain_fused(image_t* image) {
+    return DefaultChain::apply(image);
+}
+
+/* DAG MODE: ONE FUNCTION NODE PER FILTER OF THE TREE, ONE PER BRANCH OUTPUT */
+typedef flow::limiter_node<dag_frame_t *> DagLimiter;
+typedef flow::function_node<dag_frame_t *, dag_frame_t *> DagFilterNode;
+typedef flow::function_node<dag_frame_t *> DagOutputNode;
+
+class DagInput{
+public:
+    DagInput(image_dir_t* image_dir): image_dir(image_dir) {}
+
+#if SERVER_RUN
+    bool operator()(dag_frame_t *&frame) const {
+        frame = this->load();
+        return frame != NULL;
+    }
+#else
+    dag_frame_t * operator()(FLOW_TYPE &flow) const {
+        dag_frame_t *frame = this->load();
+        if(!frame) flow.stop();
+        return frame;
+    }
+#endif
+
+private:
+    dag_frame_t * load() const {
+        image_t *img = image_dir_load_next(this->image_dir);
+        if(!img) return NULL;
+        dag_frame_t *frame = dag_frame_create(&pipeline_dag.nodes[0], img, NULL);
+        if(!frame) image_destroy(img);
+        return frame;
+    }
+
+    image_dir_t* image_dir;
+};
+
+/* THE LAST RELEASE OF A DECODED FRAME LETS THE NEXT ONE THROUGH THE LIMITER */
+static void dag_release(DagLimiter *limiter, dag_frame_t *frame){
+    if(dag_frame_release(frame)) LIMITER_DECREMENT(*limiter).try_put(flow::continue_msg());
+}
+
+class DagFilter{
+public:
+    DagFilter(size_t child, DagLimiter *limiter): child(child), limiter(limiter) {}
+
+    /* THE FRAMES OF THE PARENT NODE, A FAILED FILTER SENDS NULL DOWN ITS SUBTREE */
+    dag_frame_t * operator()(dag_frame_t *input) const {
+        if(!input) return NULL;
+        dag_frame_t *output = dag_frame_apply(&pipeline_dag, input, this->child);
+        dag_release(this->limiter, input);
+        return output;
+    }
+
+private:
+    const size_t child; /* INDEX AMONG THE CHILDREN OF THE PARENT NODE */
+    DagLimiter *limiter;
+};
+
+class DagOutput{
+public:
+    DagOutput(image_dir_t* image_dir, size_t output, DagLimiter *limiter)
+        : image_dir(image_dir), output(output), limiter(limiter) {}
+
+    flow::continue_msg operator()(dag_frame_t *input) const {
+        if(!input) return flow::continue_msg();
+        image_dir_save_as(this->image_dir, input->image, pipeline_dag.outputs[this->output]);
+        dag_release(this->limiter, input);
+        return flow::continue_msg();
+    }
+
+private:
+    image_dir_t* image_dir;
+    const size_t output;
+    DagLimiter *limiter;
+};
+
+/* NODES OF THE CHILDREN AND OUTPUTS OF node RECEIVE THE FRAMES SENT BY sender */
+template<typename Sender>
+static void dag_connect(flow::graph &graph, image_dir_t* image_dir, DagLimiter *limiter, Sender &sender,
+                        const dag_node_t *node, std::vector<std::unique_ptr<DagFilterNode>> &filters,
+                        std::vector<std::unique_ptr<DagOutputNode>> &outputs){
+    for(size_t i = 0; i < node->child_count; i++){
+        filters.push_back(std::make_unique<DagFilterNode>(graph, flow::unlimited, DagFilter(i, limiter)));
+        DagFilterNode &filter = *filters.back();
+        flow::make_edge(sender, filter);
+        dag_connect(graph, image_dir, limiter, filter, &pipeline_dag.nodes[node->children[i]], filters, outputs);
+    }
+    for(size_t i = 0; i < node->output_count; i++){
+        DagOutput output(image_dir, node->outputs[i], limiter);
+        outputs.push_back(std::make_unique<DagOutputNode>(graph, flow::unlimited, output));
+        flow::make_edge(sender, *outputs.back());
+    }
+}
+
+int pipeline_dag_tbb(image_dir_t* image_dir) {
+    flow::graph graph;
+    DagLimiter limiter(graph, MAX_THREAD_COUNT);
+    std::vector<std::unique_ptr<DagFilterNode>> filters;
+    std::vector<std::unique_ptr<DagOutputNode>> outputs;
+
+#if SERVER_RUN
+    flow::source_node<dag_frame_t *> input(graph, DagInput(image_dir), false);
+#else
+    flow::input_node<dag_frame_t *> input(graph, DagInput(image_dir));
+#endif
+
+    /* DECODING STAYS SERIAL, THE LIMITER BOUNDS THE DECODED FRAMES IN FLIGHT */
+    flow::make_edge(input, limiter);
+    dag_connect(graph, image_dir, &limiter, limiter, &pipeline_dag.nodes[0], filters, outputs);
+
+    input.activate();
+    graph.wait_for_all();
+    return 0;
+}
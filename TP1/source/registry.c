@@ -0,0 +1,135 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+#include "log.h"
+#include "registry.h"
+
+#define FILTER_WITHOUT_PARAMETER(filter)                           \
+    static image_t* apply_##filter(image_t* image, double value) { \
+        return filter_##filter(image);                             \
+    }
+
+FILTER_WITHOUT_PARAMETER(sobel)
+FILTER_WITHOUT_PARAMETER(to_hsv)
+FILTER_WITHOUT_PARAMETER(to_rgb)
+FILTER_WITHOUT_PARAMETER(desaturate)
+FILTER_WITHOUT_PARAMETER(edge_identity)
+FILTER_WITHOUT_PARAMETER(edge_detect)
+FILTER_WITHOUT_PARAMETER(sharpen)
+FILTER_WITHOUT_PARAMETER(box_blur)
+FILTER_WITHOUT_PARAMETER(gaussian_blur)
+FILTER_WITHOUT_PARAMETER(horizontal_flip)
+FILTER_WITHOUT_PARAMETER(vertical_flip)
+
+static image_t* apply_scale_up(image_t* image, double value) {
+    return filter_scale_up(image, (size_t)value);
+}
+
+/* the size of the output is the size of the input times the factor, at least one pixel */
+static size_t scaled_size(size_t size, double factor) {
+    return (size_t)fmax(round(size * factor), 1);
+}
+
+static image_t* apply_scale_bilinear(image_t* image, double value) {
+    return filter_resize_bilinear(image, scaled_size(image->width, value), scaled_size(image->height, value));
+}
+
+static image_t* apply_scale_down_area(image_t* image, double value) {
+    return filter_resize_area(image, scaled_size(image->width, 1 / value), scaled_size(image->height, 1 / value));
+}
+
+static image_t* apply_add_pixel(image_t* image, double value) {
+    unsigned char byte = (unsigned char)value;
+    pixel_t pixel      = {.bytes = {byte, byte, byte, 0}};
+    return filter_add_pixel(image, &pixel);
+}
+
+static image_t* apply_box_blur_radius(image_t* image, double value) {
+    return filter_box_blur_radius(image, (size_t)value);
+}
+
+static image_t* apply_gaussian_blur_sigma(image_t* image, double value) {
+    return filter_gaussian_blur_sigma(image, value);
+}
+
+const filter_entry_t filter_registry[] = {
+    {"scale_up", "factor", 2, 1, 16, apply_scale_up},
+    {"scale_bilinear", "factor", 1.5, 0.01, 16, apply_scale_bilinear},
+    {"scale_down_area", "factor", 2, 1, 256, apply_scale_down_area},
+    {"sobel", NULL, 0, 0, 0, apply_sobel},
+    {"to_hsv", NULL, 0, 0, 0, apply_to_hsv},
+    {"to_rgb", NULL, 0, 0, 0, apply_to_rgb},
+    {"add_pixel", "value", 32, 0, 255, apply_add_pixel},
+    {"desaturate", NULL, 0, 0, 0, apply_desaturate},
+    {"edge_identity", NULL, 0, 0, 0, apply_edge_identity},
+    {"edge_detect", NULL, 0, 0, 0, apply_edge_detect},
+    {"sharpen", NULL, 0, 0, 0, apply_sharpen},
+    {"box_blur", NULL, 0, 0, 0, apply_box_blur},
+    {"gaussian_blur", NULL, 0, 0, 0, apply_gaussian_blur},
+    {"box_blur_radius", "radius", 8, 0, 4096, apply_box_blur_radius},
+    {"gaussian_blur_sigma", "sigma", 4, 0, 1024, apply_gaussian_blur_sigma},
+    {"horizontal_flip", NULL, 0, 0, 0, apply_horizontal_flip},
+    {"vertical_flip", NULL, 0, 0, 0, apply_vertical_flip},
+};
+
+const size_t filter_registry_count = sizeof(filter_registry) / sizeof(filter_registry[0]);
+
+const filter_entry_t* filter_registry_find(const char* name) {
+    for (size_t i = 0; i < filter_registry_count; i++) {
+        if (strcmp(filter_registry[i].name, name) == 0) {
+            return &filter_registry[i];
+        }
+    }
+
+    return NULL;
+}
+
+int filter_registry_parse(const char* spec, const filter_entry_t** entry, double* value) {
+    char name[64];
+
+    size_t length = strcspn(spec, ":");
+    if (length >= sizeof(name)) {
+        LOG_ERROR("filter name too long `%s`", spec);
+        goto fail_exit;
+    }
+
+    memcpy(name, spec, length);
+    name[length] = '\0';
+
+    *entry = filter_registry_find(name);
+    if (*entry == NULL) {
+        LOG_ERROR("unknown filter `%s`", name);
+        goto fail_exit;
+    }
+
+    *value = (*entry)->default_value;
+    if (spec[length] == '\0') {
+        return 0;
+    }
+
+    if ((*entry)->parameter == NULL) {
+        LOG_ERROR("filter `%s` has no parameter", name);
+        goto fail_exit;
+    }
+
+    char* end;
+    const char* arg = &spec[length + 1];
+    *value          = strtod(arg, &end);
+    if (end == arg || *end != '\0' || !isfinite(*value)) {
+        LOG_ERROR("failed to parse %s `%s` of filter `%s`", (*entry)->parameter, arg, name);
+        goto fail_exit;
+    }
+
+    if (*value < (*entry)->min_value || *value > (*entry)->max_value) {
+        LOG_ERROR("%s of filter `%s` must be between %g and %g", (*entry)->parameter, name, (*entry)->min_value,
+                  (*entry)->max_value);
+        goto fail_exit;
+    }
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "log.h"
+#include "reorder.h"
+
+/* slot value of an item that will never come */
+static char reorder_skipped;
+
+static double reorder_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+reorder_t* reorder_create(size_t depth, size_t first, size_t stride) {
+    reorder_t* reorder = calloc(1, sizeof(*reorder));
+    if (reorder == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        goto fail_exit;
+    }
+
+    reorder->depth    = depth;
+    reorder->stride   = stride;
+    reorder->next     = first;
+    reorder->capacity = depth;
+    reorder->slots    = calloc(depth, sizeof(void*));
+    if (reorder->slots == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        goto fail_free_reorder;
+    }
+
+    errno = pthread_mutex_init(&reorder->mutex, NULL);
+    if (errno != 0) {
+        LOG_ERROR_ERRNO("pthread_mutex_init");
+        goto fail_free_slots;
+    }
+
+    errno = pthread_cond_init(&reorder->released, NULL);
+    if (errno != 0) {
+        LOG_ERROR_ERRNO("pthread_cond_init");
+        goto fail_destroy_mutex;
+    }
+
+    errno = pthread_cond_init(&reorder->arrived, NULL);
+    if (errno != 0) {
+        LOG_ERROR_ERRNO("pthread_cond_init");
+        goto fail_destroy_released;
+    }
+
+    return reorder;
+
+fail_destroy_released:
+    pthread_cond_destroy(&reorder->released);
+fail_destroy_mutex:
+    pthread_mutex_destroy(&reorder->mutex);
+fail_free_slots:
+    free(reorder->slots);
+fail_free_reorder:
+    free(reorder);
+fail_exit:
+    return NULL;
+}
+
+void reorder_destroy(reorder_t* reorder) {
+    pthread_cond_destroy(&reorder->arrived);
+    pthread_cond_destroy(&reorder->released);
+    pthread_mutex_destroy(&reorder->mutex);
+    free(reorder->slots);
+    free(reorder);
+}
+
+void reorder_admit(reorder_t* reorder, size_t id) {
+    pthread_mutex_lock(&reorder->mutex);
+
+    if (id >= reorder->next + reorder->depth * reorder->stride && !reorder->closed) {
+        double start = reorder_now();
+        while (id >= reorder->next + reorder->depth * reorder->stride && !reorder->closed) {
+            pthread_cond_wait(&reorder->released, &reorder->mutex);
+        }
+
+        reorder->stats.admit_stalls++;
+        reorder->stats.admit_stall_seconds += reorder_now() - start;
+    }
+
+    pthread_mutex_unlock(&reorder->mutex);
+}
+
+/* doubles the ring, the slots from head move to the start of the new one */
+static int reorder_grow(reorder_t* reorder, size_t offset) {
+    size_t capacity = reorder->capacity;
+    while (capacity <= offset) {
+        capacity *= 2;
+    }
+
+    void** slots = calloc(capacity, sizeof(void*));
+    if (slots == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        return -1;
+    }
+
+    for (size_t i = 0; i < reorder->capacity; i++) {
+        slots[i] = reorder->slots[(reorder->head + i) % reorder->capacity];
+    }
+
+    free(reorder->slots);
+    reorder->slots    = slots;
+    reorder->head     = 0;
+    reorder->capacity = capacity;
+    return 0;
+}
+
+int reorder_put(reorder_t* reorder, size_t id, void* item) {
+    pthread_mutex_lock(&reorder->mutex);
+
+    if (id < reorder->next || (id - reorder->next) % reorder->stride != 0) {
+        LOG_ERROR("frame %zu is not expected by the reorder buffer", id);
+        goto fail_unlock;
+    }
+
+    size_t offset = (id - reorder->next) / reorder->stride;
+    if (offset >= reorder->depth) {
+        reorder->stats.overflows++;
+    }
+    if (offset >= reorder->capacity && reorder_grow(reorder, offset) < 0) {
+        goto fail_unlock;
+    }
+
+    reorder->slots[(reorder->head + offset) % reorder->capacity] = item;
+    reorder->held++;
+    if (reorder->held > reorder->stats.max_held) {
+        reorder->stats.max_held = reorder->held;
+    }
+
+    /* only the next item unblocks the consumer */
+    if (offset == 0) {
+        pthread_cond_signal(&reorder->arrived);
+    }
+
+    pthread_mutex_unlock(&reorder->mutex);
+    return 0;
+
+fail_unlock:
+    pthread_mutex_unlock(&reorder->mutex);
+    return -1;
+}
+
+void reorder_skip(reorder_t* reorder, size_t id) {
+    reorder_put(reorder, id, &reorder_skipped);
+}
+
+static void reorder_advance(reorder_t* reorder) {
+    reorder->slots[reorder->head] = NULL;
+    reorder->head                 = (reorder->head + 1) % reorder->capacity;
+    reorder->next += reorder->stride;
+    pthread_cond_broadcast(&reorder->released);
+}
+
+void* reorder_take(reorder_t* reorder) {
+    void* item         = NULL;
+    double stall_start = 0;
+
+    pthread_mutex_lock(&reorder->mutex);
+
+    while (1) {
+        item = reorder->slots[reorder->head];
+        if (item != NULL) {
+            reorder->held--;
+            reorder_advance(reorder);
+            if (item == &reorder_skipped) {
+                continue;
+            }
+            break;
+        }
+
+        if (reorder->closed) {
+            if (reorder->held == 0) {
+                break;
+            }
+
+            /* a frame that was lost without being skipped, don't wait for it */
+            reorder_advance(reorder);
+            continue;
+        }
+
+        /* later items are held while the next one is missing */
+        if (reorder->held > 0 && stall_start == 0) {
+            stall_start = reorder_now();
+        }
+        pthread_cond_wait(&reorder->arrived, &reorder->mutex);
+    }
+
+    if (stall_start != 0) {
+        reorder->stats.release_stalls++;
+        reorder->stats.release_stall_seconds += reorder_now() - stall_start;
+    }
+
+    pthread_mutex_unlock(&reorder->mutex);
+    return item;
+}
+
+void reorder_close(reorder_t* reorder) {
+    pthread_mutex_lock(&reorder->mutex);
+    reorder->closed = true;
+    pthread_cond_broadcast(&reorder->arrived);
+    pthread_cond_broadcast(&reorder->released);
+    pthread_mutex_unlock(&reorder->mutex);
+}
@@ -0,0 +1,286 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+#include "log.h"
+#include "trace.h"
+
+#define max(a, b) (((a) < (b)) ? (b) : (a))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+#if defined(__x86_64__)
+#define RESAMPLE_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define RESAMPLE_CLONES
+#endif
+
+/* weights are fixed-point with 16 fractional bits, the weights of a span sum to RESAMPLE_ONE */
+#define RESAMPLE_SHIFT 16
+#define RESAMPLE_ONE (1 << RESAMPLE_SHIFT)
+
+/*
+ * Bilinear and area resampling are separable: every output row is a weighted
+ * sum of a span of input rows, every output pixel of that row a weighted sum
+ * of a span of pixels. The vertical sum runs over whole rows and vectorizes,
+ * it keeps 8 fractional bits so rounding only happens once, at the end of the
+ * horizontal sum.
+ */
+
+typedef struct resample_span {
+    size_t start;
+    size_t count;
+    uint32_t* weights;
+} resample_span_t;
+
+typedef struct resample_spans {
+    resample_span_t* spans;
+    uint32_t* weights;
+    size_t max_count;
+} resample_spans_t;
+
+static void resample_spans_destroy(resample_spans_t* spans) {
+    free(spans->spans);
+    free(spans->weights);
+    spans->spans   = NULL;
+    spans->weights = NULL;
+}
+
+/* gives the rounding error to the largest weight so the span sums to RESAMPLE_ONE */
+static void normalize_span(resample_span_t* span) {
+    uint32_t total = 0;
+    size_t largest = 0;
+    for (size_t k = 0; k < span->count; k++) {
+        total += span->weights[k];
+        if (span->weights[k] > span->weights[largest]) {
+            largest = k;
+        }
+    }
+
+    span->weights[largest] += RESAMPLE_ONE - total;
+}
+
+/* two taps around the center of every output pixel, a single one when the input has a single pixel */
+static int bilinear_spans(size_t size, size_t new_size, resample_spans_t* spans) {
+    spans->max_count = min(size, 2);
+    spans->spans     = calloc(new_size, sizeof(resample_span_t));
+    spans->weights   = calloc(2 * new_size, sizeof(uint32_t));
+    if (spans->spans == NULL || spans->weights == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        goto fail_exit;
+    }
+
+    double ratio = (double)size / new_size;
+    for (size_t i = 0; i < new_size; i++) {
+        double center = (i + 0.5) * ratio - 0.5;
+        center        = fmin(fmax(center, 0), size - 1);
+
+        resample_span_t* span = &spans->spans[i];
+        span->start           = min((size_t)center, size - spans->max_count);
+        span->count           = spans->max_count;
+        span->weights         = &spans->weights[2 * i];
+
+        uint32_t fraction = (uint32_t)round((center - span->start) * RESAMPLE_ONE);
+        span->weights[0]  = RESAMPLE_ONE - fraction;
+        if (span->count == 2) {
+            span->weights[1] = fraction;
+        }
+        normalize_span(span);
+    }
+
+    return 0;
+
+fail_exit:
+    resample_spans_destroy(spans);
+    return -1;
+}
+
+/* every input pixel weighted by how much of it the output pixel covers */
+static int area_spans(size_t size, size_t new_size, resample_spans_t* spans) {
+    size_t max_count = (size + new_size - 1) / new_size + 1;
+
+    spans->max_count = max_count;
+    spans->spans     = calloc(new_size, sizeof(resample_span_t));
+    spans->weights   = calloc(max_count * new_size, sizeof(uint32_t));
+    if (spans->spans == NULL || spans->weights == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        goto fail_exit;
+    }
+
+    double ratio = (double)size / new_size;
+    for (size_t i = 0; i < new_size; i++) {
+        double left  = i * ratio;
+        double right = min((i + 1) * ratio, size);
+
+        resample_span_t* span = &spans->spans[i];
+        span->start           = (size_t)left;
+        span->count           = min((size_t)ceil(right), size) - span->start;
+        span->count           = min(max(span->count, 1), max_count);
+        span->weights         = &spans->weights[max_count * i];
+
+        for (size_t k = 0; k < span->count; k++) {
+            double covered   = fmin(right, span->start + k + 1) - fmax(left, span->start + k);
+            span->weights[k] = (uint32_t)round(fmax(covered, 0) / (right - left) * RESAMPLE_ONE);
+        }
+        normalize_span(span);
+    }
+
+    return 0;
+
+fail_exit:
+    resample_spans_destroy(spans);
+    return -1;
+}
+
+RESAMPLE_CLONES
+static void resample_rows(const image_t* image, const resample_span_t* span, uint32_t* sums, uint16_t* row) {
+    size_t count                = 4 * image->width;
+    const unsigned char* pixels = (const unsigned char*)image->pixels;
+
+    memset(sums, 0, count * sizeof(uint32_t));
+    for (size_t k = 0; k < span->count; k++) {
+        const unsigned char* input = &pixels[(span->start + k) * count];
+        uint32_t weight            = span->weights[k];
+
+        for (size_t i = 0; i < count; i++) {
+            sums[i] += input[i] * weight;
+        }
+    }
+
+    /* at most 255 << 8, keeps 8 fractional bits for the horizontal pass */
+    for (size_t i = 0; i < count; i++) {
+        row[i] = (sums[i] + (1 << (RESAMPLE_SHIFT - 9))) >> (RESAMPLE_SHIFT - 8);
+    }
+}
+
+static void resample_columns(const uint16_t* row, const resample_spans_t* spans, size_t new_width,
+                             pixel_t* new_row) {
+    /* bilinear spans all have two taps, the loop over the taps is unrolled */
+    if (spans->max_count == 2) {
+        for (size_t i = 0; i < new_width; i++) {
+            const uint16_t* input   = &row[4 * spans->spans[i].start];
+            const uint32_t* weights = spans->spans[i].weights;
+
+            for (int c = 0; c < 4; c++) {
+                uint32_t sum        = input[c] * weights[0] + input[4 + c] * weights[1];
+                new_row[i].bytes[c] = (sum + (1u << (RESAMPLE_SHIFT + 7))) >> (RESAMPLE_SHIFT + 8);
+            }
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < new_width; i++) {
+        const uint16_t* input   = &row[4 * spans->spans[i].start];
+        const uint32_t* weights = spans->spans[i].weights;
+        size_t count            = spans->spans[i].count;
+
+        /* at most (255 << 8) * RESAMPLE_ONE, fits in 32 bits */
+        uint32_t sums[4] = {0, 0, 0, 0};
+        for (size_t k = 0; k < count; k++) {
+            for (int c = 0; c < 4; c++) {
+                sums[c] += input[4 * k + c] * weights[k];
+            }
+        }
+
+        for (int c = 0; c < 4; c++) {
+            new_row[i].bytes[c] = (sums[c] + (1u << (RESAMPLE_SHIFT + 7))) >> (RESAMPLE_SHIFT + 8);
+        }
+    }
+}
+
+static image_t* resample(image_t* image, size_t new_width, size_t new_height,
+                         int (*make_spans)(size_t, size_t, resample_spans_t*)) {
+    resample_spans_t rows    = {NULL, NULL, 0};
+    resample_spans_t columns = {NULL, NULL, 0};
+    uint32_t* sums           = NULL;
+    uint16_t* row            = NULL;
+
+    image_t* new_image = image_create(image->id, new_width, new_height);
+    if (new_image == NULL) {
+        goto fail_exit;
+    }
+
+    if (make_spans(image->height, new_height, &rows) < 0 || make_spans(image->width, new_width, &columns) < 0) {
+        goto fail_destroy_image;
+    }
+
+    sums = malloc(4 * image->width * sizeof(uint32_t));
+    row  = malloc(4 * image->width * sizeof(uint16_t));
+    if (sums == NULL || row == NULL) {
+        LOG_ERROR_ERRNO("malloc");
+        goto fail_destroy_image;
+    }
+
+    for (size_t j = 0; j < new_height; j++) {
+        resample_rows(image, &rows.spans[j], sums, row);
+        resample_columns(row, &columns, new_width, &new_image->pixels[j * new_width]);
+    }
+
+    free(sums);
+    free(row);
+    resample_spans_destroy(&rows);
+    resample_spans_destroy(&columns);
+    return new_image;
+
+fail_destroy_image:
+    free(sums);
+    free(row);
+    resample_spans_destroy(&rows);
+    resample_spans_destroy(&columns);
+    image_destroy(new_image);
+fail_exit:
+    return NULL;
+}
+
+image_t* filter_scale_up(image_t* image, size_t factor) {
+    trace_begin(__func__, image->id);
+
+    image_t* new_image = image_create(image->id, factor * image->width, factor * image->height);
+    if (new_image == NULL) {
+        goto fail_exit;
+    }
+
+    size_t new_width = new_image->width;
+
+    for (size_t j = 0; j < image->height; j++) {
+        const pixel_t* row = &image->pixels[j * image->width];
+        pixel_t* new_row   = &new_image->pixels[factor * j * new_width];
+
+        /* the first copy of the row is built pixel by pixel, the others are copies of it */
+        for (size_t i = 0; i < image->width; i++) {
+            for (size_t k = 0; k < factor; k++) {
+                new_row[factor * i + k] = row[i];
+            }
+        }
+
+        for (size_t k = 1; k < factor; k++) {
+            memcpy(&new_row[k * new_width], new_row, new_width * sizeof(pixel_t));
+        }
+    }
+
+    trace_end(__func__, image->id, image->width * image->height);
+    return new_image;
+
+fail_exit:
+    trace_end(__func__, image->id, 0);
+    return NULL;
+}
+
+image_t* filter_resize_bilinear(image_t* image, size_t width, size_t height) {
+    trace_begin(__func__, image->id);
+
+    image_t* new_image = resample(image, width, height, bilinear_spans);
+
+    trace_end(__func__, image->id, (new_image != NULL) ? image->width * image->height : 0);
+    return new_image;
+}
+
+image_t* filter_resize_area(image_t* image, size_t width, size_t height) {
+    trace_begin(__func__, image->id);
+
+    image_t* new_image = resample(image, width, height, area_spans);
+
+    trace_end(__func__, image->id, (new_image != NULL) ? image->width * image->height : 0);
+    return new_image;
+}
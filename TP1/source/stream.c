@@ -0,0 +1,163 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "reorder.h"
+#include "stream.h"
+#include "trace.h"
+
+/* stdio buffer of the stream file, the writer appends in chunks of that size */
+#define STREAM_BUFFER_SIZE (8 << 20)
+
+typedef struct stream_frame {
+    size_t id;
+    size_t size;
+    unsigned char* data;
+} stream_frame_t;
+
+bool stream_enabled = false;
+
+static reorder_t* stream_reorder;
+static FILE* stream_file;
+static char* stream_buffer;
+static pthread_t stream_writer;
+static size_t stream_frames;
+static size_t stream_bytes;
+static bool stream_failed;
+
+static void* stream_write(void* arg) {
+    stream_frame_t* frame;
+
+    while ((frame = reorder_take(stream_reorder)) != NULL) {
+        trace_begin(__func__, frame->id);
+
+        /* after an error the frames are still taken, so nobody waits for the window */
+        if (!stream_failed && fwrite(frame->data, 1, frame->size, stream_file) != frame->size) {
+            LOG_ERROR_ERRNO("fwrite");
+            stream_failed = true;
+        }
+
+        stream_frames++;
+        stream_bytes += frame->size;
+
+        trace_end(__func__, frame->id, 0);
+        free(frame->data);
+        free(frame);
+    }
+
+    return NULL;
+}
+
+int stream_open(const char* filename, size_t depth, size_t first, size_t stride) {
+    if (filename == NULL) {
+        LOG_ERROR_NULL_PTR();
+        goto fail_exit;
+    }
+
+    stream_file = fopen(filename, "wb");
+    if (stream_file == NULL) {
+        LOG_ERROR_ERRNO("fopen");
+        goto fail_exit;
+    }
+
+    stream_buffer = malloc(STREAM_BUFFER_SIZE);
+    if (stream_buffer == NULL) {
+        LOG_ERROR_ERRNO("malloc");
+        goto fail_close_file;
+    }
+    setvbuf(stream_file, stream_buffer, _IOFBF, STREAM_BUFFER_SIZE);
+
+    stream_reorder = reorder_create(depth, first, stride);
+    if (stream_reorder == NULL) {
+        goto fail_close_file;
+    }
+
+    stream_frames = 0;
+    stream_bytes  = 0;
+    stream_failed = false;
+
+    errno = pthread_create(&stream_writer, NULL, stream_write, NULL);
+    if (errno != 0) {
+        LOG_ERROR_ERRNO("pthread_create");
+        goto fail_destroy_reorder;
+    }
+
+    stream_enabled = true;
+    return 0;
+
+fail_destroy_reorder:
+    reorder_destroy(stream_reorder);
+fail_close_file:
+    fclose(stream_file);
+    free(stream_buffer);
+fail_exit:
+    return -1;
+}
+
+void stream_admit(size_t frame) {
+    if (stream_enabled) {
+        reorder_admit(stream_reorder, frame);
+    }
+}
+
+int stream_put(image_t* image) {
+    stream_frame_t* frame = malloc(sizeof(*frame));
+    if (frame == NULL) {
+        LOG_ERROR_ERRNO("malloc");
+        goto fail_skip;
+    }
+
+    frame->id = image->id;
+    if (image_encode_png(image, &frame->data, &frame->size) < 0) {
+        goto fail_free_frame;
+    }
+
+    if (reorder_put(stream_reorder, frame->id, frame) < 0) {
+        goto fail_free_data;
+    }
+
+    return 0;
+
+fail_free_data:
+    free(frame->data);
+fail_free_frame:
+    free(frame);
+fail_skip:
+    stream_skip(image->id);
+    return -1;
+}
+
+void stream_skip(size_t frame) {
+    if (stream_enabled) {
+        reorder_skip(stream_reorder, frame);
+    }
+}
+
+int stream_close(void) {
+    if (!stream_enabled) {
+        return 0;
+    }
+
+    stream_enabled = false;
+
+    reorder_close(stream_reorder);
+    pthread_join(stream_writer, NULL);
+
+    reorder_stats_t* stats = &stream_reorder->stats;
+    printf("stream: %zu frames, %.1f MB, reorder depth %zu, at most %zu frames held, %zu overflows\n", stream_frames,
+           stream_bytes / 1e6, stream_reorder->depth, stats->max_held, stats->overflows);
+    printf("stream: loader waited %zu times (%.3f s), writer waited %zu times (%.3f s) for an earlier frame\n",
+           stats->admit_stalls, stats->admit_stall_seconds, stats->release_stalls, stats->release_stall_seconds);
+
+    reorder_destroy(stream_reorder);
+    stream_reorder = NULL;
+
+    if (fclose(stream_file) != 0) {
+        LOG_ERROR_ERRNO("fclose");
+        stream_failed = true;
+    }
+    free(stream_buffer);
+
+    return stream_failed ? -1 : 0;
+}
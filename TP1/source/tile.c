@@ -0,0 +1,112 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tile.h"
+
+#define max(a, b) (((a) < (b)) ? (b) : (a))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+/* used when sysfs doesn't describe the caches */
+#define TILE_DEFAULT_L1_SIZE (32 * 1024)
+#define TILE_DEFAULT_L2_SIZE (256 * 1024)
+
+/* widths are kept a multiple of the vector width of the kernels */
+#define TILE_WIDTH_MULTIPLE 16
+
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static size_t cache_l1_size      = TILE_DEFAULT_L1_SIZE;
+static size_t cache_l2_size      = TILE_DEFAULT_L2_SIZE;
+
+static int read_cache_attribute(int index, const char* attribute, char* buffer, size_t size) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/%s", index, attribute);
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int ret = fgets(buffer, size, file) == NULL ? -1 : 0;
+    fclose(file);
+
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return ret;
+}
+
+static void read_cache_sizes(void) {
+    for (int index = 0;; index++) {
+        char level[16];
+        char type[32];
+        char size[32];
+
+        if (read_cache_attribute(index, "level", level, sizeof(level)) < 0 ||
+            read_cache_attribute(index, "type", type, sizeof(type)) < 0 ||
+            read_cache_attribute(index, "size", size, sizeof(size)) < 0) {
+            break;
+        }
+
+        if (strcmp(type, "Instruction") == 0) {
+            continue;
+        }
+
+        size_t bytes = 0;
+        char unit    = '\0';
+        if (sscanf(size, "%zu%c", &bytes, &unit) < 1 || bytes == 0) {
+            continue;
+        }
+
+        if (unit == 'K') {
+            bytes *= 1024;
+        } else if (unit == 'M') {
+            bytes *= 1024 * 1024;
+        }
+
+        if (strcmp(level, "1") == 0) {
+            cache_l1_size = bytes;
+        } else if (strcmp(level, "2") == 0) {
+            cache_l2_size = bytes;
+        }
+    }
+}
+
+void tile_get_size(size_t halo, size_t* width, size_t* height) {
+    pthread_once(&cache_once, read_cache_sizes);
+
+    /* half of each cache is left to the other data of the filter and to the prefetchers */
+    size_t l1_pixels = cache_l1_size / 2 / sizeof(pixel_t);
+    size_t l2_pixels = cache_l2_size / 2 / sizeof(pixel_t);
+
+    /* 2 * halo + 1 input rows and one output row */
+    size_t tile_width = l1_pixels / (2 * halo + 2);
+    tile_width        = max(tile_width - tile_width % TILE_WIDTH_MULTIPLE, TILE_WIDTH_MULTIPLE);
+
+    /* (width + 2 halo) * (height + 2 halo) input pixels and width * height output pixels */
+    size_t halo_pixels = (tile_width + 2 * halo) * 2 * halo;
+    size_t tile_height = 1;
+    if (l2_pixels > halo_pixels) {
+        tile_height = max((l2_pixels - halo_pixels) / (2 * tile_width + 2 * halo), 1);
+    }
+
+    *width  = tile_width;
+    *height = tile_height;
+}
+
+void tile_for_each(const image_t* input, image_t* output, size_t halo, tile_kernel_t kernel, void* arg) {
+    size_t tile_width;
+    size_t tile_height;
+    tile_get_size(halo, &tile_width, &tile_height);
+
+    for (size_t y = 0; y < output->height; y += tile_height) {
+        for (size_t x = 0; x < output->width; x += tile_width) {
+            tile_t tile = {
+                .x      = x,
+                .y      = y,
+                .width  = min(tile_width, output->width - x),
+                .height = min(tile_height, output->height - y),
+            };
+
+            kernel(input, output, &tile, arg);
+        }
+    }
+}
@@ -0,0 +1,210 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "counters.h"
+#include "log.h"
+#include "trace.h"
+
+#define TRACE_CHUNK_EVENTS 4096
+
+typedef struct trace_event {
+    const char* name;
+    size_t frame;
+    size_t pixels;
+    uint64_t timestamp;
+    char phase;
+} trace_event_t;
+
+typedef struct trace_chunk trace_chunk_t;
+
+typedef struct trace_chunk {
+    trace_chunk_t* next;
+    size_t used;
+    trace_event_t events[TRACE_CHUNK_EVENTS];
+} trace_chunk_t;
+
+typedef struct trace_buffer trace_buffer_t;
+
+typedef struct trace_buffer {
+    trace_buffer_t* next;
+    pid_t tid;
+    trace_chunk_t* head;
+    trace_chunk_t* tail;
+} trace_buffer_t;
+
+bool trace_enabled = false;
+
+static const char* trace_filename;
+static uint64_t trace_start;
+static unsigned int trace_generation;
+static trace_buffer_t* trace_buffers;
+static __thread trace_buffer_t* trace_local;
+/* trace_close() frees the buffers, a thread only reuses trace_local if it was taken since the last trace_open() */
+static __thread unsigned int trace_local_generation;
+
+static uint64_t trace_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static trace_buffer_t* trace_get_buffer(void) {
+    if (trace_local != NULL && trace_local_generation == trace_generation) {
+        return trace_local;
+    }
+
+    trace_buffer_t* buffer = calloc(1, sizeof(*buffer));
+    if (buffer == NULL) {
+        LOG_ERROR_ERRNO("calloc");
+        return NULL;
+    }
+
+    buffer->tid = syscall(SYS_gettid);
+
+    /* lock-free push, the list is only walked once every thread is done */
+    buffer->next = __atomic_load_n(&trace_buffers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace_buffers, &buffer->next, buffer, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+    }
+
+    trace_local = buffer;
+    trace_local_generation = trace_generation;
+    return buffer;
+}
+
+static void trace_record(const char* name, size_t frame, size_t pixels, char phase) {
+    trace_buffer_t* buffer = trace_get_buffer();
+    if (buffer == NULL) {
+        return;
+    }
+
+    trace_chunk_t* chunk = buffer->tail;
+    if (chunk == NULL || chunk->used == TRACE_CHUNK_EVENTS) {
+        chunk = malloc(sizeof(*chunk));
+        if (chunk == NULL) {
+            LOG_ERROR_ERRNO("malloc");
+            return;
+        }
+
+        chunk->next = NULL;
+        chunk->used = 0;
+
+        if (buffer->tail == NULL) {
+            buffer->head = chunk;
+        } else {
+            buffer->tail->next = chunk;
+        }
+        buffer->tail = chunk;
+    }
+
+    trace_event_t* event = &chunk->events[chunk->used++];
+    event->name          = name;
+    event->frame         = frame;
+    event->pixels        = pixels;
+    event->timestamp     = trace_now();
+    event->phase         = phase;
+}
+
+/* the counters are read inside the trace events, so they don't count the recording */
+void trace_begin(const char* name, size_t frame) {
+    if (trace_enabled) {
+        trace_record(name, frame, 0, 'B');
+    }
+
+    if (counters_enabled) {
+        counters_begin(name);
+    }
+}
+
+void trace_end(const char* name, size_t frame, size_t pixels) {
+    if (counters_enabled) {
+        counters_end(name, pixels);
+    }
+
+    if (trace_enabled) {
+        trace_record(name, frame, pixels, 'E');
+    }
+}
+
+int trace_open(const char* filename) {
+    if (filename == NULL) {
+        LOG_ERROR_NULL_PTR();
+        goto fail_exit;
+    }
+
+    trace_filename = filename;
+    trace_buffers  = NULL;
+    trace_start    = trace_now();
+    trace_generation++;
+    trace_enabled = true;
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+int trace_close(void) {
+    if (!trace_enabled) {
+        return 0;
+    }
+
+    trace_enabled = false;
+
+    trace_buffer_t* buffers = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE);
+    trace_buffers           = NULL;
+
+    int ret    = 0;
+    FILE* file = fopen(trace_filename, "w");
+    if (file == NULL) {
+        LOG_ERROR_ERRNO("fopen");
+        ret = -1;
+    }
+
+    if (file != NULL) {
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    }
+
+    bool first = true;
+    while (buffers != NULL) {
+        trace_buffer_t* buffer = buffers;
+        buffers                = buffer->next;
+
+        while (buffer->head != NULL) {
+            trace_chunk_t* chunk = buffer->head;
+            buffer->head         = chunk->next;
+
+            for (size_t i = 0; file != NULL && i < chunk->used; i++) {
+                trace_event_t* event = &chunk->events[i];
+                double timestamp_us  = (event->timestamp - trace_start) / 1000.0;
+
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,", first ? "" : ",\n",
+                        event->name, event->phase, timestamp_us, buffer->tid);
+                if (event->phase == 'B') {
+                    fprintf(file, "\"args\":{\"frame\":%zu}}", event->frame);
+                } else {
+                    fprintf(file, "\"args\":{\"frame\":%zu,\"pixels\":%zu}}", event->frame, event->pixels);
+                }
+                first = false;
+            }
+
+            free(chunk);
+        }
+
+        free(buffer);
+    }
+
+    if (file != NULL) {
+        fprintf(file, "\n]}\n");
+        if (fclose(file) != 0) {
+            LOG_ERROR_ERRNO("fclose");
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
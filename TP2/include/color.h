@@ -9,4 +9,53 @@ unsigned int color_get_interval(float max);
 float color_get_interval_inverse(float max);
 void color_value(pixel_t* pixel, float value, int interval, float interval_inverse);
 
+/*
+ * color_value() as tables, for values in [0, COLOR_PALETTE_SIZE). x[v] is the
+ * ramp of the integer part v of a value, the segment (value * interval_inverse
+ * clamped to the white one) gives every byte as base + slope * x. The segment
+ * is computed from the value like color_value() does, a value close to the end
+ * of a segment lands in the same one, so the colors are exactly the same.
+ *
+ * The layout is shared with the opencl kernel, which takes the palette as a
+ * __constant buffer.
+ */
+
+#define COLOR_PALETTE_SIZE 256
+#define COLOR_PALETTE_SEGMENTS 6
+
+typedef struct color_palette {
+    float max; /* the palette is built for this max */
+    unsigned int interval;
+    float interval_inverse;
+    int base[COLOR_PALETTE_SEGMENTS][3];
+    int slope[COLOR_PALETTE_SEGMENTS][3];
+    unsigned char x[COLOR_PALETTE_SIZE];
+} color_palette_t;
+
+void color_palette_init(color_palette_t* palette, float max);
+int color_palette_check(float max);
+
+/* rebuilds the palette when max changed */
+static inline void color_palette_update(color_palette_t* palette, float max) {
+    if (palette->max != max) {
+        color_palette_init(palette, max);
+    }
+}
+
+/* NaN and values out of the table go through color_value(), the others don't branch */
+static inline void color_palette_value(const color_palette_t* palette, pixel_t* pixel, float value) {
+    if (!(value >= 0 && value < COLOR_PALETTE_SIZE)) {
+        color_value(pixel, value, palette->interval, palette->interval_inverse);
+        return;
+    }
+
+    int x       = palette->x[(int)value];
+    int segment = value * palette->interval_inverse;
+    segment     = (segment < COLOR_PALETTE_SEGMENTS - 1) ? segment : COLOR_PALETTE_SEGMENTS - 1;
+
+    pixel->bytes[0] = palette->base[segment][0] + palette->slope[segment][0] * x;
+    pixel->bytes[1] = palette->base[segment][1] + palette->slope[segment][1] * x;
+    pixel->bytes[2] = palette->base[segment][2] + palette->slope[segment][2] * x;
+}
+
 #endif /* INCLUDE_COLOR_H_ */
@@ -0,0 +1,134 @@
+/*
+ * Body of the SIMD math functions for one instruction set, included by
+ * simd-math.c once per instruction set with:
+ *
+ *   SIMD_SUFFIX  suffix of the function names
+ *   SIMD_WIDTH   floats per vector
+ *   SIMD_TARGET  function attribute enabling the instruction set
+ *
+ * The vectors are GCC vector extensions, the compiler picks the instructions
+ * of the target. The polynomials are the single precision ones of Cephes.
+ */
+
+#define SIMD_CONCAT_(name, suffix) name##_##suffix
+#define SIMD_CONCAT(name, suffix) SIMD_CONCAT_(name, suffix)
+#define SIMD_NAME(name) SIMD_CONCAT(name, SIMD_SUFFIX)
+#define SIMD_STRING_(name) #name
+#define SIMD_STRING(name) SIMD_STRING_(name)
+
+typedef float SIMD_NAME(vfloat) __attribute__((vector_size(SIMD_WIDTH * sizeof(float))));
+typedef int SIMD_NAME(vint) __attribute__((vector_size(SIMD_WIDTH * sizeof(int))));
+
+#define vfloat SIMD_NAME(vfloat)
+#define vint SIMD_NAME(vint)
+
+/* mask ? a : b, mask lanes are all ones or all zeros */
+static inline SIMD_TARGET vfloat SIMD_NAME(select)(vint mask, vfloat a, vfloat b) {
+    return (vfloat)(((vint)a & mask) | ((vint)b & ~mask));
+}
+
+/* r = x - q * pi / 2 with |r| <= pi / 4, q is returned modulo 4 */
+static inline SIMD_TARGET vfloat SIMD_NAME(reduce)(vfloat x, vint* quadrant) {
+    /* rounds to nearest, |x * 2 / pi| is far below 2^22 */
+    vfloat q = (x * (float)M_2_PI + 12582912.0f) - 12582912.0f;
+
+    /* the first two parts have few enough bits that q * part is exact */
+    vfloat r = x - q * 1.5703125f;
+    r        = r - q * 4.837512969970703125e-4f;
+    r        = r - q * 7.54978995489188216e-8f;
+
+    *quadrant = __builtin_convertvector(q, vint) & 3;
+    return r;
+}
+
+static inline SIMD_TARGET vfloat SIMD_NAME(sin_poly)(vfloat r) {
+    vfloat z = r * r;
+    return ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+}
+
+static inline SIMD_TARGET vfloat SIMD_NAME(cos_poly)(vfloat r) {
+    vfloat z = r * r;
+    return ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z +
+           1.0f;
+}
+
+/* sin(x + quadrant * pi / 2) from the reduced argument */
+static inline SIMD_TARGET vfloat SIMD_NAME(sin_quadrant)(vfloat r, vint quadrant) {
+    vint odd      = -(quadrant & 1);
+    vint negative = (quadrant & 2) << 30;
+
+    vfloat value = SIMD_NAME(select)(odd, SIMD_NAME(cos_poly)(r), SIMD_NAME(sin_poly)(r));
+    return (vfloat)((vint)value ^ negative);
+}
+
+static inline SIMD_TARGET vfloat SIMD_NAME(sin)(vfloat x) {
+    vint quadrant;
+    vfloat r = SIMD_NAME(reduce)(x, &quadrant);
+    return SIMD_NAME(sin_quadrant)(r, quadrant);
+}
+
+static inline SIMD_TARGET vfloat SIMD_NAME(cos)(vfloat x) {
+    vint quadrant;
+    vfloat r = SIMD_NAME(reduce)(x, &quadrant);
+    return SIMD_NAME(sin_quadrant)(r, (quadrant + 1) & 3);
+}
+
+static inline SIMD_TARGET vfloat SIMD_NAME(atan)(vfloat x) {
+    vint sign = (vint)x & (int)0x80000000;
+    vfloat a  = (vfloat)((vint)x & 0x7fffffff);
+
+    /* atan(a) = pi / 2 + atan(-1 / a) above tan(3 pi / 8), pi / 4 + atan((a - 1) / (a + 1)) above tan(pi / 8) */
+    vint large  = a > 2.414213562373095f;
+    vint medium = (a > 0.4142135623730950f) & ~large;
+
+    vfloat r      = SIMD_NAME(select)(large, -1.0f / a, SIMD_NAME(select)(medium, (a - 1.0f) / (a + 1.0f), a));
+    vfloat offset = SIMD_NAME(select)(large, (vfloat){} + (float)M_PI_2,
+                                      SIMD_NAME(select)(medium, (vfloat){} + (float)M_PI_4, (vfloat){}));
+
+    vfloat z     = r * r;
+    vfloat value = (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f) *
+                       z * r +
+                   r + offset;
+
+    return (vfloat)((vint)value ^ sign);
+}
+
+/* the last partial vector goes through a zero-padded copy */
+#define SIMD_ARRAY_FUNCTION(function)                                                             \
+    static SIMD_TARGET void SIMD_NAME(function##_array)(const float* x, float* y, size_t count) { \
+        size_t i = 0;                                                                             \
+        for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {                                        \
+            vfloat v;                                                                             \
+            memcpy(&v, &x[i], sizeof(v));                                                         \
+            v = SIMD_NAME(function)(v);                                                           \
+            memcpy(&y[i], &v, sizeof(v));                                                         \
+        }                                                                                         \
+                                                                                                  \
+        if (i < count) {                                                                          \
+            vfloat v = {};                                                                        \
+            memcpy(&v, &x[i], (count - i) * sizeof(float));                                       \
+            v = SIMD_NAME(function)(v);                                                           \
+            memcpy(&y[i], &v, (count - i) * sizeof(float));                                       \
+        }                                                                                         \
+    }
+
+SIMD_ARRAY_FUNCTION(sin)
+SIMD_ARRAY_FUNCTION(cos)
+SIMD_ARRAY_FUNCTION(atan)
+
+static const simd_math_t SIMD_NAME(simd_math) = {
+    .name  = SIMD_STRING(SIMD_SUFFIX),
+    .width = SIMD_WIDTH,
+    .sin   = SIMD_NAME(sin_array),
+    .cos   = SIMD_NAME(cos_array),
+    .atan  = SIMD_NAME(atan_array),
+};
+
+#undef SIMD_ARRAY_FUNCTION
+#undef vint
+#undef vfloat
+#undef SIMD_STRING
+#undef SIMD_STRING_
+#undef SIMD_NAME
+#undef SIMD_CONCAT
+#undef SIMD_CONCAT_
@@ -0,0 +1,40 @@
+#ifndef INCLUDE_SIMD_MATH_H_
+#define INCLUDE_SIMD_MATH_H_
+
+#include <stddef.h>
+
+/*
+ * Single precision sin, cos and atan over arrays, on AVX-512 (16 floats per
+ * vector), AVX2 with FMA (8 floats) or SSE (4 floats).
+ * The instruction set is picked at the first call from what the CPU supports,
+ * the SIMD_MATH_ISA environment variable (avx512, avx2 or sse) forces a lower
+ * one.
+ *
+ * sin and cos reduce their argument modulo pi / 2 with a three-part constant,
+ * exact for |x| < 8192. The arguments of the sinoscope stay well below that,
+ * time is at most 2000 pi. Maximum error measured against libm in double
+ * precision on 20M random inputs per range:
+ *
+ *   sin, cos  |x| < 8192    1.6 ulp, absolute error below 8e-8
+ *   atan      any float     2 ulp
+ *
+ * With FMA (AVX2 and AVX-512) sin and cos stay within 1.6 ulp up to 65536,
+ * with SSE they lose about one bit every time |x| doubles beyond 8192.
+ */
+
+/* pixels per iteration of the callers, one AVX-512 vector */
+#define SIMD_MATH_BLOCK 16
+
+typedef void (*simd_math_function)(const float* x, float* y, size_t count);
+
+typedef struct simd_math {
+    const char* name;
+    unsigned int width; /* floats per vector */
+    simd_math_function sin;
+    simd_math_function cos;
+    simd_math_function atan;
+} simd_math_t;
+
+const simd_math_t* simd_math_get(void);
+
+#endif /* INCLUDE_SIMD_MATH_H_ */
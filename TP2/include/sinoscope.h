@@ -3,13 +3,27 @@
 #ifndef INCLUDE_SINOSCOPE_H_
 #define INCLUDE_SINOSCOPE_H_
 
+#include "color.h"
 #include "opencl.h"
 
+/*
+ * Frames computed ahead on the device: while the host reads back and uses
+ * frame N, the kernels of the next frames run in the other buffers.
+ */
+#define SINOSCOPE_OPENCL_FRAMES 3
+
+typedef struct sinoscope_opencl_frame sinoscope_opencl_frame_t;
+
 typedef struct sinoscope_opencl {
     cl_device_id device_id;
     cl_context context;
-    cl_command_queue queue;
-    cl_mem buffer;
+    cl_command_queue queue;    /* kernels */
+    cl_command_queue transfer; /* maps of the frames, overlaps the kernels */
+    sinoscope_opencl_frame_t* frames;
+    unsigned int frame_first; /* oldest frame in flight */
+    unsigned int frame_count; /* frames in flight */
+    cl_mem palette;
+    float palette_max; /* max of the palette on the device */
     cl_kernel kernel;
 } sinoscope_opencl_t;
 
@@ -29,6 +43,7 @@ typedef struct sinoscope {
 
     unsigned int interval;
     float interval_inverse;
+    color_palette_t palette; /* color_value() as tables, for the openmp, separable and recurrence methods */
 
     float time;
     float max;
@@ -37,6 +52,9 @@ typedef struct sinoscope {
     float dx;
     float dy;
 
+    float* rows;    /* sine sum of every row, for the separable method */
+    float* columns; /* cosine sum of every column, for the separable method */
+
     sinoscope_opencl_t* opencl;
 } sinoscope_t;
 
@@ -44,8 +62,8 @@ sinoscope_t* sinoscope_create(char* name, sinoscope_handler handler, unsigned in
                               float max);
 void sinoscope_destroy(sinoscope_t* sinoscope);
 int sinoscope_corners(sinoscope_t* sinoscope);
-int sinoscope_check(unsigned int width, unsigned int height, unsigned int taylor, float max,
-                    sinoscope_opencl_t* opencl);
+int sinoscope_check(char* name, sinoscope_handler handler, unsigned int width, unsigned int height,
+                    unsigned int taylor, float max, sinoscope_opencl_t* opencl, unsigned int tolerance);
 int sinoscope_benchmarks(unsigned int width, unsigned int height, unsigned int taylor, float max,
                         sinoscope_opencl_t* opencl, unsigned int iterations);
 
@@ -54,6 +72,10 @@ int sinoscope_benchmark(sinoscope_t* sinoscope, unsigned int iterations);
 int sinoscope_image_serial(sinoscope_t* sinoscope);
 int sinoscope_image_openmp(sinoscope_t* sinoscope);
 int sinoscope_image_opencl(sinoscope_t* sinoscope);
+int sinoscope_image_separable(sinoscope_t* sinoscope);
+int sinoscope_image_recurrence(sinoscope_t* sinoscope);
+
+int sinoscope_recurrence_sweep(unsigned int width, unsigned int height, unsigned int max_taylor, float max);
 
 int sinoscope_opencl_init(sinoscope_opencl_t* opencl, cl_device_id opencl_device_id, unsigned int width,
                           unsigned int height);
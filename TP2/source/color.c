@@ -1,6 +1,8 @@
 /* DO NOT EDIT THIS FILE */
 
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "color.h"
 
@@ -62,3 +64,75 @@ void color_value(pixel_t* pixel, float value, int interval, float interval_inver
 done:
     *pixel = pixel_value;
 }
+
+void color_palette_init(color_palette_t* palette, float max) {
+    /* segment 5 and above is white */
+    static const int base[COLOR_PALETTE_SEGMENTS][3] = {
+        {0, 0, 255}, {0, 255, 255}, {0, 255, 0}, {255, 255, 0}, {255, 0, 0}, {255, 255, 255},
+    };
+    static const int slope[COLOR_PALETTE_SEGMENTS][3] = {
+        {0, 1, 0}, {0, 0, -1}, {1, 0, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, 0},
+    };
+
+    palette->max              = max;
+    palette->interval         = color_get_interval(max);
+    palette->interval_inverse = color_get_interval_inverse(max);
+
+    memcpy(palette->base, base, sizeof(base));
+    memcpy(palette->slope, slope, sizeof(slope));
+
+    for (int value = 0; value < COLOR_PALETTE_SIZE; value++) {
+        int interval      = palette->interval;
+        palette->x[value] = ((value % interval) * 255) * palette->interval_inverse;
+    }
+}
+
+/* every float from 0 to max, NaN and a few values out of the table against color_value() */
+int color_palette_check(float max) {
+    static const float outside[] = {-1.0f, -0.0f, 255.99998f, 256.0f, 1000.0f, INFINITY, -INFINITY, NAN};
+
+    color_palette_t palette;
+    color_palette_init(&palette, max);
+
+    unsigned long values = 0;
+    unsigned long errors = 0;
+
+    for (float value = 0;; value = nextafterf(value, INFINITY)) {
+        pixel_t expected;
+        pixel_t pixel;
+
+        color_value(&expected, value, palette.interval, palette.interval_inverse);
+        color_palette_value(&palette, &pixel, value);
+
+        if (memcmp(&expected, &pixel, sizeof(pixel)) != 0) {
+            if (errors++ < 10) {
+                printf("palette differs at %.9g\n", value);
+            }
+        }
+
+        values++;
+
+        if (value >= max) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < sizeof(outside) / sizeof(outside[0]); i++) {
+        pixel_t expected;
+        pixel_t pixel;
+
+        color_value(&expected, outside[i], palette.interval, palette.interval_inverse);
+        color_palette_value(&palette, &pixel, outside[i]);
+
+        if (memcmp(&expected, &pixel, sizeof(pixel)) != 0) {
+            printf("palette differs at %.9g\n", outside[i]);
+            errors++;
+        }
+
+        values++;
+    }
+
+    printf("palette: %lu values, %lu differ\n", values, errors);
+
+    return errors == 0 ? 0 : -1;
+}
@@ -55,4 +55,32 @@ void color_value(pixel_t* pixel, float value, int interval, float interval_inver
 
 done:
     *pixel = pixel_value;
-}
\ No newline at end of file
+}
+
+/* the palette of color.h, built and uploaded by the host when max changes */
+
+#define COLOR_PALETTE_SIZE 256
+#define COLOR_PALETTE_SEGMENTS 6
+
+typedef struct color_palette {
+    float max;
+    unsigned int interval;
+    float interval_inverse;
+    int base[COLOR_PALETTE_SEGMENTS][3];
+    int slope[COLOR_PALETTE_SEGMENTS][3];
+    unsigned char x[COLOR_PALETTE_SIZE];
+} color_palette_t;
+
+void color_palette_value(__constant const color_palette_t* palette, pixel_t* pixel, float value) {
+    if (!(value >= 0 && value < COLOR_PALETTE_SIZE)) {
+        color_value(pixel, value, palette->interval, palette->interval_inverse);
+        return;
+    }
+
+    int x       = palette->x[(int)value];
+    int segment = min((int)(value * palette->interval_inverse), COLOR_PALETTE_SEGMENTS - 1);
+
+    pixel->bytes[0] = palette->base[segment][0] + palette->slope[segment][0] * x;
+    pixel->bytes[1] = palette->base[segment][1] + palette->slope[segment][1] * x;
+    pixel->bytes[2] = palette->base[segment][2] + palette->slope[segment][2] * x;
+}
@@ -18,7 +18,7 @@ typedef struct sinoscope_float {
     float dy;
 } sinoscope_float_t;
 
-__kernel void sinoscope_kernel(__global unsigned char *buffer, const sinoscope_int_t sinoscope_int, const sinoscope_float_t sinoscope_float) {
+__kernel void sinoscope_kernel(__global unsigned char *buffer, const sinoscope_int_t sinoscope_int, const sinoscope_float_t sinoscope_float, __constant const color_palette_t *palette) {
     const int x = get_global_id(0);
     const int y = get_global_id(1);
 
@@ -35,7 +35,7 @@ __kernel void sinoscope_kernel(__global unsigned char *buffer, const sinoscope_i
     value = (value + 1) * 100;
 
     pixel_t pixel;
-    color_value(&pixel, value, sinoscope_int.interval, sinoscope_float.interval_inverse);
+    color_palette_value(palette, &pixel, value);
 
     const int index = (x * 3) + (y * 3) * sinoscope_int.width;
     buffer[index] = pixel.bytes[0];
@@ -10,6 +10,7 @@
 #include <GL/glut.h>
 #endif
 
+#include "color.h"
 #include "headless.h"
 #include "log.h"
 #include "opencl.h"
@@ -82,7 +83,8 @@ static void show_help(FILE* f, const char* exec_name) {
     fprintf(f, "\n");
     fprintf(f, "Options:\n");
     fprintf(f,
-            "  --method [serial|openmp|opencl] computation method to use "
+            "  --method [serial|separable|recurrence|openmp|opencl]\n"
+            "                                  computation method to use "
             "(default: serial)\n");
     fprintf(f,
             "  --width N                       width of the simulation "
@@ -107,8 +109,15 @@ static void show_help(FILE* f, const char* exec_name) {
             "graphical interface\n");
     fprintf(f, "  --save FILE                     save a frame into a PNG image\n");
     fprintf(f, "  --benchmarks N                  benchmark all implementations for N iterations\n");
-    fprintf(f, "  --benchmark VARIANT N           benchmark VARIANT for N iterations\n");
-    fprintf(f, "  --check VARIANT                 check VARIANT outputs\n");
+    fprintf(f, "  --benchmark VARIANT N           benchmark VARIANT (serial, separable, recurrence, mp or cl)\n");
+    fprintf(f, "                                  for N iterations\n");
+    fprintf(f, "  --check VARIANT                 check VARIANT (mp, cl, separable or recurrence) outputs\n");
+    fprintf(f, "                                  against serial, or the palette (palette) against the\n");
+    fprintf(f, "                                  color mapping\n");
+    fprintf(f, "  --tolerance N                   largest difference of a color byte accepted by --check\n");
+    fprintf(f, "                                  (default: 10)\n");
+    fprintf(f, "  --error-sweep N                 error of the recurrence method against serial for 1 to N\n");
+    fprintf(f, "                                  Taylor terms\n");
     fprintf(f, "  --help                          show this help\n");
 }
 
@@ -240,18 +249,39 @@ static void run_benchmarks(sinoscope_opencl_t* opencl, unsigned int width, unsig
     }
 }
 
-static void run_check_mp(unsigned int width, unsigned int height, unsigned int taylor,
-			 float max) {
-    if (sinoscope_check(width, height, taylor, max, NULL) < 0) {
+static void run_benchmark_separable(unsigned int width, unsigned int height, unsigned int taylor, float max,
+                                    unsigned int iterations) {
+    sinoscope_t* s = sinoscope_create("separable", sinoscope_image_separable, width, height, max);
+
+    if (!s) {
+        LOG_ERROR("failed to create sinoscope (separable)");
+        exit(1);
+    }
+    s->taylor = taylor;
+    if (sinoscope_benchmark(s, iterations) < 0) {
         LOG_ERROR("failed to check ouputs");
         exit(1);
     }
 }
 
+static void run_benchmark_recurrence(unsigned int width, unsigned int height, unsigned int taylor, float max,
+                                     unsigned int iterations) {
+    sinoscope_t* s = sinoscope_create("recurrence", sinoscope_image_recurrence, width, height, max);
+
+    if (!s) {
+        LOG_ERROR("failed to create sinoscope (recurrence)");
+        exit(1);
+    }
+    s->taylor = taylor;
+    if (sinoscope_benchmark(s, iterations) < 0) {
+        LOG_ERROR("failed to check ouputs");
+        exit(1);
+    }
+}
 
-static void run_check_cl(sinoscope_opencl_t* opencl, unsigned int width, unsigned int height, unsigned int taylor,
-			 float max) {
-    if (sinoscope_check(width, height, taylor, max, opencl) < 0) {
+static void run_check(char* name, sinoscope_handler handler, sinoscope_opencl_t* opencl, unsigned int width,
+                      unsigned int height, unsigned int taylor, float max, unsigned int tolerance) {
+    if (sinoscope_check(name, handler, width, height, taylor, max, opencl, tolerance) < 0) {
         LOG_ERROR("failed to check ouputs");
         exit(1);
     }
@@ -303,16 +333,18 @@ int main(int argc, char* argv[]) {
     }
 #endif
 
-    char* exec_name        = argv[0];
-    bool use_method_serial = false;
-    bool use_method_openmp = false;
-    bool use_method_opencl = false;
-    int use_method_count   = 0;
-    bool do_run_headless   = false;
-    bool do_benchmarks      = false;
-    bool do_save_image     = false;
-    char *check            = NULL;
-    char *benchmark        = NULL;
+    char* exec_name            = argv[0];
+    bool use_method_serial     = false;
+    bool use_method_separable  = false;
+    bool use_method_recurrence = false;
+    bool use_method_openmp     = false;
+    bool use_method_opencl     = false;
+    int use_method_count       = 0;
+    bool do_run_headless       = false;
+    bool do_benchmarks         = false;
+    bool do_save_image         = false;
+    char *check                = NULL;
+    char *benchmark            = NULL;
 
     char* save_filename = NULL;
 
@@ -320,6 +352,8 @@ int main(int argc, char* argv[]) {
     unsigned int height     = 512;
     unsigned int taylor     = 6;
     unsigned int iterations = 0;
+    int tolerance           = -1;
+    unsigned int sweep      = 0;
 
     unsigned int opencl_platform_index = 0;
     unsigned int opencl_device_index   = 0;
@@ -333,6 +367,12 @@ int main(int argc, char* argv[]) {
             if (strcmp("serial", argv[i + 1]) == 0) {
                 use_method_serial = true;
                 use_method_count++;
+            } else if (strcmp("separable", argv[i + 1]) == 0) {
+                use_method_separable = true;
+                use_method_count++;
+            } else if (strcmp("recurrence", argv[i + 1]) == 0) {
+                use_method_recurrence = true;
+                use_method_count++;
             } else if (strcmp("openmp", argv[i + 1]) == 0) {
                 use_method_openmp = true;
                 use_method_count++;
@@ -422,6 +462,20 @@ int main(int argc, char* argv[]) {
 		}
 		check = argv[i + 1];
 		i++;
+        } else if (strcmp("--tolerance", argv[i]) == 0) {
+            if (i >= argc - 1) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            tolerance = get_positive_integer_or_fail(exec_name, argv[i], argv[i + 1]);
+            i++;
+        } else if (strcmp("--error-sweep", argv[i]) == 0) {
+            if (i >= argc - 1) {
+                fail_missing_argument(exec_name, argv[i]);
+            }
+
+            sweep = get_strictly_positive_integer_or_fail(exec_name, argv[i], argv[i + 1]);
+            i++;
         } else if (strcmp("--help", argv[i]) == 0) {
             show_help(stdout, exec_name);
             exit(0);
@@ -446,6 +500,10 @@ int main(int argc, char* argv[]) {
 
 	    if (0 == strcmp(benchmark, "serial")) {
 		    run_benchmark_serial(width, height, taylor, 200.0, iterations);
+	    } else if (0 == strcmp(benchmark, "separable")) {
+		    run_benchmark_separable(width, height, taylor, 200.0, iterations);
+	    } else if (0 == strcmp(benchmark, "recurrence")) {
+		    run_benchmark_recurrence(width, height, taylor, 200.0, iterations);
 	    } else if (0 == strcmp(benchmark, "mp")) {
 		    run_benchmark_mp(width, height, taylor, 200.0, iterations);
 	    } else if(0 == strcmp(benchmark, "cl")) {
@@ -461,15 +519,40 @@ int main(int argc, char* argv[]) {
 	    goto done;
     }
 
+    if (sweep > 0) {
+        if (sinoscope_recurrence_sweep(width, height, sweep, 200.0) < 0) {
+            LOG_ERROR("failed to sweep the recurrence error");
+            exit(1);
+        }
+
+        goto done;
+    }
+
     if (check) {
 
 	    if (0 == strcmp(check, "mp")) {
-		    run_check_mp(width, height, taylor, 200.0);
+		    /* the vectorized sin, cos and atan are not correctly rounded */
+		    run_check("openmp", sinoscope_image_openmp, NULL, width, height, taylor, 200.0,
+			      (tolerance < 0) ? 10 : tolerance);
 	    } else if(0 == strcmp(check, "cl")) {
 		    	    sinoscope_opencl_ptr =
 		    configure_opencl(opencl_platform_index, opencl_device_index, &sinoscope_opencl, width, height);
 
-		    run_check_cl(sinoscope_opencl_ptr, width, height, taylor, 200.0);
+		    run_check("opencl", sinoscope_image_opencl, sinoscope_opencl_ptr, width, height, taylor, 200.0,
+			      (tolerance < 0) ? 10 : tolerance);
+	    } else if (0 == strcmp(check, "separable")) {
+		    /* the row and column sums round differently from the sum of the terms */
+		    run_check("separable", sinoscope_image_separable, NULL, width, height, taylor, 200.0,
+			      (tolerance < 0) ? 10 : tolerance);
+	    } else if (0 == strcmp(check, "recurrence")) {
+		    run_check("recurrence", sinoscope_image_recurrence, NULL, width, height, taylor, 200.0,
+			      (tolerance < 0) ? 10 : tolerance);
+	    } else if (0 == strcmp(check, "palette")) {
+		    /* exact, every value the color stage can receive */
+		    if (color_palette_check(200.0) < 0) {
+			    LOG_ERROR("failed to check palette");
+			    exit(1);
+		    }
 	    } else {
 		    fprintf(stderr, "Invalid check: %s\n", check);
 		    exit(EXIT_FAILURE);
@@ -486,6 +569,10 @@ int main(int argc, char* argv[]) {
 
     if (use_method_serial) {
         sinoscope = sinoscope_create("serial", sinoscope_image_serial, width, height, 200.0);
+    } else if (use_method_separable) {
+        sinoscope = sinoscope_create("separable", sinoscope_image_separable, width, height, 200.0);
+    } else if (use_method_recurrence) {
+        sinoscope = sinoscope_create("recurrence", sinoscope_image_recurrence, width, height, 200.0);
     } else if (use_method_openmp) {
         sinoscope = sinoscope_create("openmp", sinoscope_image_openmp, width, height, 200.0);
     } else if (use_method_opencl) {
@@ -0,0 +1,69 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd-math.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define SIMD_SUFFIX avx512
+#define SIMD_WIDTH 16
+#define SIMD_TARGET __attribute__((target("avx512f")))
+#include "simd-math-impl.h"
+#undef SIMD_TARGET
+#undef SIMD_WIDTH
+#undef SIMD_SUFFIX
+
+#define SIMD_SUFFIX avx2
+#define SIMD_WIDTH 8
+#define SIMD_TARGET __attribute__((target("avx2,fma")))
+#include "simd-math-impl.h"
+#undef SIMD_TARGET
+#undef SIMD_WIDTH
+#undef SIMD_SUFFIX
+
+#endif
+
+/* SSE on x86-64, whatever 128-bit vectors the compiler targets elsewhere */
+#define SIMD_SUFFIX sse
+#define SIMD_WIDTH 4
+#define SIMD_TARGET
+#include "simd-math-impl.h"
+#undef SIMD_TARGET
+#undef SIMD_WIDTH
+#undef SIMD_SUFFIX
+
+static const simd_math_t* simd_math_select(void) {
+    const char* forced = getenv("SIMD_MATH_ISA");
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    bool allow_avx512 = forced == NULL || strcmp(forced, "avx512") == 0;
+    bool allow_avx2   = allow_avx512 || strcmp(forced, "avx2") == 0;
+
+    if (allow_avx512 && __builtin_cpu_supports("avx512f")) {
+        return &simd_math_avx512;
+    }
+
+    if (allow_avx2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return &simd_math_avx2;
+    }
+#endif
+
+    return &simd_math_sse;
+}
+
+const simd_math_t* simd_math_get(void) {
+    static const simd_math_t* simd_math = NULL;
+
+    /* every thread selects the same functions, the race is harmless */
+    const simd_math_t* selected = __atomic_load_n(&simd_math, __ATOMIC_RELAXED);
+    if (selected == NULL) {
+        selected = simd_math_select();
+        __atomic_store_n(&simd_math, selected, __ATOMIC_RELAXED);
+    }
+
+    return selected;
+}
@@ -1,7 +1,11 @@
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "color.h"
 #include "log.h"
 #include "sinoscope.h"
 
@@ -91,8 +95,14 @@ typedef struct sinoscope_float {
     float dy;
 } sinoscope_float_t;
 
-static sinoscope_int_t second_param;
-static sinoscope_float_t third_param;
+/* a frame in flight, computed with the given parameters */
+struct sinoscope_opencl_frame {
+	cl_mem buffer;      /* in host memory, mapped to read the frame */
+	cl_event computed;  /* kernel, NULL when the frame is not in flight */
+	cl_event unmapped;  /* last unmap of the buffer, the next kernel waits for it */
+	sinoscope_int_t second_param;
+	sinoscope_float_t third_param;
+};
 
 int sinoscope_opencl_init(sinoscope_opencl_t* opencl, cl_device_id opencl_device_id, unsigned int width,
 			  unsigned int height) {
@@ -113,12 +123,36 @@ int sinoscope_opencl_init(sinoscope_opencl_t* opencl, cl_device_id opencl_device
 		LOG_ERROR("FAILED TO INITIALIZE COMMAND QUEUE: %s", opencl_errstr(error));
 		return -1;
 	}
+	opencl->transfer = clCreateCommandQueue(opencl->context, opencl->device_id, 0, &error);
+	if (error != CL_SUCCESS){
+		LOG_ERROR("FAILED TO INITIALIZE TRANSFER QUEUE: %s", opencl_errstr(error));
+		return -1;
+	}
 
-	opencl->buffer = clCreateBuffer(opencl->context, CL_MEM_WRITE_ONLY, width * height * 3, NULL, &error);
+	opencl->frames = calloc(SINOSCOPE_OPENCL_FRAMES, sizeof(*opencl->frames));
+	if (opencl->frames == NULL){
+		LOG_ERROR_ERRNO("calloc");
+		return -1;
+	}
+	opencl->frame_first = 0;
+	opencl->frame_count = 0;
+
+	/* the host reads the frames by mapping them, zero copy on CPU devices */
+	for (int i = 0; i < SINOSCOPE_OPENCL_FRAMES; i++){
+		opencl->frames[i].buffer = clCreateBuffer(opencl->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, width * height * 3, NULL, &error);
+		if (error != CL_SUCCESS){
+			LOG_ERROR("FAILED TO INITIALIZE IMAGE BUFFER %d: %s", i, opencl_errstr(error));
+			return -1;
+		}
+	}
+
+	/* filled by the first frame */
+	opencl->palette = clCreateBuffer(opencl->context, CL_MEM_READ_ONLY, sizeof(color_palette_t), NULL, &error);
 	if (error != CL_SUCCESS){
-		LOG_ERROR("FAILED TO INITIALIZE IMAGE BUFFER: %s", opencl_errstr(error));
+		LOG_ERROR("FAILED TO INITIALIZE PALETTE BUFFER: %s", opencl_errstr(error));
 		return -1;
-	} 
+	}
+	opencl->palette_max = NAN;
 
 	char *shader_content = NULL;
 	size_t shader_content_len = 0;
@@ -155,70 +189,187 @@ int sinoscope_opencl_init(sinoscope_opencl_t* opencl, cl_device_id opencl_device
 		return -1;
 	} 
 
-	error = clSetKernelArg(opencl->kernel, 0, sizeof(cl_mem), &opencl->buffer);
+	/* the buffer and parameters are set by every frame */
+	error = clSetKernelArg(opencl->kernel, 3, sizeof(cl_mem), &opencl->palette);
+	if(error != CL_SUCCESS){
+		LOG_ERROR("FAILED TO ADD ARG 3 TO KERNEL: %s", opencl_errstr(error));
+		return -1;
+	}
+
+	return 0;
+}
+
+void sinoscope_opencl_cleanup(sinoscope_opencl_t* opencl){
+	/* the frames computed ahead are never read */
+	clFinish(opencl->queue);
+	clFinish(opencl->transfer);
+
+	for (int i = 0; i < SINOSCOPE_OPENCL_FRAMES; i++){
+		sinoscope_opencl_frame_t* frame = &opencl->frames[i];
+		if (frame->computed != NULL){
+			clReleaseEvent(frame->computed);
+		}
+		if (frame->unmapped != NULL){
+			clReleaseEvent(frame->unmapped);
+		}
+		clReleaseMemObject(frame->buffer);
+	}
+	free(opencl->frames);
+
+	clReleaseKernel(opencl->kernel);
+	clReleaseMemObject(opencl->palette);
+	clReleaseCommandQueue(opencl->transfer);
+	clReleaseCommandQueue(opencl->queue);
+	clReleaseContext(opencl->context);
+}
+
+static void frame_params(sinoscope_t* sinoscope, sinoscope_int_t* second_param, sinoscope_float_t* third_param) {
+	second_param->buffer_size = sinoscope->buffer_size;
+	second_param->height = sinoscope->height;
+	second_param->width = sinoscope->width;
+	second_param->interval = sinoscope->interval;
+	second_param->taylor = sinoscope->taylor;
+
+	third_param->interval_inverse = sinoscope->interval_inverse;
+	third_param->time = sinoscope->time;
+	third_param->max = sinoscope->max;
+	third_param->phase0 = sinoscope->phase0;
+	third_param->phase1 = sinoscope->phase1;
+	third_param->dx = sinoscope->dx;
+	third_param->dy = sinoscope->dy;
+}
+
+/* starts the kernel of a frame in the next free buffer, once the host is done with it */
+static int frame_enqueue(sinoscope_opencl_t* opencl, sinoscope_t* sinoscope) {
+	unsigned int index = (opencl->frame_first + opencl->frame_count) % SINOSCOPE_OPENCL_FRAMES;
+	sinoscope_opencl_frame_t* frame = &opencl->frames[index];
+
+	frame_params(sinoscope, &frame->second_param, &frame->third_param);
+
+	cl_int error = clSetKernelArg(opencl->kernel, 0, sizeof(cl_mem), &frame->buffer);
 	if(error != CL_SUCCESS){
 		LOG_ERROR("FAILED TO ADD ARG 0 TO KERNEL: %s", opencl_errstr(error));
 		return -1;
 	} 
-	error = clSetKernelArg(opencl->kernel, 1, sizeof(sinoscope_int_t), &second_param);
+	error = clSetKernelArg(opencl->kernel, 1, sizeof(sinoscope_int_t), &frame->second_param);
 	if(error != CL_SUCCESS){
 		LOG_ERROR("FAILED TO ADD ARG 1 TO KERNEL: SIZE: %lu, %s", sizeof(sinoscope_int_t), opencl_errstr(error));
 		return -1;
 	} 
-	error = clSetKernelArg(opencl->kernel, 2, sizeof(sinoscope_float_t), &third_param);
+	error = clSetKernelArg(opencl->kernel, 2, sizeof(sinoscope_float_t), &frame->third_param);
 	if(error != CL_SUCCESS){
 		LOG_ERROR("FAILED TO ADD ARG 2 TO KERNEL: SIZE: %lu, %s", sizeof(sinoscope_float_t), opencl_errstr(error));
 		return -1;
 	} 
 
+	const size_t total_size[2] = {sinoscope->width, sinoscope->height};
+	error = clEnqueueNDRangeKernel(opencl->queue, opencl->kernel, 2, NULL, total_size, NULL, (frame->unmapped != NULL) ? 1 : 0, (frame->unmapped != NULL) ? &frame->unmapped : NULL, &frame->computed);
+	if(error != CL_SUCCESS){
+		LOG_ERROR("FAILED TO ENQUEUE OPENCL KERNEL: %s", opencl_errstr(error));
+		return -1;
+	} 
+
+	opencl->frame_count++;
+
 	return 0;
 }
 
-void sinoscope_opencl_cleanup(sinoscope_opencl_t* opencl){
-	clReleaseKernel(opencl->kernel);
-	clReleaseMemObject(opencl->buffer);
-	clReleaseCommandQueue(opencl->queue);
-	clReleaseContext(opencl->context);
+/* drops the frames computed ahead */
+static void frame_drain(sinoscope_opencl_t* opencl) {
+	for (unsigned int i = 0; i < opencl->frame_count; i++){
+		sinoscope_opencl_frame_t* frame = &opencl->frames[(opencl->frame_first + i) % SINOSCOPE_OPENCL_FRAMES];
+		clWaitForEvents(1, &frame->computed);
+		clReleaseEvent(frame->computed);
+		frame->computed = NULL;
+	}
+
+	opencl->frame_count = 0;
 }
 
+/*
+ * The frame asked for is usually already computed or running: sinoscope_corners()
+ * only moves the time forward, so the next frames are known in advance. When
+ * the parameters changed (check, other taylor or max), the frames computed
+ * ahead are dropped and the frame is computed right away.
+ */
 int sinoscope_image_opencl(sinoscope_t* sinoscope) {
-	second_param.buffer_size = sinoscope->buffer_size;
-	second_param.height = sinoscope->height;
-	second_param.width = sinoscope->width;
-	second_param.interval = sinoscope->interval;
-	second_param.taylor = sinoscope->taylor;
-
-	third_param.interval_inverse = sinoscope->interval_inverse;
-	third_param.time = sinoscope->time;
-	third_param.max = sinoscope->max;
-	third_param.phase0 = sinoscope->phase0;
-	third_param.phase1 = sinoscope->phase1;
-	third_param.dx = sinoscope->dx;
-	third_param.dy = sinoscope->dy;
-	
-	cl_int error = clSetKernelArg(sinoscope->opencl->kernel, 1, sizeof(sinoscope_int_t), &second_param);
-	if(error != CL_SUCCESS){
-		LOG_ERROR("FAILED TO ADD ARG 1 TO KERNEL: SIZE: %lu, %s", sizeof(sinoscope_int_t), opencl_errstr(error));
+	sinoscope_opencl_t* opencl = sinoscope->opencl;
+
+	sinoscope_int_t second_param;
+	sinoscope_float_t third_param;
+	frame_params(sinoscope, &second_param, &third_param);
+
+	if (opencl->frame_count > 0){
+		sinoscope_opencl_frame_t* first = &opencl->frames[opencl->frame_first];
+		if (memcmp(&first->second_param, &second_param, sizeof(second_param)) != 0 ||
+		    memcmp(&first->third_param, &third_param, sizeof(third_param)) != 0){
+			frame_drain(opencl);
+		}
+	}
+
+	/* the palette only goes to the device when max changed, the frames of the old max are drained */
+	color_palette_update(&sinoscope->palette, sinoscope->max);
+	cl_int error;
+	if (opencl->palette_max != sinoscope->palette.max) {
+		error = clEnqueueWriteBuffer(opencl->queue, opencl->palette, CL_TRUE, 0, sizeof(color_palette_t), &sinoscope->palette, 0, NULL, NULL);
+		if(error != CL_SUCCESS){
+			LOG_ERROR("FAILED TO ENQUEUE WRITE PALETTE OP: %s", opencl_errstr(error));
+			return -1;
+		}
+		opencl->palette_max = sinoscope->palette.max;
+	}
+
+	if (opencl->frame_count == 0 && frame_enqueue(opencl, sinoscope) < 0){
 		return -1;
-	} 
-	error = clSetKernelArg(sinoscope->opencl->kernel, 2, sizeof(sinoscope_float_t), &third_param);
+	}
+
+	sinoscope_opencl_frame_t* frame = &opencl->frames[opencl->frame_first];
+
+	cl_event mapped;
+	unsigned char* pixels = clEnqueueMapBuffer(opencl->transfer, frame->buffer, CL_FALSE, CL_MAP_READ, 0, sinoscope->buffer_size, 1, &frame->computed, &mapped, &error);
 	if(error != CL_SUCCESS){
-		LOG_ERROR("FAILED TO ADD ARG 2 TO KERNEL: SIZE: %lu, %s", sizeof(sinoscope_float_t), opencl_errstr(error));
+		LOG_ERROR("FAILED TO ENQUEUE MAP IMAGE OP: %s", opencl_errstr(error));
 		return -1;
 	} 
 
-	const size_t total_size[2] = {sinoscope->width, sinoscope->height};
-	error = clEnqueueNDRangeKernel(sinoscope->opencl->queue, sinoscope->opencl->kernel, 2, NULL, total_size, NULL, 0, NULL, NULL);
+	/* the next frames run while this one is read */
+	sinoscope_t ahead = *sinoscope;
+	for (unsigned int i = 1; i < SINOSCOPE_OPENCL_FRAMES; i++){
+		if (sinoscope_corners(&ahead) < 0){
+			return -1;
+		}
+		if (i >= opencl->frame_count && frame_enqueue(opencl, &ahead) < 0){
+			return -1;
+		}
+	}
+
+	clFlush(opencl->queue);
+	clFlush(opencl->transfer);
+
+	error = clWaitForEvents(1, &mapped);
+	clReleaseEvent(mapped);
 	if(error != CL_SUCCESS){
-		LOG_ERROR("FAILED TO ENQUEUE OPENCL KERNEL: %s", opencl_errstr(error));
+		LOG_ERROR("FAILED TO MAP IMAGE: %s", opencl_errstr(error));
 		return -1;
 	} 
-	
-	error = clEnqueueReadBuffer(sinoscope->opencl->queue, sinoscope->opencl->buffer, CL_TRUE, 0, sinoscope->buffer_size, sinoscope->buffer, 0, NULL, NULL);
+
+	memcpy(sinoscope->buffer, pixels, sinoscope->buffer_size);
+
+	if (frame->unmapped != NULL){
+		clReleaseEvent(frame->unmapped);
+	}
+	error = clEnqueueUnmapMemObject(opencl->transfer, frame->buffer, pixels, 0, NULL, &frame->unmapped);
 	if(error != CL_SUCCESS){
-		LOG_ERROR("FAILED TO ENQUEUE READ IMAGE OP: %s", opencl_errstr(error));
+		frame->unmapped = NULL;
+		LOG_ERROR("FAILED TO ENQUEUE UNMAP IMAGE OP: %s", opencl_errstr(error));
 		return -1;
 	} 
+	clFlush(opencl->transfer);
+
+	clReleaseEvent(frame->computed);
+	frame->computed = NULL;
+	opencl->frame_first = (opencl->frame_first + 1) % SINOSCOPE_OPENCL_FRAMES;
+	opencl->frame_count--;
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -1,45 +1,117 @@
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <omp.h>
 
 #include "color.h"
 #include "log.h"
+#include "simd-math.h"
 #include "sinoscope.h"
 
+/*
+ * Rows are spread over the threads, a row is computed SIMD_MATH_BLOCK pixels
+ * at a time with the vectorized sin, cos and atan. The sine terms only depend
+ * on the row, they are computed once per row.
+ */
+
 int sinoscope_image_openmp(sinoscope_t* sinoscope) {
 	if (sinoscope == NULL) {
         LOG_ERROR_NULL_PTR();
         goto fail_exit;
     }
 
+    const simd_math_t* math = simd_math_get();
+    unsigned int terms      = (sinoscope->taylor + 1) / 2;
+
+    color_palette_update(&sinoscope->palette, sinoscope->max);
+
+    /* the buffer is written through a char pointer, which could alias every field */
+    unsigned char* buffer          = sinoscope->buffer;
+    const int width                = sinoscope->width;
+    const int height               = sinoscope->height;
+    const float dx                 = sinoscope->dx;
+    const float dy                 = sinoscope->dy;
+    const float phase0             = sinoscope->phase0;
+    const float phase1             = sinoscope->phase1;
+    const float time               = sinoscope->time;
+    const color_palette_t palette  = sinoscope->palette;
+
+    /* sine terms of the row of every thread */
+    float* sines = malloc(omp_get_max_threads() * terms * sizeof(*sines));
+    if (sines == NULL) {
+        LOG_ERROR_ERRNO("malloc");
+        goto fail_exit;
+    }
+
 	#pragma omp parallel
 	#pragma omp for schedule(dynamic)
-	for (int j = 0; j < sinoscope->height; j++){
-		for (int i = 0; i < sinoscope->width; i++) {
-            float px    = sinoscope->dx * j - 2 * M_PI;
-            float py    = sinoscope->dy * i - 2 * M_PI;
-            float value = 0;
-
-            for (int k = 1; k <= sinoscope->taylor; k += 2) {
-                value += sin(px * k * sinoscope->phase1 + sinoscope->time) / k;
-                value += cos(py * k * sinoscope->phase0) / k;
+	for (int j = 0; j < height; j++){
+        float* row_sines = &sines[omp_get_thread_num() * terms];
+        float px         = dx * j - 2 * M_PI;
+
+        for (int t = 0; t < terms; t++) {
+            int k        = 2 * t + 1;
+            row_sines[t] = px * k * phase1 + time;
+        }
+
+        math->sin(row_sines, row_sines, terms);
+
+        for (int t = 0; t < terms; t++) {
+            row_sines[t] /= 2 * t + 1;
+        }
+
+		for (int first = 0; first < width; first += SIMD_MATH_BLOCK) {
+            int count = width - first;
+            if (count > SIMD_MATH_BLOCK) {
+                count = SIMD_MATH_BLOCK;
+            }
+
+            float py[SIMD_MATH_BLOCK];
+            float arguments[SIMD_MATH_BLOCK];
+            float cosines[SIMD_MATH_BLOCK];
+            float values[SIMD_MATH_BLOCK];
+
+            for (int l = 0; l < count; l++) {
+                py[l]     = dy * (first + l) - 2 * M_PI;
+                values[l] = 0;
+            }
+
+            for (int t = 0; t < terms; t++) {
+                int k = 2 * t + 1;
+
+                for (int l = 0; l < count; l++) {
+                    arguments[l] = py[l] * k * phase0;
+                }
+
+                math->cos(arguments, cosines, count);
+
+                for (int l = 0; l < count; l++) {
+                    values[l] += row_sines[t];
+                    values[l] += cosines[l] / k;
+                }
             }
 
-            value = (atan(value) - atan(-value)) / M_PI;
-            value = (value + 1) * 100;
+            math->atan(values, values, count);
 
-            pixel_t pixel;
-            color_value(&pixel, value, sinoscope->interval, sinoscope->interval_inverse);
+            for (int l = 0; l < count; l++) {
+                float value = (values[l] - (-values[l])) / M_PI;
+                value       = (value + 1) * 100;
 
-            int index = (i * 3) + (j * 3) * sinoscope->width;
+                pixel_t pixel;
+                color_palette_value(&palette, &pixel, value);
 
-            sinoscope->buffer[index + 0] = pixel.bytes[0];
-            sinoscope->buffer[index + 1] = pixel.bytes[1];
-            sinoscope->buffer[index + 2] = pixel.bytes[2];
+                int index = ((first + l) * 3) + (j * 3) * width;
+
+                buffer[index + 0] = pixel.bytes[0];
+                buffer[index + 1] = pixel.bytes[1];
+                buffer[index + 2] = pixel.bytes[2];
+            }
         }
     }
 
+    free(sines);
+
     return 0;
 
 fail_exit:
@@ -0,0 +1,197 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "color.h"
+#include "log.h"
+#include "sinoscope.h"
+
+/*
+ * The odd harmonics follow the Chebyshev recurrence
+ *
+ *   sin((k + 2) a + t) = 2 cos(2 a) sin(k a + t) - sin((k - 2) a + t)
+ *   cos((k + 2) b)     = 2 cos(2 b) cos(k b)     - cos((k - 2) b)
+ *
+ * so a pixel costs five sin/cos calls whatever the number of terms. The
+ * recurrence runs in double precision, its error grows about linearly with k
+ * and stays far below the float sum. The serial method rounds every argument
+ * k a + t to float, so the two differ by a few float ulps of the largest
+ * argument, see sinoscope_recurrence_sweep().
+ */
+
+static float recurrence_value(sinoscope_t* sinoscope, float px, float py) {
+    double a = (double)px * sinoscope->phase1;
+    double b = (double)py * sinoscope->phase0;
+
+    /* the terms of k = -1 start the recurrences */
+    double sine          = sin(a + sinoscope->time);
+    double sine_previous = sin(sinoscope->time - a);
+    double sine_factor   = 2 * cos(2 * a);
+
+    double cosine          = cos(b);
+    double cosine_previous = cosine;
+    double cosine_factor   = 2 * cos(2 * b);
+
+    float value = 0;
+
+    for (int k = 1; k <= sinoscope->taylor; k += 2) {
+        value += sine / k;
+        value += cosine / k;
+
+        double sine_next   = sine_factor * sine - sine_previous;
+        double cosine_next = cosine_factor * cosine - cosine_previous;
+
+        sine_previous   = sine;
+        sine            = sine_next;
+        cosine_previous = cosine;
+        cosine          = cosine_next;
+    }
+
+    return value;
+}
+
+/* the sum of sinoscope_image_serial(), for the error sweep */
+static float serial_value(sinoscope_t* sinoscope, float px, float py) {
+    float value = 0;
+
+    for (int k = 1; k <= sinoscope->taylor; k += 2) {
+        value += sin(px * k * sinoscope->phase1 + sinoscope->time) / k;
+        value += cos(py * k * sinoscope->phase0) / k;
+    }
+
+    return value;
+}
+
+/* the same terms evaluated one by one with exact arguments, isolates the error of the recurrence */
+static float exact_value(sinoscope_t* sinoscope, float px, float py) {
+    double a    = (double)px * sinoscope->phase1;
+    double b    = (double)py * sinoscope->phase0;
+    float value = 0;
+
+    for (int k = 1; k <= sinoscope->taylor; k += 2) {
+        value += sin(k * a + sinoscope->time) / k;
+        value += cos(k * b) / k;
+    }
+
+    return value;
+}
+
+static void value_pixel(sinoscope_t* sinoscope, float value, pixel_t* pixel) {
+    value = (atan(value) - atan(-value)) / M_PI;
+    value = (value + 1) * 100;
+
+    color_palette_value(&sinoscope->palette, pixel, value);
+}
+
+int sinoscope_image_recurrence(sinoscope_t* sinoscope) {
+    if (sinoscope == NULL) {
+        LOG_ERROR_NULL_PTR();
+        goto fail_exit;
+    }
+
+    color_palette_update(&sinoscope->palette, sinoscope->max);
+
+    for (int j = 0; j < sinoscope->height; j++) {
+        for (int i = 0; i < sinoscope->width; i++) {
+            float px = sinoscope->dx * j - 2 * M_PI;
+            float py = sinoscope->dy * i - 2 * M_PI;
+
+            pixel_t pixel;
+            value_pixel(sinoscope, recurrence_value(sinoscope, px, py), &pixel);
+
+            int index = (i * 3) + (j * 3) * sinoscope->width;
+
+            sinoscope->buffer[index + 0] = pixel.bytes[0];
+            sinoscope->buffer[index + 1] = pixel.bytes[1];
+            sinoscope->buffer[index + 2] = pixel.bytes[2];
+        }
+    }
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+/*
+ * Error of the recurrence for taylor from 1 to max_taylor, doubling each
+ * time, over a few random frames: largest and mean absolute difference of the
+ * sum before the atan against serial, largest against the same terms with
+ * exact arguments, largest difference of a color byte against serial and
+ * share of the bytes that differ.
+ */
+int sinoscope_recurrence_sweep(unsigned int width, unsigned int height, unsigned int max_taylor, float max) {
+    const int frames = 3;
+
+    sinoscope_t* sinoscope = sinoscope_create("recurrence", sinoscope_image_recurrence, width, height, max);
+    if (sinoscope == NULL) {
+        LOG_ERROR("failed to create sinoscope (recurrence)");
+        goto fail_exit;
+    }
+
+    printf("taylor  serial max  serial mean   exact max  max byte diff  bytes differing\n");
+
+    for (unsigned int taylor = 1;; taylor = (taylor * 2 < max_taylor) ? taylor * 2 + 1 : max_taylor) {
+        double max_error     = 0;
+        double total_error   = 0;
+        double max_drift     = 0;
+        int max_byte_diff    = 0;
+        unsigned long differ = 0;
+
+        sinoscope->taylor = taylor;
+
+        for (int frame = 0; frame < frames; frame++) {
+            sinoscope->time = (((float)rand()) / ((float)RAND_MAX)) * (2 * M_PI * 1000);
+            if (sinoscope_corners(sinoscope) < 0) {
+                LOG_ERROR("failed to forward sinoscope");
+                goto fail_destroy;
+            }
+
+            for (int j = 0; j < height; j++) {
+                for (int i = 0; i < width; i++) {
+                    float px = sinoscope->dx * j - 2 * M_PI;
+                    float py = sinoscope->dy * i - 2 * M_PI;
+
+                    float expected = serial_value(sinoscope, px, py);
+                    float value    = recurrence_value(sinoscope, px, py);
+                    double error   = fabs((double)value - expected);
+
+                    max_error = fmax(max_error, error);
+                    total_error += error;
+                    max_drift = fmax(max_drift, fabs((double)value - exact_value(sinoscope, px, py)));
+
+                    pixel_t expected_pixel;
+                    pixel_t pixel;
+                    value_pixel(sinoscope, expected, &expected_pixel);
+                    value_pixel(sinoscope, value, &pixel);
+
+                    for (int c = 0; c < 3; c++) {
+                        int diff = abs(pixel.bytes[c] - expected_pixel.bytes[c]);
+                        if (diff > max_byte_diff) {
+                            max_byte_diff = diff;
+                        }
+                        differ += diff != 0;
+                    }
+                }
+            }
+        }
+
+        unsigned long bytes = (unsigned long)frames * width * height * 3;
+        printf("%6u  %10.3e   %10.3e  %10.3e  %13d  %14.4f%%\n", taylor, max_error,
+               total_error / ((unsigned long)frames * width * height), max_drift, max_byte_diff,
+               100.0 * differ / bytes);
+
+        if (taylor >= max_taylor) {
+            break;
+        }
+    }
+
+    sinoscope_destroy(sinoscope);
+
+    return 0;
+
+fail_destroy:
+    sinoscope_destroy(sinoscope);
+fail_exit:
+    return -1;
+}
@@ -0,0 +1,70 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "color.h"
+#include "log.h"
+#include "sinoscope.h"
+
+/*
+ * In the Taylor sum of a pixel, the sine terms only depend on its row and the
+ * cosine terms only on its column. Both sums are computed once per frame, so a
+ * pixel costs an add, the atan and the color mapping: O(W.T + H.T + W.H)
+ * instead of O(W.H.T). The two sums are added at the end instead of term by
+ * term, the colors may differ slightly from the serial method.
+ */
+
+int sinoscope_image_separable(sinoscope_t* sinoscope) {
+    if (sinoscope == NULL) {
+        LOG_ERROR_NULL_PTR();
+        goto fail_exit;
+    }
+
+    color_palette_update(&sinoscope->palette, sinoscope->max);
+
+    for (int j = 0; j < sinoscope->height; j++) {
+        float px    = sinoscope->dx * j - 2 * M_PI;
+        float value = 0;
+
+        for (int k = 1; k <= sinoscope->taylor; k += 2) {
+            value += sin(px * k * sinoscope->phase1 + sinoscope->time) / k;
+        }
+
+        sinoscope->rows[j] = value;
+    }
+
+    for (int i = 0; i < sinoscope->width; i++) {
+        float py    = sinoscope->dy * i - 2 * M_PI;
+        float value = 0;
+
+        for (int k = 1; k <= sinoscope->taylor; k += 2) {
+            value += cos(py * k * sinoscope->phase0) / k;
+        }
+
+        sinoscope->columns[i] = value;
+    }
+
+    /* row by row, the buffer is written in order */
+    for (int j = 0; j < sinoscope->height; j++) {
+        for (int i = 0; i < sinoscope->width; i++) {
+            float value = sinoscope->rows[j] + sinoscope->columns[i];
+
+            value = (atan(value) - atan(-value)) / M_PI;
+            value = (value + 1) * 100;
+
+            pixel_t pixel;
+            color_palette_value(&sinoscope->palette, &pixel, value);
+
+            int index = (i * 3) + (j * 3) * sinoscope->width;
+
+            sinoscope->buffer[index + 0] = pixel.bytes[0];
+            sinoscope->buffer[index + 1] = pixel.bytes[1];
+            sinoscope->buffer[index + 2] = pixel.bytes[2];
+        }
+    }
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
@@ -36,12 +36,20 @@ sinoscope_t* sinoscope_create(char* name, sinoscope_handler handler, unsigned in
         goto fail_free_sinoscope;
     }
 
+    sinoscope->rows    = malloc(height * sizeof(*sinoscope->rows));
+    sinoscope->columns = malloc(width * sizeof(*sinoscope->columns));
+    if (sinoscope->rows == NULL || sinoscope->columns == NULL) {
+        LOG_ERROR_ERRNO("malloc");
+        goto fail_free_buffer;
+    }
+
     sinoscope->width  = width;
     sinoscope->height = height;
     sinoscope->taylor = 3;
 
     sinoscope->interval         = color_get_interval(max);
     sinoscope->interval_inverse = color_get_interval_inverse(max);
+    color_palette_init(&sinoscope->palette, max);
 
     sinoscope->time   = 0;
     sinoscope->max    = max;
@@ -53,6 +61,10 @@ sinoscope_t* sinoscope_create(char* name, sinoscope_handler handler, unsigned in
 
     return sinoscope;
 
+fail_free_buffer:
+    free(sinoscope->columns);
+    free(sinoscope->rows);
+    free(sinoscope->buffer);
 fail_free_sinoscope:
     free(sinoscope);
 fail_exit:
@@ -60,6 +72,8 @@ fail_exit:
 }
 
 void sinoscope_destroy(sinoscope_t* sinoscope) {
+    free(sinoscope->columns);
+    free(sinoscope->rows);
     free(sinoscope->buffer);
     free(sinoscope);
 }
@@ -98,21 +112,9 @@ fail_exit:
     return -1;
 }
 
-static int compare_methods(sinoscope_t* serial, sinoscope_t* openmp, sinoscope_t* opencl) {
+/* every byte of compare must be within tolerance of the serial output */
+static int compare_methods(sinoscope_t* base, sinoscope_t* compare, unsigned int tolerance) {
     int status;
-    sinoscope_t *base;
-    sinoscope_t *compare;
-    long long max_diff;
-
-    base = serial;
-
-    if (openmp) {
-	    max_diff = 0;
-	    compare  = openmp;
-    } else {
-	    compare  = opencl;
-	    max_diff = 10;
-    }
 
     if (base->buffer_size != compare->buffer_size) {
         LOG_ERROR("buffer sizes mismatch");
@@ -129,7 +131,7 @@ static int compare_methods(sinoscope_t* serial, sinoscope_t* openmp, sinoscope_t
         goto fail_exit;
     }
 
-    status = base->handler(serial);
+    status = base->handler(base);
     status += compare->handler(compare);
 
     if (status != 0) {
@@ -138,12 +140,12 @@ static int compare_methods(sinoscope_t* serial, sinoscope_t* openmp, sinoscope_t
     }
 
     for (int i = 0; i < buffer_size; i++) {
-        int base_value = base->buffer[i];
+        int base_value    = base->buffer[i];
         int compare_value = compare->buffer[i];
 
-        if (abs(compare_value - base_value) > max_diff) {
+        if (abs(compare_value - base_value) > tolerance) {
             printf("[%d] differs from [%d] at %d\n", compare_value, base_value, i);
-	    exit(EXIT_FAILURE);
+            exit(EXIT_FAILURE);
         }
     }
 
@@ -153,11 +155,10 @@ fail_exit:
     return -1;
 }
 
-int sinoscope_check(unsigned int width, unsigned int height, unsigned int taylor, float max,
-                    sinoscope_opencl_t* opencl) {
-    sinoscope_t* sinoscope_serial = NULL;
-    sinoscope_t* sinoscope_openmp = NULL;
-    sinoscope_t* sinoscope_opencl = NULL;
+int sinoscope_check(char* name, sinoscope_handler handler, unsigned int width, unsigned int height,
+                    unsigned int taylor, float max, sinoscope_opencl_t* opencl, unsigned int tolerance) {
+    sinoscope_t* sinoscope_serial  = NULL;
+    sinoscope_t* sinoscope_compare = NULL;
 
     sinoscope_serial = sinoscope_create("serial", sinoscope_image_serial, width, height, max);
     if (sinoscope_serial == NULL) {
@@ -166,45 +167,27 @@ int sinoscope_check(unsigned int width, unsigned int height, unsigned int taylor
     }
     sinoscope_serial->taylor = taylor;
 
-    if (!opencl) {
-    sinoscope_openmp = sinoscope_create("openmp", sinoscope_image_openmp, width, height, max);
-    if (sinoscope_openmp == NULL) {
-        LOG_ERROR("failed to create sinoscope (openmp)");
-        goto fail_exit;
-    }
-    sinoscope_openmp->taylor = taylor;
-    } else {
-    sinoscope_opencl = sinoscope_create("opencl", sinoscope_image_opencl, width, height, max);
-    if (sinoscope_opencl == NULL) {
-        LOG_ERROR("failed to create sinoscope (opencl)");
+    sinoscope_compare = sinoscope_create(name, handler, width, height, max);
+    if (sinoscope_compare == NULL) {
+        LOG_ERROR("failed to create sinoscope (%s)", name);
         goto fail_exit;
     }
-    sinoscope_opencl->taylor = taylor;
-    sinoscope_opencl->opencl = opencl;
-    }
+    sinoscope_compare->taylor = taylor;
+    sinoscope_compare->opencl = opencl;
 
     for (int i = 0; i < 10; i++) {
-        float time             = (((float)rand()) / ((float)RAND_MAX)) * (2 * M_PI * 1000);
-        sinoscope_serial->time = time;
-	if (!opencl) {
-		sinoscope_openmp->time = time;
-	} else {
-		sinoscope_opencl->time = time;
-	}
-
-        if (compare_methods(sinoscope_serial, sinoscope_openmp, sinoscope_opencl) < 0) {
+        float time              = (((float)rand()) / ((float)RAND_MAX)) * (2 * M_PI * 1000);
+        sinoscope_serial->time  = time;
+        sinoscope_compare->time = time;
+
+        if (compare_methods(sinoscope_serial, sinoscope_compare, tolerance) < 0) {
             LOG_ERROR("error when comparing results");
             goto fail_exit;
         }
     }
 
     sinoscope_destroy(sinoscope_serial);
-
-    if (!opencl) {
-    sinoscope_destroy(sinoscope_openmp);
-    } else {
-    sinoscope_destroy(sinoscope_opencl);
-    }
+    sinoscope_destroy(sinoscope_compare);
 
     return 0;
 
@@ -213,12 +196,8 @@ fail_exit:
         sinoscope_destroy(sinoscope_serial);
     }
 
-    if (sinoscope_openmp != NULL) {
-        sinoscope_destroy(sinoscope_openmp);
-    }
-
-    if (sinoscope_opencl != NULL) {
-        sinoscope_destroy(sinoscope_opencl);
+    if (sinoscope_compare != NULL) {
+        sinoscope_destroy(sinoscope_compare);
     }
 
     return -1;
@@ -238,19 +217,55 @@ static uint64_t timeval_diff_us(timeval_t* t1, timeval_t* t2) {
     return (t1_us > t2_us) ? (t1_us - t2_us) : (t2_us - t1_us);
 }
 
-int sinoscope_benchmark(sinoscope_t* sinoscope, unsigned int iterations) {
-    timespec_t start_time;
-    if (clock_gettime(CLOCK_MONOTONIC, &start_time) < 0) {
+typedef struct benchmark_clock {
+    timespec_t time;
+    rusage_t usage;
+} benchmark_clock_t;
+
+static int benchmark_clock_read(benchmark_clock_t* clock) {
+    if (clock_gettime(CLOCK_MONOTONIC, &clock->time) < 0) {
         LOG_ERROR_ERRNO("clock_gettime");
         goto fail_exit;
     }
 
-    rusage_t start_usage;
-    if (getrusage(RUSAGE_SELF, &start_usage) < 0) {
+    if (getrusage(RUSAGE_SELF, &clock->usage) < 0) {
         LOG_ERROR_ERRNO("getrusage failed");
         goto fail_exit;
     }
 
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+/* one line of the results table, from start to now */
+static int benchmark_print(const char* name, unsigned int width, unsigned int height, unsigned int iterations,
+                           benchmark_clock_t* start) {
+    benchmark_clock_t end;
+    if (benchmark_clock_read(&end) < 0) {
+        goto fail_exit;
+    }
+
+    uint64_t utime   = timeval_diff_us(&start->usage.ru_utime, &end.usage.ru_utime);
+    uint64_t stime   = timeval_diff_us(&start->usage.ru_stime, &end.usage.ru_stime);
+    uint64_t elapsed = timespec_diff_us(&start->time, &end.time);
+
+    printf("%s\t%5d    %5u    %8u  %10lu   %10lu    %10lu\n", name, width, height, iterations, utime, stime,
+           elapsed);
+
+    return 0;
+
+fail_exit:
+    return -1;
+}
+
+int sinoscope_benchmark(sinoscope_t* sinoscope, unsigned int iterations) {
+    benchmark_clock_t start;
+    if (benchmark_clock_read(&start) < 0) {
+        goto fail_exit;
+    }
+
     for (unsigned int i = 0; i < iterations; i++) {
         if (sinoscope_corners(sinoscope) < 0) {
             LOG_ERROR("failed to forward sinoscope");
@@ -263,27 +278,94 @@ int sinoscope_benchmark(sinoscope_t* sinoscope, unsigned int iterations) {
         }
     }
 
-    timespec_t end_time;
-    if (clock_gettime(CLOCK_MONOTONIC, &end_time) < 0) {
-        LOG_ERROR_ERRNO("clock_gettime");
+    return benchmark_print(sinoscope->name, sinoscope->width, sinoscope->height, iterations, &start);
+
+fail_exit:
+    return -1;
+}
+
+/*
+ * The color stage alone, color_value() then the palette, over the values of a
+ * serial frame: the difference with a full frame is the cost of the sum.
+ */
+static int sinoscope_benchmark_color(sinoscope_t* sinoscope, unsigned int iterations) {
+    unsigned int count = sinoscope->width * sinoscope->height;
+
+    float* values = malloc(count * sizeof(*values));
+    if (values == NULL) {
+        LOG_ERROR_ERRNO("malloc");
         goto fail_exit;
     }
 
-    rusage_t end_usage;
-    if (getrusage(RUSAGE_SELF, &end_usage) < 0) {
-        LOG_ERROR_ERRNO("getrusage failed");
-        goto fail_exit;
+    if (sinoscope_corners(sinoscope) < 0) {
+        LOG_ERROR("failed to forward sinoscope");
+        goto fail_free_values;
+    }
+
+    for (int j = 0; j < sinoscope->height; j++) {
+        for (int i = 0; i < sinoscope->width; i++) {
+            float px    = sinoscope->dx * j - 2 * M_PI;
+            float py    = sinoscope->dy * i - 2 * M_PI;
+            float value = 0;
+
+            for (int k = 1; k <= sinoscope->taylor; k += 2) {
+                value += sin(px * k * sinoscope->phase1 + sinoscope->time) / k;
+                value += cos(py * k * sinoscope->phase0) / k;
+            }
+
+            value = (atan(value) - atan(-value)) / M_PI;
+
+            values[i + j * sinoscope->width] = (value + 1) * 100;
+        }
+    }
+
+    benchmark_clock_t start;
+    if (benchmark_clock_read(&start) < 0) {
+        goto fail_free_values;
     }
 
-    uint64_t utime   = timeval_diff_us(&start_usage.ru_utime, &end_usage.ru_utime);
-    uint64_t stime   = timeval_diff_us(&start_usage.ru_stime, &end_usage.ru_stime);
-    uint64_t elapsed = timespec_diff_us(&start_time, &end_time);
+    for (unsigned int n = 0; n < iterations; n++) {
+        for (unsigned int i = 0; i < count; i++) {
+            pixel_t pixel;
+            color_value(&pixel, values[i], sinoscope->interval, sinoscope->interval_inverse);
+
+            sinoscope->buffer[i * 3 + 0] = pixel.bytes[0];
+            sinoscope->buffer[i * 3 + 1] = pixel.bytes[1];
+            sinoscope->buffer[i * 3 + 2] = pixel.bytes[2];
+        }
+    }
 
-    printf("%s\t%5d    %5u    %8u  %10lu   %10lu    %10lu\n", sinoscope->name, sinoscope->width, sinoscope->height,
-           iterations, utime, stime, elapsed);
+    if (benchmark_print("color", sinoscope->width, sinoscope->height, iterations, &start) < 0) {
+        goto fail_free_values;
+    }
+
+    if (benchmark_clock_read(&start) < 0) {
+        goto fail_free_values;
+    }
+
+    for (unsigned int n = 0; n < iterations; n++) {
+        color_palette_update(&sinoscope->palette, sinoscope->max);
+
+        for (unsigned int i = 0; i < count; i++) {
+            pixel_t pixel;
+            color_palette_value(&sinoscope->palette, &pixel, values[i]);
+
+            sinoscope->buffer[i * 3 + 0] = pixel.bytes[0];
+            sinoscope->buffer[i * 3 + 1] = pixel.bytes[1];
+            sinoscope->buffer[i * 3 + 2] = pixel.bytes[2];
+        }
+    }
+
+    if (benchmark_print("palette", sinoscope->width, sinoscope->height, iterations, &start) < 0) {
+        goto fail_free_values;
+    }
+
+    free(values);
 
     return 0;
 
+fail_free_values:
+    free(values);
 fail_exit:
     return -1;
 }
@@ -291,8 +373,10 @@ fail_exit:
 int sinoscope_benchmarks(unsigned int width, unsigned int height, unsigned int taylor, float max,
                         sinoscope_opencl_t* opencl, unsigned int iterations) {
     sinoscope_t* sinoscope_serial = NULL;
-    sinoscope_t* sinoscope_openmp = NULL;
-    sinoscope_t* sinoscope_opencl = NULL;
+    sinoscope_t* sinoscope_separable  = NULL;
+    sinoscope_t* sinoscope_recurrence = NULL;
+    sinoscope_t* sinoscope_openmp     = NULL;
+    sinoscope_t* sinoscope_opencl     = NULL;
 
     sinoscope_serial = sinoscope_create("serial", sinoscope_image_serial, width, height, max);
     if (sinoscope_serial == NULL) {
@@ -301,6 +385,20 @@ int sinoscope_benchmarks(unsigned int width, unsigned int height, unsigned int t
     }
     sinoscope_serial->taylor = taylor;
 
+    sinoscope_separable = sinoscope_create("separable", sinoscope_image_separable, width, height, max);
+    if (sinoscope_separable == NULL) {
+        LOG_ERROR("failed to create sinoscope (separable)");
+        goto fail_exit;
+    }
+    sinoscope_separable->taylor = taylor;
+
+    sinoscope_recurrence = sinoscope_create("recurrence", sinoscope_image_recurrence, width, height, max);
+    if (sinoscope_recurrence == NULL) {
+        LOG_ERROR("failed to create sinoscope (recurrence)");
+        goto fail_exit;
+    }
+    sinoscope_recurrence->taylor = taylor;
+
     sinoscope_openmp = sinoscope_create("openmp", sinoscope_image_openmp, width, height, max);
     if (sinoscope_openmp == NULL) {
         LOG_ERROR("failed to create sinoscope (openmp)");
@@ -326,6 +424,16 @@ int sinoscope_benchmarks(unsigned int width, unsigned int height, unsigned int t
         goto fail_exit;
     }
 
+    if (sinoscope_benchmark(sinoscope_separable, iterations) < 0) {
+        LOG_ERROR("failed to benchmark (separable)");
+        goto fail_exit;
+    }
+
+    if (sinoscope_benchmark(sinoscope_recurrence, iterations) < 0) {
+        LOG_ERROR("failed to benchmark (recurrence)");
+        goto fail_exit;
+    }
+
     if (sinoscope_benchmark(sinoscope_openmp, iterations) < 0) {
         LOG_ERROR("failed to benchmark (openmp)");
         goto fail_exit;
@@ -336,9 +444,16 @@ int sinoscope_benchmarks(unsigned int width, unsigned int height, unsigned int t
         goto fail_exit;
     }
 
+    if (sinoscope_benchmark_color(sinoscope_serial, iterations) < 0) {
+        LOG_ERROR("failed to benchmark (color)");
+        goto fail_exit;
+    }
+
     printf("=========================================================================\n");
 
     sinoscope_destroy(sinoscope_serial);
+    sinoscope_destroy(sinoscope_separable);
+    sinoscope_destroy(sinoscope_recurrence);
     sinoscope_destroy(sinoscope_openmp);
     sinoscope_destroy(sinoscope_opencl);
 
@@ -349,6 +464,14 @@ fail_exit:
         sinoscope_destroy(sinoscope_serial);
     }
 
+    if (sinoscope_separable != NULL) {
+        sinoscope_destroy(sinoscope_separable);
+    }
+
+    if (sinoscope_recurrence != NULL) {
+        sinoscope_destroy(sinoscope_recurrence);
+    }
+
     if (sinoscope_openmp != NULL) {
         sinoscope_destroy(sinoscope_openmp);
     }